@@ -0,0 +1,244 @@
+#pragma once
+//==============================================================================
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+#include "bitboard.h"
+#include "piece.h"
+//==============================================================================
+namespace chess {
+//==============================================================================
+namespace detail {
+//==============================================================================
+struct direction {
+  int rank;
+  int file;
+};
+inline constexpr std::array<direction, 4> rook_directions   = {{{1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+inline constexpr std::array<direction, 4> bishop_directions = {{{1, 1}, {1, -1}, {-1, 1}, {-1, -1}}};
+//------------------------------------------------------------------------------
+constexpr auto on_board(int const rank, int const file) -> bool {
+  return rank >= 0 && rank < 8 && file >= 0 && file < 8;
+}
+//------------------------------------------------------------------------------
+/// Walks the rays of a rook or bishop on sq until it hits a blocker in
+/// occupied. Only used to build the lookup tables.
+constexpr auto ray_attacks(std::array<direction, 4> const &directions,
+                           square const sq, bitboard const occupied)
+    -> bitboard {
+  auto attacks = bitboard{0};
+  for (auto const [dr, df] : directions) {
+    auto r = static_cast<int>(rank_of(sq)) + dr;
+    auto f = static_cast<int>(file_of(sq)) + df;
+    for (; on_board(r, f); r += dr, f += df) {
+      auto const bb = square_bb(make_square(r, f));
+      attacks |= bb;
+      if (occupied & bb) {
+        break;
+      }
+    }
+  }
+  return attacks;
+}
+//------------------------------------------------------------------------------
+/// Relevant occupancy of a slider: its rays without the board edge, because a
+/// blocker on the last square of a ray does not change the attack set.
+constexpr auto relevant_occupancy(std::array<direction, 4> const &directions,
+                                  square const sq) -> bitboard {
+  auto mask = bitboard{0};
+  for (auto const [dr, df] : directions) {
+    auto r = static_cast<int>(rank_of(sq)) + dr;
+    auto f = static_cast<int>(file_of(sq)) + df;
+    for (; on_board(r + dr, f + df); r += dr, f += df) {
+      mask |= square_bb(make_square(r, f));
+    }
+  }
+  return mask;
+}
+//------------------------------------------------------------------------------
+template <std::size_t N>
+consteval auto make_leaper_table(std::array<direction, N> const &steps)
+    -> std::array<bitboard, 64> {
+  auto table = std::array<bitboard, 64>{};
+  for (auto sq = std::size_t{0}; sq < 64; ++sq) {
+    for (auto const [dr, df] : steps) {
+      auto const r = static_cast<int>(sq / 8) + dr;
+      auto const f = static_cast<int>(sq % 8) + df;
+      if (on_board(r, f)) {
+        table[sq] |= square_bb(make_square(r, f));
+      }
+    }
+  }
+  return table;
+}
+//==============================================================================
+/// Fancy magic bitboard entry of one square. The relevant blockers are
+/// multiplied by a magic number so that every occupancy subset hashes to a
+/// slot holding the correct attack set.
+struct magic {
+  bitboard      mask       = 0;
+  bitboard      multiplier = 0;
+  std::uint32_t offset     = 0;
+  std::uint8_t  shift      = 0;
+  //----------------------------------------------------------------------------
+  constexpr auto index(bitboard const occupied) const -> std::size_t {
+    return offset + static_cast<std::size_t>(((occupied & mask) * multiplier) >> shift);
+  }
+};
+//------------------------------------------------------------------------------
+// Multipliers were found offline by random search of sparse 64-bit numbers.
+// They are verified when the tables are built: a multiplier that maps two
+// different attack sets to the same slot fails compilation.
+// clang-format off
+inline constexpr std::array<bitboard, 64> rook_multipliers = {
+  0x1080004008801020ULL, 0x0840092002c03000ULL, 0x1900200010400900ULL, 0x0880100008000480ULL,
+  0x4200100420080200ULL, 0x8100020100080400ULL, 0x0200040110886200ULL, 0x0200008040220411ULL,
+  0x0404800084400220ULL, 0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+  0x000a001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL, 0x0442000102105084ULL,
+  0x9080010020804100ULL, 0x0040404000201009ULL, 0x0000808010002009ULL, 0x2200090021d00100ULL,
+  0x0008008008040080ULL, 0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000a0001768104ULL,
+  0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL,
+  0x0442000a00049020ULL, 0x2100040080020080ULL, 0x0800120400900148ULL, 0x0010040a00128541ULL,
+  0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+  0x0400802402800800ULL, 0xc100020080800400ULL, 0x0002000802000401ULL, 0x0182085882000401ULL,
+  0x0220204000808000ULL, 0x2860100040024022ULL, 0x0001002004110040ULL, 0x99101042000a0020ULL,
+  0x0004080004008080ULL, 0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+  0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040a00300ULL, 0x0801100280080480ULL,
+  0x0242009008200600ULL, 0x1002000489500200ULL, 0x0040800200010080ULL, 0x0091800041000080ULL,
+  0x0000209300488001ULL, 0x04c1002414824001ULL, 0x020020000b001041ULL, 0x7000100004200901ULL,
+  0x8002002004100802ULL, 0x30010002084c0007ULL, 0x0888221800813004ULL, 0x4000002840840112ULL,
+};
+inline constexpr std::array<bitboard, 64> bishop_multipliers = {
+  0xa010041108003100ULL, 0x006082020a002900ULL, 0x6810010619200000ULL, 0x08281a0520000408ULL,
+  0x0001104001000400ULL, 0x0018901008048400ULL, 0x00040a0210245280ULL, 0x000200210808a402ULL,
+  0x9140048410821200ULL, 0x0800091010820041ULL, 0x20504804832202c0ULL, 0x0100091401081000ULL,
+  0x8021011140000012ULL, 0x0810020804450400ULL, 0x208b0542109008a2ULL, 0x0080084a08040204ULL,
+  0x0040e2a80811244cULL, 0x2505022008008108ULL, 0x0430220100420040ULL, 0x010a040420220040ULL,
+  0x1105000290400000ULL, 0x0093001200822120ULL, 0x4000a62048043004ULL, 0x280120048a015004ULL,
+  0x006090002a020814ULL, 0x44042000240800d0ULL, 0x01102800040a4400ULL, 0x1004080080220040ULL,
+  0x0001001011004024ULL, 0x0010044000805040ULL, 0x0914041200820100ULL, 0x0004821012821480ULL,
+  0x0024040500c05021ULL, 0x0088611002080200ULL, 0x0116080a00040020ULL, 0x4000020080080080ULL,
+  0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL, 0x8081110600002e00ULL,
+  0x2842101105000801ULL, 0x1100809008001025ULL, 0x00020202221c0400ULL, 0x0422014022009020ULL,
+  0x0210046102100c00ULL, 0xc004008082029102ULL, 0x00aa461801101200ULL, 0x0404080080201108ULL,
+  0x020542108c205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL, 0x0400200042021100ULL,
+  0x00004204850400c0ULL, 0x0200100410a42102ULL, 0x1040020801210102ULL, 0x0805040410420000ULL,
+  0x2884804130100200ULL, 0x800c262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+  0x0104000012a02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL, 0x0402020801010201ULL,
+};
+// clang-format on
+//------------------------------------------------------------------------------
+consteval auto make_magics(std::array<direction, 4> const &directions,
+                           std::array<bitboard, 64> const &multipliers)
+    -> std::array<magic, 64> {
+  auto magics = std::array<magic, 64>{};
+  auto offset = std::uint32_t{0};
+  for (auto sq = std::size_t{0}; sq < 64; ++sq) {
+    auto const mask = relevant_occupancy(directions, static_cast<square>(sq));
+    auto const bits = popcount(mask);
+    magics[sq] = {mask, multipliers[sq], offset, static_cast<std::uint8_t>(64 - bits)};
+    offset += std::uint32_t{1} << bits;
+  }
+  return magics;
+}
+//------------------------------------------------------------------------------
+template <std::size_t N>
+consteval auto table_size(std::array<magic, N> const &magics) -> std::size_t {
+  return magics.back().offset +
+         (std::size_t{1} << (64 - magics.back().shift));
+}
+//------------------------------------------------------------------------------
+template <std::size_t TableSize>
+consteval auto make_slider_table(std::array<direction, 4> const &directions,
+                                 std::array<magic, 64> const &magics)
+    -> std::array<bitboard, TableSize> {
+  auto table = std::array<bitboard, TableSize>{};
+  for (auto sq = std::size_t{0}; sq < 64; ++sq) {
+    auto const &m = magics[sq];
+    // enumerate all subsets of the mask (Carry-Rippler)
+    auto occupied = bitboard{0};
+    do {
+      auto const attacks =
+          ray_attacks(directions, static_cast<square>(sq), occupied);
+      auto &slot = table[m.index(occupied)];
+      if (slot != 0 && slot != attacks) {
+        throw std::logic_error{"magic multiplier collision"};
+      }
+      slot     = attacks;
+      occupied = (occupied - m.mask) & m.mask;
+    } while (occupied != 0);
+  }
+  return table;
+}
+//==============================================================================
+inline constexpr auto rook_magics   = make_magics(rook_directions, rook_multipliers);
+inline constexpr auto bishop_magics = make_magics(bishop_directions, bishop_multipliers);
+inline constexpr auto rook_table_size   = table_size(rook_magics);
+inline constexpr auto bishop_table_size = table_size(bishop_magics);
+// Defined in attacks.cpp so that the tables are evaluated once and not in
+// every translation unit.
+extern std::array<bitboard, rook_table_size> const   rook_table;
+extern std::array<bitboard, bishop_table_size> const bishop_table;
+extern std::array<std::array<bitboard, 64>, 64> const between_table;
+extern std::array<std::array<bitboard, 64>, 64> const line_table;
+//------------------------------------------------------------------------------
+inline constexpr auto knight_table = make_leaper_table(std::array<direction, 8>{
+    {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}}});
+inline constexpr auto king_table = make_leaper_table(std::array<direction, 8>{
+    {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}}});
+inline constexpr std::array<std::array<bitboard, 64>, 2> pawn_table = {
+    make_leaper_table(std::array<direction, 2>{{{1, 1}, {1, -1}}}),
+    make_leaper_table(std::array<direction, 2>{{{-1, 1}, {-1, -1}}})};
+//==============================================================================
+} // namespace detail
+//==============================================================================
+/// Squares a pawn of color c on sq attacks.
+constexpr auto pawn_attacks(color const c, square const sq) -> bitboard {
+  return detail::pawn_table[static_cast<std::size_t>(c)][sq];
+}
+constexpr auto knight_attacks(square const sq) -> bitboard {
+  return detail::knight_table[sq];
+}
+constexpr auto king_attacks(square const sq) -> bitboard {
+  return detail::king_table[sq];
+}
+//------------------------------------------------------------------------------
+inline auto bishop_attacks(square const sq, bitboard const occupied)
+    -> bitboard {
+  return detail::bishop_table[detail::bishop_magics[sq].index(occupied)];
+}
+inline auto rook_attacks(square const sq, bitboard const occupied) -> bitboard {
+  return detail::rook_table[detail::rook_magics[sq].index(occupied)];
+}
+inline auto queen_attacks(square const sq, bitboard const occupied)
+    -> bitboard {
+  return bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
+}
+//------------------------------------------------------------------------------
+/// Attacks of a non-pawn piece of type t on sq.
+inline auto attacks(piece_type const t, square const sq,
+                    bitboard const occupied) -> bitboard {
+  switch (t) {
+    case piece_type::knight: return knight_attacks(sq);
+    case piece_type::bishop: return bishop_attacks(sq, occupied);
+    case piece_type::rook:   return rook_attacks(sq, occupied);
+    case piece_type::queen:  return queen_attacks(sq, occupied);
+    case piece_type::king:   return king_attacks(sq);
+    default:                 return 0;
+  }
+}
+//------------------------------------------------------------------------------
+/// Squares strictly between a and b if they share a rank, file or diagonal,
+/// otherwise empty.
+inline auto between(square const a, square const b) -> bitboard {
+  return detail::between_table[a][b];
+}
+/// The whole rank, file or diagonal through a and b, empty if they are not
+/// aligned.
+inline auto line(square const a, square const b) -> bitboard {
+  return detail::line_table[a][b];
+}
+//==============================================================================
+} // namespace chess
+//==============================================================================
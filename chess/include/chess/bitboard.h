@@ -0,0 +1,69 @@
+#pragma once
+//==============================================================================
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+//==============================================================================
+namespace chess {
+//==============================================================================
+/// One bit per square, bit 0 is a1, bit 7 is h1 and bit 63 is h8.
+using bitboard = std::uint64_t;
+//==============================================================================
+// clang-format off
+enum square : std::uint8_t {
+  a1, b1, c1, d1, e1, f1, g1, h1,
+  a2, b2, c2, d2, e2, f2, g2, h2,
+  a3, b3, c3, d3, e3, f3, g3, h3,
+  a4, b4, c4, d4, e4, f4, g4, h4,
+  a5, b5, c5, d5, e5, f5, g5, h5,
+  a6, b6, c6, d6, e6, f6, g6, h6,
+  a7, b7, c7, d7, e7, f7, g7, h7,
+  a8, b8, c8, d8, e8, f8, g8, h8,
+  no_square
+};
+// clang-format on
+//------------------------------------------------------------------------------
+constexpr auto make_square(std::size_t const rank, std::size_t const file)
+    -> square {
+  return static_cast<square>(rank * 8 + file);
+}
+//------------------------------------------------------------------------------
+constexpr auto rank_of(square const sq) -> std::size_t { return sq >> 3; }
+constexpr auto file_of(square const sq) -> std::size_t { return sq & 7; }
+//------------------------------------------------------------------------------
+constexpr auto square_bb(square const sq) -> bitboard {
+  return bitboard{1} << sq;
+}
+//------------------------------------------------------------------------------
+constexpr bitboard file_a_bb = 0x0101010101010101ULL;
+constexpr bitboard file_h_bb = file_a_bb << 7;
+constexpr bitboard rank_1_bb = 0xFFULL;
+constexpr bitboard rank_8_bb = rank_1_bb << 56;
+//------------------------------------------------------------------------------
+constexpr auto file_bb(std::size_t const file) -> bitboard {
+  return file_a_bb << file;
+}
+constexpr auto rank_bb(std::size_t const rank) -> bitboard {
+  return rank_1_bb << (8 * rank);
+}
+//------------------------------------------------------------------------------
+constexpr auto popcount(bitboard const b) -> int { return std::popcount(b); }
+//------------------------------------------------------------------------------
+/// Index of the least significant set bit. b must not be empty.
+constexpr auto lsb(bitboard const b) -> square {
+  return static_cast<square>(std::countr_zero(b));
+}
+//------------------------------------------------------------------------------
+/// Removes the least significant set bit from b and returns its index.
+constexpr auto pop_lsb(bitboard &b) -> square {
+  auto const sq = lsb(b);
+  b &= b - 1;
+  return sq;
+}
+//------------------------------------------------------------------------------
+constexpr auto more_than_one(bitboard const b) -> bool {
+  return (b & (b - 1)) != 0;
+}
+//==============================================================================
+} // namespace chess
+//==============================================================================
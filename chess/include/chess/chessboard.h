@@ -1,15 +1,59 @@
-#include <array>
-#include <memory>
+#pragma once
+
+#include <string_view>
+#include <vector>
 
 #include "chesspiece.h"
+#include "position.h"
 
 namespace chess{
 class chess_board {
-  using chess_piece_ptr = std::unique_ptr<chess_piece>;
-  using board_data = std::array<std::array<chess_piece_ptr, 8>, 8>;
-  board_data m_pieces;
+ public:
+  /// Number of moves make_move can play before the history has to grow.
+  static constexpr size_t default_history_capacity = 256;
+
+  /// Starts from the initial position.
+  chess_board();
+  /// Throws std::invalid_argument if fen is malformed.
+  explicit chess_board(std::string_view fen);
+
+  /// i is the rank and j the file, both zero-based starting at a1.
+  auto get_piece_at(size_t const i, size_t const j) const -> piece;
+  /// Editing the board clears the move history.
+  void set_piece_at(size_t const i, size_t const j, piece const p);
+
+  /// Appends all legal moves of the side to move to moves.
+  void get_possible_moves(move_list& moves) const;
+
+  /// Plays m, which has to be legal, in place and updates the Zobrist key
+  /// incrementally.
+  void make_move(move const m);
+  /// Passes the turn, used by search for null move pruning.
+  void make_null_move();
+  /// Takes back the last move played with make_move or make_null_move.
+  void unmake_move();
+  /// Makes sure that plies more moves can be played without allocating.
+  void reserve_history(size_t const plies);
+
+  auto get_position() const -> position const& { return m_position; }
+  auto get_key() const { return m_position.key(); }
+  /// Number of moves played with make_move that can be taken back.
+  auto get_ply() const { return m_history.size(); }
+  auto get_last_move() const {
+    return m_history.empty() ? move{} : m_history.back().m;
+  }
+
+  /// True if the current position occurred before since the last capture or
+  /// pawn move.
+  auto is_repetition() const -> bool;
+
+ private:
+  struct history_entry {
+    move      m;
+    undo_info undo;
+  };
 
-  auto get_piece_at(size_t const i, size_t const j) -> chess_piece_ptr&;
-  auto get_piece_at(size_t const i, size_t const j) const -> chess_piece_ptr const&;
+  position                   m_position;
+  std::vector<history_entry> m_history;
 };
 }
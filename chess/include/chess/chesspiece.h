@@ -1,11 +1,26 @@
 #pragma once
 
+#include "bitboard.h"
+#include "move.h"
 #include "networkinstance.h"
+#include "piece.h"
 
 namespace chess {
 class chess_board;
-
+//==============================================================================
+/// View of one piece standing on a board.
 class chess_piece : public network_instance {
-  virtual char get_possible_moves(chess_board const& board) const = 0;
+ public:
+  chess_piece(piece const p, square const sq) : m_piece{p}, m_square{sq} {}
+
+  auto get_piece() const { return m_piece; }
+  auto get_square() const { return m_square; }
+
+  /// Appends the legal moves of this piece to moves.
+  void get_possible_moves(chess_board const& board, move_list& moves) const;
+
+ private:
+  piece  m_piece;
+  square m_square;
 };
 }
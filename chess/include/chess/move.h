@@ -0,0 +1,138 @@
+#pragma once
+//==============================================================================
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "bitboard.h"
+#include "piece.h"
+//==============================================================================
+namespace chess {
+//==============================================================================
+/// A move packed into 16 bits: origin in bits 0-5, target in bits 6-11 and
+/// a flag in bits 12-15. The type is trivial so that move lists need no
+/// initialization, a value-initialized move{} is the null move.
+class move {
+ public:
+  enum class flag : std::uint8_t {
+    quiet                    = 0,
+    double_pawn_push         = 1,
+    king_castle              = 2,
+    queen_castle             = 3,
+    capture                  = 4,
+    en_passant               = 5,
+    knight_promotion         = 8,
+    bishop_promotion         = 9,
+    rook_promotion           = 10,
+    queen_promotion          = 11,
+    knight_promotion_capture = 12,
+    bishop_promotion_capture = 13,
+    rook_promotion_capture   = 14,
+    queen_promotion_capture  = 15
+  };
+  //----------------------------------------------------------------------------
+  constexpr move() = default;
+  constexpr move(square const from, square const to,
+                 flag const f = flag::quiet)
+      : m_data{static_cast<std::uint16_t>(
+            from | (to << 6) | (static_cast<std::uint16_t>(f) << 12))} {}
+  //----------------------------------------------------------------------------
+  static constexpr auto from_raw(std::uint16_t const raw) -> move {
+    auto m   = move{};
+    m.m_data = raw;
+    return m;
+  }
+  constexpr auto raw() const -> std::uint16_t { return m_data; }
+  //----------------------------------------------------------------------------
+  constexpr auto from() const -> square {
+    return static_cast<square>(m_data & 0x3F);
+  }
+  constexpr auto to() const -> square {
+    return static_cast<square>((m_data >> 6) & 0x3F);
+  }
+  constexpr auto get_flag() const -> flag {
+    return static_cast<flag>(m_data >> 12);
+  }
+  //----------------------------------------------------------------------------
+  constexpr auto is_capture() const -> bool { return (m_data >> 14) & 1; }
+  constexpr auto is_promotion() const -> bool { return (m_data >> 15) & 1; }
+  constexpr auto is_en_passant() const -> bool {
+    return get_flag() == flag::en_passant;
+  }
+  constexpr auto is_castling() const -> bool {
+    return get_flag() == flag::king_castle || get_flag() == flag::queen_castle;
+  }
+  /// Only meaningful for promotions.
+  constexpr auto promotion_type() const -> piece_type {
+    return static_cast<piece_type>(((m_data >> 12) & 3) + 1);
+  }
+  //----------------------------------------------------------------------------
+  /// The null move does not correspond to any move on the board.
+  constexpr auto is_null() const -> bool { return m_data == 0; }
+  //----------------------------------------------------------------------------
+  /// Coordinate notation like e2e4 or e7e8q.
+  auto to_uci() const -> std::string {
+    if (is_null()) {
+      return "0000";
+    }
+    auto str = std::string{
+        static_cast<char>('a' + file_of(from())),
+        static_cast<char>('1' + rank_of(from())),
+        static_cast<char>('a' + file_of(to())),
+        static_cast<char>('1' + rank_of(to()))};
+    if (is_promotion()) {
+      str += "nbrq"[static_cast<std::size_t>(promotion_type()) - 1];
+    }
+    return str;
+  }
+  //----------------------------------------------------------------------------
+  constexpr auto operator==(move const &other) const -> bool = default;
+
+ private:
+  std::uint16_t m_data;
+};
+static_assert(sizeof(move) == 2);
+static_assert(std::is_trivial_v<move>);
+//==============================================================================
+/// Fixed capacity move container meant to live on the stack. 256 entries
+/// exceed the largest known number of legal moves in a position (218).
+class move_list {
+ public:
+  static constexpr std::size_t capacity = 256;
+  //----------------------------------------------------------------------------
+  void push_back(move const m) { m_moves[m_size++] = m; }
+  void clear() { m_size = 0; }
+  //----------------------------------------------------------------------------
+  auto size() const { return m_size; }
+  auto empty() const { return m_size == 0; }
+  //----------------------------------------------------------------------------
+  auto operator[](std::size_t const i) -> move & { return m_moves[i]; }
+  auto operator[](std::size_t const i) const -> move const & {
+    return m_moves[i];
+  }
+  //----------------------------------------------------------------------------
+  auto begin() { return m_moves.begin(); }
+  auto begin() const { return m_moves.begin(); }
+  auto end() { return m_moves.begin() + static_cast<std::ptrdiff_t>(m_size); }
+  auto end() const {
+    return m_moves.begin() + static_cast<std::ptrdiff_t>(m_size);
+  }
+  //----------------------------------------------------------------------------
+  auto contains(move const m) const -> bool {
+    for (auto const candidate : *this) {
+      if (candidate == m) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  std::array<move, capacity> m_moves;
+  std::size_t                m_size = 0;
+};
+//==============================================================================
+} // namespace chess
+//==============================================================================
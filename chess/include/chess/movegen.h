@@ -0,0 +1,22 @@
+#pragma once
+//==============================================================================
+#include <string_view>
+
+#include "move.h"
+#include "position.h"
+//==============================================================================
+namespace chess {
+//==============================================================================
+/// Appends all legal moves of the side to move in pos to moves.
+void generate_legal_moves(position const &pos, move_list &moves);
+//------------------------------------------------------------------------------
+/// Appends the legal captures, including en passant, and promotions of the
+/// side to move in pos to moves.
+void generate_legal_captures(position const &pos, move_list &moves);
+//------------------------------------------------------------------------------
+/// Looks up a move given in coordinate notation (e2e4, e7e8q) among the legal
+/// moves of pos. Returns the null move if it is malformed or illegal.
+auto parse_move(position const &pos, std::string_view uci) -> move;
+//==============================================================================
+} // namespace chess
+//==============================================================================
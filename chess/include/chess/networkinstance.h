@@ -1,5 +1,43 @@
 #pragma once
-
+//==============================================================================
+#include <cstdint>
+//==============================================================================
 namespace chess {
-class network_instance {};
-}
+//==============================================================================
+/// Identifies a replicated object on the server and on all clients. Ids are
+/// handed out once and never reused, zero means not registered.
+using network_id = std::uint32_t;
+inline constexpr network_id no_network_id = 0;
+//==============================================================================
+/// Base of objects that are replicated to clients.
+///
+/// A replication_registry assigns the network id. Derived classes call
+/// mark_dirty whenever replicated state changes, so the registry only
+/// serializes objects that changed since the last tick. Copies are neither
+/// registered nor dirty.
+class network_instance {
+ public:
+  auto get_network_id() const { return m_network_id; }
+  auto is_registered() const { return m_network_id != no_network_id; }
+  /// True if state changed since the last update was sent.
+  auto is_dirty() const { return m_dirty; }
+
+ protected:
+  network_instance() = default;
+  network_instance(network_instance const &) {}
+  auto operator=(network_instance const &) -> network_instance & {
+    return *this;
+  }
+  ~network_instance() = default;
+  //----------------------------------------------------------------------------
+  void mark_dirty() { m_dirty = true; }
+  void clear_dirty() { m_dirty = false; }
+  void set_network_id(network_id const id) { m_network_id = id; }
+
+ private:
+  network_id m_network_id = no_network_id;
+  bool       m_dirty      = false;
+};
+//==============================================================================
+} // namespace chess
+//==============================================================================
@@ -0,0 +1,38 @@
+#pragma once
+//==============================================================================
+#include <cstdint>
+//==============================================================================
+namespace chess {
+//==============================================================================
+enum class color : std::uint8_t { white, black };
+//------------------------------------------------------------------------------
+constexpr auto operator~(color const c) -> color {
+  return static_cast<color>(static_cast<std::uint8_t>(c) ^ 1);
+}
+//==============================================================================
+enum class piece_type : std::uint8_t { pawn, knight, bishop, rook, queen, king };
+//==============================================================================
+/// Colored piece, the value doubles as index into the bitboards of a position.
+enum class piece : std::uint8_t {
+  white_pawn, white_knight, white_bishop, white_rook, white_queen, white_king,
+  black_pawn, black_knight, black_bishop, black_rook, black_queen, black_king,
+  none
+};
+//------------------------------------------------------------------------------
+constexpr auto make_piece(color const c, piece_type const t) -> piece {
+  return static_cast<piece>(static_cast<std::uint8_t>(c) * 6 +
+                            static_cast<std::uint8_t>(t));
+}
+//------------------------------------------------------------------------------
+/// p must not be piece::none
+constexpr auto color_of(piece const p) -> color {
+  return static_cast<std::uint8_t>(p) < 6 ? color::white : color::black;
+}
+//------------------------------------------------------------------------------
+/// p must not be piece::none
+constexpr auto type_of(piece const p) -> piece_type {
+  return static_cast<piece_type>(static_cast<std::uint8_t>(p) % 6);
+}
+//==============================================================================
+} // namespace chess
+//==============================================================================
@@ -0,0 +1,148 @@
+#pragma once
+//==============================================================================
+#include <array>
+#include <string>
+#include <string_view>
+
+#include "attacks.h"
+#include "bitboard.h"
+#include "move.h"
+#include "piece.h"
+#include "zobrist.h"
+//==============================================================================
+namespace chess {
+//==============================================================================
+enum castling_rights : std::uint8_t {
+  no_castling      = 0,
+  white_king_side  = 1,
+  white_queen_side = 2,
+  black_king_side  = 4,
+  black_queen_side = 8,
+  any_castling     = 15
+};
+//==============================================================================
+/// Everything make_move overwrites that cannot be derived from the move when
+/// it is taken back.
+struct undo_info {
+  std::uint64_t key;
+  piece         captured;
+  std::uint8_t  castling;
+  square        en_passant;
+  std::uint16_t halfmove_clock;
+};
+//==============================================================================
+/// Flat bitboard representation of a chess position.
+///
+/// Holds one bitboard per colored piece, occupancy masks per color and for the
+/// whole board plus a square-indexed mailbox so that lookups in either
+/// direction are single loads. The type owns no heap memory and is cheap to
+/// copy.
+///
+/// A Zobrist key of piece placement, side to move, castling rights and en
+/// passant file is kept up to date by every modification.
+class position {
+ public:
+  static constexpr std::string_view start_fen =
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+  //----------------------------------------------------------------------------
+  position();
+  //----------------------------------------------------------------------------
+  /// Throws std::invalid_argument if fen is malformed.
+  static auto from_fen(std::string_view fen) -> position;
+  auto to_fen() const -> std::string;
+  //----------------------------------------------------------------------------
+  auto piece_at(square const sq) const -> piece { return m_mailbox[sq]; }
+  //----------------------------------------------------------------------------
+  auto pieces(piece const p) const -> bitboard {
+    return m_pieces[static_cast<std::size_t>(p)];
+  }
+  auto pieces(color const c, piece_type const t) const -> bitboard {
+    return pieces(make_piece(c, t));
+  }
+  auto pieces(color const c) const -> bitboard {
+    return m_occupancy[static_cast<std::size_t>(c)];
+  }
+  auto occupied() const -> bitboard { return m_occupied; }
+  auto king_square(color const c) const -> square {
+    return lsb(pieces(c, piece_type::king));
+  }
+  //----------------------------------------------------------------------------
+  /// Pieces of both colors that attack sq if the board was occupied by
+  /// occupied. Passing a modified occupancy lets callers look through pieces
+  /// that are about to move.
+  auto attackers_to(square const sq, bitboard const occupied) const
+      -> bitboard {
+    auto const bishops_queens = pieces(piece::white_bishop) |
+                                pieces(piece::black_bishop) |
+                                pieces(piece::white_queen) |
+                                pieces(piece::black_queen);
+    auto const rooks_queens = pieces(piece::white_rook) |
+                              pieces(piece::black_rook) |
+                              pieces(piece::white_queen) |
+                              pieces(piece::black_queen);
+    return (pawn_attacks(color::black, sq) & pieces(piece::white_pawn)) |
+           (pawn_attacks(color::white, sq) & pieces(piece::black_pawn)) |
+           (knight_attacks(sq) & (pieces(piece::white_knight) |
+                                  pieces(piece::black_knight))) |
+           (king_attacks(sq) & (pieces(piece::white_king) |
+                                pieces(piece::black_king))) |
+           (bishop_attacks(sq, occupied) & bishops_queens) |
+           (rook_attacks(sq, occupied) & rooks_queens);
+  }
+  auto attackers_to(square const sq) const -> bitboard {
+    return attackers_to(sq, m_occupied);
+  }
+  //----------------------------------------------------------------------------
+  auto is_attacked(square const sq, color const by) const -> bool {
+    return (attackers_to(sq) & pieces(by)) != 0;
+  }
+  //----------------------------------------------------------------------------
+  /// Enemy pieces giving check to the side to move.
+  auto checkers() const -> bitboard {
+    return attackers_to(king_square(m_side_to_move)) & pieces(~m_side_to_move);
+  }
+  auto in_check() const -> bool { return checkers() != 0; }
+  //----------------------------------------------------------------------------
+  auto side_to_move() const { return m_side_to_move; }
+  auto castling() const { return m_castling; }
+  /// Square a pawn passed over with a double push in the last move or
+  /// no_square.
+  auto en_passant() const { return m_en_passant; }
+  auto halfmove_clock() const { return m_halfmove_clock; }
+  auto fullmove_number() const { return m_fullmove_number; }
+  auto key() const { return m_key; }
+  /// Recomputes the Zobrist key from scratch, key() is always equal to it.
+  auto compute_key() const -> std::uint64_t;
+  //----------------------------------------------------------------------------
+  /// Plays m, which has to be legal in this position, and returns what is
+  /// needed to take it back.
+  auto make_move(move m) -> undo_info;
+  /// Takes back m, which has to be the last move played with make_move.
+  void unmake_move(move m, undo_info const &undo);
+  /// Passes the turn to the opponent, only used by search. The halfmove clock
+  /// restarts so that repetitions are not detected across a null move.
+  auto make_null_move() -> undo_info;
+  void unmake_null_move(undo_info const &undo);
+  //----------------------------------------------------------------------------
+  /// Low level editing, does not check whether the result is a legal position.
+  /// put_piece expects sq to be empty.
+  void put_piece(piece p, square sq);
+  void remove_piece(square sq);
+  //----------------------------------------------------------------------------
+  auto operator==(position const &other) const -> bool = default;
+
+ private:
+  std::array<bitboard, 12> m_pieces{};
+  std::array<bitboard, 2>  m_occupancy{};
+  bitboard                 m_occupied = 0;
+  std::array<piece, 64>    m_mailbox;
+  color                    m_side_to_move    = color::white;
+  std::uint8_t             m_castling        = no_castling;
+  square                   m_en_passant      = no_square;
+  std::uint16_t            m_halfmove_clock  = 0;
+  std::uint16_t            m_fullmove_number = 1;
+  std::uint64_t            m_key             = 0;
+};
+//==============================================================================
+} // namespace chess
+//==============================================================================
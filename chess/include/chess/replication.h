@@ -0,0 +1,188 @@
+#pragma once
+//==============================================================================
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <vector>
+
+#include "bitboard.h"
+#include "networkinstance.h"
+#include "piece.h"
+#include "position.h"
+//==============================================================================
+namespace chess {
+//==============================================================================
+enum class game_status : std::uint8_t {
+  waiting, ongoing, white_won, black_won, draw, aborted
+};
+//------------------------------------------------------------------------------
+enum class update_kind : std::uint8_t { keyframe, delta };
+//------------------------------------------------------------------------------
+/// Leading fields of every serialized update.
+struct update_header {
+  update_kind   kind;
+  network_id    id;
+  /// A delta only applies to the state of version - 1, a keyframe replaces
+  /// any state.
+  std::uint32_t version;
+  //----------------------------------------------------------------------------
+  static constexpr std::size_t size = 9;
+  /// Throws std::invalid_argument if update is too short or of unknown kind.
+  static auto read(std::span<std::uint8_t const> update) -> update_header;
+};
+//------------------------------------------------------------------------------
+enum class apply_result : std::uint8_t {
+  applied,
+  /// The update is older than the state, nothing changed.
+  stale,
+  /// A delta skipped versions, the client has to ask for a keyframe.
+  needs_keyframe
+};
+//==============================================================================
+/// Replicated state of one game: the pieces, the side to move, both clocks
+/// and the game status.
+///
+/// The server edits its instance and tracks which squares and fields changed.
+/// Deltas carry the new values of exactly those, so a move costs a few bytes
+/// instead of a full board. Keyframes carry everything. Values in updates are
+/// absolute, applying a change twice is harmless.
+///
+/// Clients keep their own instance and feed it the updates of the server. An
+/// unregistered client instance takes the id of the first keyframe.
+class replicated_game : public network_instance {
+ public:
+  /// Bytes of a keyframe, a delta is at most a few bytes longer.
+  static constexpr std::size_t keyframe_size = update_header::size + 32 + 10;
+  //----------------------------------------------------------------------------
+  /// Starts with an empty board, white to move and zero clocks.
+  replicated_game();
+  //----------------------------------------------------------------------------
+  auto piece_at(square const sq) const { return m_squares[sq]; }
+  auto side_to_move() const { return m_side_to_move; }
+  /// Remaining time of c in milliseconds.
+  auto clock(color const c) const { return m_clocks[static_cast<int>(c)]; }
+  auto status() const { return m_status; }
+  /// Version of the last update sent or applied.
+  auto version() const { return m_version; }
+  //----------------------------------------------------------------------------
+  void set_piece(square const sq, piece const p);
+  void set_side_to_move(color const c);
+  void set_clock(color const c, std::uint32_t const milliseconds);
+  void set_status(game_status const s);
+  /// Takes pieces and side to move from pos, only squares that differ count
+  /// as changed.
+  void sync(position const &pos);
+  //----------------------------------------------------------------------------
+  /// Appends the whole state at the current version.
+  void write_keyframe(std::vector<std::uint8_t> &out) const;
+  /// Appends the changes since the last update as version() + 1.
+  void write_delta(std::vector<std::uint8_t> &out) const;
+  /// Marks the changes as sent and moves to version() + 1.
+  void commit();
+  //----------------------------------------------------------------------------
+  /// Throws std::invalid_argument for malformed updates and updates of
+  /// another instance.
+  auto apply(std::span<std::uint8_t const> update) -> apply_result;
+
+ private:
+  enum field : std::uint8_t {
+    side_field   = 1,
+    clocks_field = 2,
+    status_field = 4,
+  };
+  //----------------------------------------------------------------------------
+  friend class replication_registry;
+  //----------------------------------------------------------------------------
+  void mark_changed(std::uint8_t const fields);
+  //----------------------------------------------------------------------------
+  std::array<piece, 64>         m_squares;
+  std::array<std::uint32_t, 2>  m_clocks{};
+  color                         m_side_to_move = color::white;
+  game_status                   m_status       = game_status::waiting;
+  std::uint32_t                 m_version      = 0;
+  bitboard                      m_changed_squares = 0;
+  std::uint8_t                  m_changed_fields  = 0;
+};
+//==============================================================================
+/// Server side registry of replicated games.
+///
+/// Registered games get ids that stay valid until they are removed and are
+/// never given out again. Every tick produces an update for each game that
+/// changed and nothing for the others, so idle games cost no bandwidth.
+/// Every keyframe_interval-th update of a game is a keyframe instead of a
+/// delta, clients that lost track resynchronize without asking while the
+/// game goes on. Late joiners and reconnecting clients start from keyframe()
+/// and follow the deltas.
+///
+/// Registered games must outlive their registration. Not thread-safe, the
+/// game loop owns the registry.
+class replication_registry {
+ public:
+  static constexpr std::uint32_t default_keyframe_interval = 64;
+  //----------------------------------------------------------------------------
+  explicit replication_registry(
+      std::uint32_t keyframe_interval = default_keyframe_interval);
+  //----------------------------------------------------------------------------
+  /// Throws std::logic_error if game is registered already.
+  auto add(replicated_game &game) -> network_id;
+  void remove(replicated_game &game);
+  auto find(network_id const id) const -> replicated_game *;
+  auto size() const { return m_games.size(); }
+  auto ticks() const { return m_tick; }
+  //----------------------------------------------------------------------------
+  /// Keyframe of the game with id for a client that starts to follow it.
+  /// False if there is no such game.
+  auto keyframe(network_id const id, std::vector<std::uint8_t> &out) const
+      -> bool;
+  //----------------------------------------------------------------------------
+  /// Advances one tick and calls emit(game, update) for every update it
+  /// produces. The update bytes are only valid during the call.
+  template <typename Emit>
+  void tick(Emit &&emit) {
+    ++m_tick;
+    for (auto const &[id, game] : m_games) {
+      send(*game, emit);
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Like tick but only looks at the games in changed instead of at all of
+  /// them. Ids that are listed twice or not registered are skipped.
+  template <typename Emit>
+  void tick(std::span<network_id const> const changed, Emit &&emit) {
+    ++m_tick;
+    for (auto const id : changed) {
+      if (auto *const game = find(id)) {
+        send(*game, emit);
+      }
+    }
+  }
+
+ private:
+  template <typename Emit>
+  void send(replicated_game &game, Emit &emit) {
+    if (!game.is_dirty()) {
+      return;
+    }
+    m_buffer.clear();
+    if ((game.version() + 1) % m_keyframe_interval == 0) {
+      game.commit();
+      game.write_keyframe(m_buffer);
+    } else {
+      game.write_delta(m_buffer);
+      game.commit();
+    }
+    emit(static_cast<replicated_game const &>(game),
+         std::span<std::uint8_t const>{m_buffer});
+  }
+  //----------------------------------------------------------------------------
+  std::map<network_id, replicated_game *> m_games;
+  std::vector<std::uint8_t>               m_buffer;
+  std::uint32_t                           m_keyframe_interval;
+  std::uint64_t                           m_tick    = 0;
+  network_id                              m_next_id = 1;
+};
+//==============================================================================
+} // namespace chess
+//==============================================================================
@@ -0,0 +1,138 @@
+#pragma once
+//==============================================================================
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include "move.h"
+//==============================================================================
+namespace chess {
+//==============================================================================
+enum class bound : std::uint8_t { none, upper, lower, exact };
+//==============================================================================
+/// Search result stored for a position. Mate scores have to be made relative
+/// to the stored position by the caller.
+struct tt_entry {
+  move         best_move{};
+  std::int16_t score = 0;
+  std::int16_t eval  = 0;
+  int          depth = 0;
+  bound        type  = bound::none;
+};
+//==============================================================================
+/// Fixed-size hash table of search results shared by all search threads.
+///
+/// Buckets of four 16 byte slots fill exactly one cache line. Each slot holds
+/// the packed entry and the key XORed with it. Both words are written and read
+/// with relaxed atomics and without locks, a reader only accepts a slot if
+/// key ^ data reproduces the probed key, so torn writes from concurrent stores
+/// are rejected instead of returning a mix of two entries.
+///
+/// Probing, storing and new_search are thread-safe, so concurrent searches
+/// of different games may share one table per process. resize, clear and
+/// set_age_interval are not and must not run while a search uses the table.
+///
+/// The age kept with every entry has six bits. A shared table is given an
+/// age interval, so that its age advances once per time slice instead of
+/// with every search that starts. Otherwise concurrent searches would age
+/// each other's entries while they still use them and the age would wrap
+/// after a few dozen moves of the server.
+class transposition_table {
+ public:
+  /// Statistics gathered by one search thread and merged into the table's
+  /// totals with add_counters, so threads do not contend on shared counters
+  /// for every probe.
+  struct counters {
+    std::uint64_t probes     = 0;
+    std::uint64_t hits       = 0;
+    std::uint64_t stores     = 0;
+    /// Stores that evicted an entry of a different position.
+    std::uint64_t collisions = 0;
+    //--------------------------------------------------------------------------
+    auto operator+=(counters const &other) -> counters & {
+      probes += other.probes;
+      hits += other.hits;
+      stores += other.stores;
+      collisions += other.collisions;
+      return *this;
+    }
+  };
+  //----------------------------------------------------------------------------
+  static constexpr std::size_t slots_per_bucket = 4;
+  /// Lowest depth that can be stored, quiescence search uses depths <= 0.
+  static constexpr int min_depth = -8;
+  //----------------------------------------------------------------------------
+  explicit transposition_table(std::size_t megabytes = 16);
+  //----------------------------------------------------------------------------
+  /// Reallocates the table with the given size, which drops all entries.
+  void resize(std::size_t megabytes);
+  void clear();
+  /// Ages all entries so that results of earlier searches get replaced first.
+  /// Call once before every search. With an age interval the entries are only
+  /// aged if the interval passed since they were aged last.
+  void new_search();
+  /// Interval new_search ages the entries at most once in, zero to age them
+  /// with every search.
+  void set_age_interval(std::chrono::milliseconds interval);
+  //----------------------------------------------------------------------------
+  auto probe(std::uint64_t key, counters &stats) const
+      -> std::optional<tt_entry>;
+  void store(std::uint64_t key, tt_entry const &entry, counters &stats);
+  /// Pulls the bucket of key into the cache ahead of a probe.
+  void prefetch(std::uint64_t const key) const {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(&m_buckets[bucket_index(key)]);
+#endif
+  }
+  //----------------------------------------------------------------------------
+  auto size_in_megabytes() const -> std::size_t;
+  auto bucket_count() const { return m_bucket_count; }
+  /// Permille of sampled slots used since the entries were aged last.
+  auto hashfull() const -> int;
+  //----------------------------------------------------------------------------
+  void add_counters(counters const &stats);
+  auto get_counters() const -> counters;
+  void reset_counters();
+
+ private:
+  struct slot {
+    std::atomic<std::uint64_t> key_xor_data{0};
+    std::atomic<std::uint64_t> data{0};
+  };
+  struct alignas(64) bucket {
+    std::array<slot, slots_per_bucket> slots;
+  };
+  static_assert(sizeof(bucket) == 64);
+  //----------------------------------------------------------------------------
+  auto bucket_index(std::uint64_t const key) const -> std::size_t {
+#if defined(__SIZEOF_INT128__)
+    // maps the key onto [0, bucket_count) without a division
+    return static_cast<std::size_t>(
+        (static_cast<unsigned __int128>(key) * m_bucket_count) >> 64);
+#else
+    return static_cast<std::size_t>(key % m_bucket_count);
+#endif
+  }
+  //----------------------------------------------------------------------------
+  auto age() const -> std::uint8_t;
+  //----------------------------------------------------------------------------
+  std::unique_ptr<bucket[]> m_buckets;
+  std::size_t               m_bucket_count = 0;
+  // Only the low bits count, the counter wraps at a multiple of their range
+  std::atomic<std::uint8_t> m_age{0};
+  std::chrono::steady_clock::duration m_age_interval{0};
+  // Time since the epoch of the steady clock at which the age advances next
+  std::atomic<std::chrono::steady_clock::rep> m_next_age{0};
+
+  std::atomic<std::uint64_t> m_probes{0};
+  std::atomic<std::uint64_t> m_hits{0};
+  std::atomic<std::uint64_t> m_stores{0};
+  std::atomic<std::uint64_t> m_collisions{0};
+};
+//==============================================================================
+} // namespace chess
+//==============================================================================
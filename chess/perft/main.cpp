@@ -0,0 +1,117 @@
+#include <chess/movegen.h>
+#include <chess/position.h>
+//==============================================================================
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+//==============================================================================
+namespace {
+//==============================================================================
+struct perft_position {
+  std::string_view name;
+  std::string_view fen;
+  /// Depth used when no depth is given on the command line.
+  int default_depth;
+  /// Expected leaf node counts for depth 1, 2, ...
+  std::array<std::uint64_t, 6> nodes;
+};
+//------------------------------------------------------------------------------
+// Reference counts from https://www.chessprogramming.org/Perft_Results
+constexpr auto positions = std::array{
+    perft_position{
+        "startpos", chess::position::start_fen, 5,
+        {20, 400, 8902, 197281, 4865609, 119060324}},
+    perft_position{
+        "kiwipete",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        4, {48, 2039, 97862, 4085603, 193690690, 8031647685}},
+    perft_position{
+        "position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5,
+        {14, 191, 2812, 43238, 674624, 11030083}},
+    perft_position{
+        "position4",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4,
+        {6, 264, 9467, 422333, 15833292, 706045033}},
+    perft_position{
+        "position5",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4,
+        {44, 1486, 62379, 2103487, 89941194, 3048196529}},
+    perft_position{
+        "position6",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        4, {46, 2079, 89890, 3894594, 164075551, 6923051137}},
+};
+//------------------------------------------------------------------------------
+auto perft(chess::position &pos, int const depth) -> std::uint64_t {
+  auto moves = chess::move_list{};
+  chess::generate_legal_moves(pos, moves);
+  if (depth == 1) {
+    return moves.size();
+  }
+  auto nodes = std::uint64_t{0};
+  for (auto const m : moves) {
+    auto const undo = pos.make_move(m);
+    nodes += perft(pos, depth - 1);
+    pos.unmake_move(m, undo);
+  }
+  return nodes;
+}
+//------------------------------------------------------------------------------
+auto run(perft_position const &p, int const depth) -> bool {
+  auto       pos   = chess::position::from_fen(p.fen);
+  auto const begin = std::chrono::steady_clock::now();
+  auto const nodes = perft(pos, depth);
+  auto const end   = std::chrono::steady_clock::now();
+
+  auto const seconds  = std::chrono::duration<double>(end - begin).count();
+  auto const expected = p.nodes[static_cast<std::size_t>(depth - 1)];
+  std::cout << p.name << " depth " << depth << ": " << nodes << " nodes in "
+            << seconds << " s, "
+            << static_cast<std::uint64_t>(static_cast<double>(nodes) /
+                                          std::max(seconds, 1e-9))
+            << " nodes/s";
+  if (nodes != expected) {
+    std::cout << " - FAILED, expected " << expected << '\n';
+    return false;
+  }
+  std::cout << '\n';
+  return true;
+}
+//==============================================================================
+} // namespace
+//==============================================================================
+// usage: chess.perft [position-name [depth]]
+// Without arguments all positions are run at their default depth.
+auto main(int argc, char **argv) -> int {
+  auto const name  = argc > 1 ? std::string_view{argv[1]} : std::string_view{};
+  auto       depth = 0;
+  if (argc > 2) {
+    auto const arg = std::string_view{argv[2]};
+    auto const [ptr, ec] =
+        std::from_chars(arg.data(), arg.data() + arg.size(), depth);
+    if (ec != std::errc{} || depth < 1 ||
+        depth > static_cast<int>(perft_position{}.nodes.size())) {
+      std::cerr << "invalid depth: " << arg << '\n';
+      return 2;
+    }
+  }
+
+  auto success = true;
+  auto found   = false;
+  for (auto const &p : positions) {
+    if (!name.empty() && name != p.name) {
+      continue;
+    }
+    found   = true;
+    success = run(p, depth > 0 ? depth : p.default_depth) && success;
+  }
+  if (!found) {
+    std::cerr << "unknown position: " << name << '\n';
+    return 2;
+  }
+  return success ? 0 : 1;
+}
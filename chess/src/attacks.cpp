@@ -0,0 +1,48 @@
+#include "chess/attacks.h"
+//==============================================================================
+namespace chess::detail {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+consteval auto make_line_tables() {
+  struct tables {
+    std::array<std::array<bitboard, 64>, 64> between{};
+    std::array<std::array<bitboard, 64>, 64> line{};
+  } t;
+  for (auto a = std::size_t{0}; a < 64; ++a) {
+    for (auto b = std::size_t{0}; b < 64; ++b) {
+      if (a == b) {
+        continue;
+      }
+      auto const sa = static_cast<square>(a);
+      auto const sb = static_cast<square>(b);
+      for (auto const *directions : {&rook_directions, &bishop_directions}) {
+        if ((ray_attacks(*directions, sa, 0) & square_bb(sb)) == 0) {
+          continue;
+        }
+        t.between[a][b] = ray_attacks(*directions, sa, square_bb(sb)) &
+                          ray_attacks(*directions, sb, square_bb(sa));
+        t.line[a][b] = (ray_attacks(*directions, sa, 0) &
+                        ray_attacks(*directions, sb, 0)) |
+                       square_bb(sa) | square_bb(sb);
+      }
+    }
+  }
+  return t;
+}
+//------------------------------------------------------------------------------
+constexpr auto line_tables = make_line_tables();
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+constinit std::array<bitboard, rook_table_size> const rook_table =
+    make_slider_table<rook_table_size>(rook_directions, rook_magics);
+constinit std::array<bitboard, bishop_table_size> const bishop_table =
+    make_slider_table<bishop_table_size>(bishop_directions, bishop_magics);
+constinit std::array<std::array<bitboard, 64>, 64> const between_table =
+    line_tables.between;
+constinit std::array<std::array<bitboard, 64>, 64> const line_table =
+    line_tables.line;
+//==============================================================================
+} // namespace chess::detail
+//==============================================================================
@@ -1,9 +1,55 @@
 #include "chess/chessboard.h"
+#include "chess/movegen.h"
+
+#include <algorithm>
 namespace chess{
-auto chess_board::get_piece_at(size_t const i, size_t const j) -> chess_piece_ptr & {
-  return m_pieces[i][j];
+chess_board::chess_board() : chess_board{position::start_fen} {}
+chess_board::chess_board(std::string_view const fen)
+    : m_position{position::from_fen(fen)} {
+  m_history.reserve(default_history_capacity);
 }
-auto chess_board::get_piece_at(size_t const i, size_t const j) const -> chess_piece_ptr const& {
-  return m_pieces[i][j];
+auto chess_board::get_piece_at(size_t const i, size_t const j) const -> piece {
+  return m_position.piece_at(make_square(i, j));
+}
+void chess_board::set_piece_at(size_t const i, size_t const j, piece const p) {
+  auto const sq = make_square(i, j);
+  m_position.remove_piece(sq);
+  if (p != piece::none) {
+    m_position.put_piece(p, sq);
+  }
+  m_history.clear();
+}
+void chess_board::get_possible_moves(move_list& moves) const {
+  generate_legal_moves(m_position, moves);
+}
+void chess_board::make_move(move const m) {
+  m_history.push_back({m, m_position.make_move(m)});
+}
+void chess_board::make_null_move() {
+  m_history.push_back({move{}, m_position.make_null_move()});
+}
+void chess_board::unmake_move() {
+  auto const& last = m_history.back();
+  if (last.m.is_null()) {
+    m_position.unmake_null_move(last.undo);
+  } else {
+    m_position.unmake_move(last.m, last.undo);
+  }
+  m_history.pop_back();
+}
+void chess_board::reserve_history(size_t const plies) {
+  m_history.reserve(m_history.size() + plies);
+}
+auto chess_board::is_repetition() const -> bool {
+  // positions with the other side to move can not be equal, and nothing
+  // before the last irreversible move can repeat
+  auto const reversible =
+      std::min<size_t>(m_position.halfmove_clock(), m_history.size());
+  for (auto back = size_t{4}; back <= reversible; back += 2) {
+    if (m_history[m_history.size() - back].undo.key == m_position.key()) {
+      return true;
+    }
+  }
+  return false;
 }
 }
@@ -1 +1,17 @@
 #include "chess/chesspiece.h"
+
+#include "chess/chessboard.h"
+#include "chess/movegen.h"
+
+namespace chess {
+void chess_piece::get_possible_moves(chess_board const& board,
+                                     move_list& moves) const {
+  auto all = move_list{};
+  generate_legal_moves(board.get_position(), all);
+  for (auto const m : all) {
+    if (m.from() == m_square) {
+      moves.push_back(m);
+    }
+  }
+}
+}
@@ -0,0 +1,239 @@
+#include "chess/movegen.h"
+
+#include "chess/attacks.h"
+//==============================================================================
+namespace chess {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+constexpr auto all_squares = ~bitboard{0};
+//------------------------------------------------------------------------------
+void add_moves(move_list &moves, square const from, bitboard targets,
+               bitboard const enemies) {
+  while (targets != 0) {
+    auto const to = pop_lsb(targets);
+    moves.push_back(move{from, to,
+                         (enemies & square_bb(to)) != 0 ? move::flag::capture
+                                                        : move::flag::quiet});
+  }
+}
+//------------------------------------------------------------------------------
+void add_promotions(move_list &moves, square const from, square const to,
+                    bool const is_capture) {
+  using enum move::flag;
+  if (is_capture) {
+    moves.push_back(move{from, to, queen_promotion_capture});
+    moves.push_back(move{from, to, rook_promotion_capture});
+    moves.push_back(move{from, to, bishop_promotion_capture});
+    moves.push_back(move{from, to, knight_promotion_capture});
+  } else {
+    moves.push_back(move{from, to, queen_promotion});
+    moves.push_back(move{from, to, rook_promotion});
+    moves.push_back(move{from, to, bishop_promotion});
+    moves.push_back(move{from, to, knight_promotion});
+  }
+}
+//------------------------------------------------------------------------------
+template <color Us, bool CapturesOnly>
+void generate_pawn_moves(position const &pos, move_list &moves,
+                         square const king, bitboard const pinned,
+                         bitboard const check_mask) {
+  constexpr auto them       = ~Us;
+  constexpr auto up         = Us == color::white ? 8 : -8;
+  constexpr auto start_rank = Us == color::white ? rank_bb(1) : rank_bb(6);
+  constexpr auto last_rank  = Us == color::white ? rank_8_bb : rank_1_bb;
+
+  auto const enemies = pos.pieces(them);
+  auto const empty   = ~pos.occupied();
+
+  auto pawns = pos.pieces(Us, piece_type::pawn);
+  while (pawns != 0) {
+    auto const from = pop_lsb(pawns);
+    auto const allowed =
+        check_mask &
+        ((pinned & square_bb(from)) != 0 ? line(king, from) : all_squares);
+
+    // pushes, of which only promotions count as captures
+    auto const one = static_cast<square>(from + up);
+    if ((empty & square_bb(one)) != 0) {
+      if ((allowed & square_bb(one)) != 0) {
+        if ((last_rank & square_bb(one)) != 0) {
+          add_promotions(moves, from, one, false);
+        } else if (!CapturesOnly) {
+          moves.push_back(move{from, one});
+        }
+      }
+      auto const two = static_cast<square>(one + up);
+      if (!CapturesOnly && (start_rank & square_bb(from)) != 0 &&
+          (empty & allowed & square_bb(two)) != 0) {
+        moves.push_back(move{from, two, move::flag::double_pawn_push});
+      }
+    }
+
+    // captures
+    auto captures = pawn_attacks(Us, from) & enemies & allowed;
+    while (captures != 0) {
+      auto const to = pop_lsb(captures);
+      if ((last_rank & square_bb(to)) != 0) {
+        add_promotions(moves, from, to, true);
+      } else {
+        moves.push_back(move{from, to, move::flag::capture});
+      }
+    }
+
+    // en passant removes two pieces from one line, so legality is checked by
+    // looking at the king's attackers on the board after the capture
+    auto const ep = pos.en_passant();
+    if (ep != no_square && (pawn_attacks(Us, from) & square_bb(ep)) != 0) {
+      auto const captured = static_cast<square>(ep - up);
+      auto const occupied =
+          (pos.occupied() ^ square_bb(from) ^ square_bb(captured)) |
+          square_bb(ep);
+      if ((pos.attackers_to(king, occupied) & enemies &
+           ~square_bb(captured)) == 0) {
+        moves.push_back(move{from, ep, move::flag::en_passant});
+      }
+    }
+  }
+}
+//------------------------------------------------------------------------------
+template <color Us>
+void generate_castling(position const &pos, move_list &moves) {
+  constexpr auto them = ~Us;
+  constexpr auto king_side =
+      Us == color::white ? white_king_side : black_king_side;
+  constexpr auto queen_side =
+      Us == color::white ? white_queen_side : black_queen_side;
+  constexpr auto home = Us == color::white ? e1 : e8;
+  constexpr auto f    = Us == color::white ? f1 : f8;
+  constexpr auto g    = Us == color::white ? g1 : g8;
+  constexpr auto d    = Us == color::white ? d1 : d8;
+  constexpr auto c    = Us == color::white ? c1 : c8;
+  constexpr auto b    = Us == color::white ? b1 : b8;
+
+  auto const occupied = pos.occupied();
+  if ((pos.castling() & king_side) != 0 &&
+      (occupied & (square_bb(f) | square_bb(g))) == 0 &&
+      !pos.is_attacked(f, them) && !pos.is_attacked(g, them)) {
+    moves.push_back(move{home, g, move::flag::king_castle});
+  }
+  if ((pos.castling() & queen_side) != 0 &&
+      (occupied & (square_bb(d) | square_bb(c) | square_bb(b))) == 0 &&
+      !pos.is_attacked(d, them) && !pos.is_attacked(c, them)) {
+    moves.push_back(move{home, c, move::flag::queen_castle});
+  }
+}
+//------------------------------------------------------------------------------
+template <color Us, bool CapturesOnly>
+void generate(position const &pos, move_list &moves) {
+  constexpr auto them = ~Us;
+
+  auto const king     = pos.king_square(Us);
+  auto const friends  = pos.pieces(Us);
+  auto const enemies  = pos.pieces(them);
+  auto const occupied = pos.occupied();
+  auto const checkers = pos.attackers_to(king) & enemies;
+  auto const targets  = CapturesOnly ? enemies : ~friends;
+
+  // the king must not step onto attacked squares, including squares behind
+  // it on the line of a checking slider
+  auto const without_king = occupied ^ square_bb(king);
+  auto       king_targets = king_attacks(king) & targets;
+  while (king_targets != 0) {
+    auto const to = pop_lsb(king_targets);
+    if ((pos.attackers_to(to, without_king) & enemies) == 0) {
+      moves.push_back(move{king, to,
+                           (enemies & square_bb(to)) != 0 ? move::flag::capture
+                                                          : move::flag::quiet});
+    }
+  }
+  if (more_than_one(checkers)) {
+    return;
+  }
+
+  // pieces standing alone between the king and an enemy slider may only move
+  // along that line
+  auto const enemy_queens = pos.pieces(them, piece_type::queen);
+  auto       snipers =
+      (rook_attacks(king, 0) &
+       (pos.pieces(them, piece_type::rook) | enemy_queens)) |
+      (bishop_attacks(king, 0) &
+       (pos.pieces(them, piece_type::bishop) | enemy_queens));
+  auto pinned = bitboard{0};
+  while (snipers != 0) {
+    auto const blockers = between(king, pop_lsb(snipers)) & occupied;
+    if (blockers != 0 && !more_than_one(blockers)) {
+      pinned |= blockers & friends;
+    }
+  }
+
+  // when in check every move has to capture the checker or block its line
+  auto const check_mask =
+      checkers != 0 ? between(king, lsb(checkers)) | checkers : all_squares;
+
+  generate_pawn_moves<Us, CapturesOnly>(pos, moves, king, pinned, check_mask);
+
+  // a pinned knight can never stay on the pin line
+  auto knights = pos.pieces(Us, piece_type::knight) & ~pinned;
+  while (knights != 0) {
+    auto const from = pop_lsb(knights);
+    add_moves(moves, from, knight_attacks(from) & targets & check_mask,
+              enemies);
+  }
+
+  auto const queens = pos.pieces(Us, piece_type::queen);
+  auto diagonal = pos.pieces(Us, piece_type::bishop) | queens;
+  while (diagonal != 0) {
+    auto const from = pop_lsb(diagonal);
+    auto       to = bishop_attacks(from, occupied) & targets & check_mask;
+    if ((pinned & square_bb(from)) != 0) {
+      to &= line(king, from);
+    }
+    add_moves(moves, from, to, enemies);
+  }
+  auto orthogonal = pos.pieces(Us, piece_type::rook) | queens;
+  while (orthogonal != 0) {
+    auto const from = pop_lsb(orthogonal);
+    auto       to = rook_attacks(from, occupied) & targets & check_mask;
+    if ((pinned & square_bb(from)) != 0) {
+      to &= line(king, from);
+    }
+    add_moves(moves, from, to, enemies);
+  }
+
+  if (!CapturesOnly && checkers == 0) {
+    generate_castling<Us>(pos, moves);
+  }
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+void generate_legal_moves(position const &pos, move_list &moves) {
+  if (pos.side_to_move() == color::white) {
+    generate<color::white, false>(pos, moves);
+  } else {
+    generate<color::black, false>(pos, moves);
+  }
+}
+//------------------------------------------------------------------------------
+void generate_legal_captures(position const &pos, move_list &moves) {
+  if (pos.side_to_move() == color::white) {
+    generate<color::white, true>(pos, moves);
+  } else {
+    generate<color::black, true>(pos, moves);
+  }
+}
+//------------------------------------------------------------------------------
+auto parse_move(position const &pos, std::string_view const uci) -> move {
+  auto moves = move_list{};
+  generate_legal_moves(pos, moves);
+  for (auto const m : moves) {
+    if (m.to_uci() == uci) {
+      return m;
+    }
+  }
+  return move{};
+}
+//==============================================================================
+} // namespace chess
+//==============================================================================
@@ -0,0 +1,368 @@
+#include "chess/position.h"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+//==============================================================================
+namespace chess {
+//==============================================================================
+namespace {
+constexpr std::string_view piece_chars = "PNBRQKpnbrqk";
+//------------------------------------------------------------------------------
+/// Castling rights that survive a move from or to each square.
+constexpr auto castling_masks = [] {
+  auto masks = std::array<std::uint8_t, 64>{};
+  masks.fill(any_castling);
+  masks[a1] = any_castling & ~white_queen_side;
+  masks[h1] = any_castling & ~white_king_side;
+  masks[e1] = any_castling & ~(white_king_side | white_queen_side);
+  masks[a8] = any_castling & ~black_queen_side;
+  masks[h8] = any_castling & ~black_king_side;
+  masks[e8] = any_castling & ~(black_king_side | black_queen_side);
+  return masks;
+}();
+//------------------------------------------------------------------------------
+/// Origin and target square of the rook that moves along with a castling
+/// king.
+constexpr auto castling_rook_squares(move const m) -> std::array<square, 2> {
+  auto const rank = rank_of(m.from());
+  return m.get_flag() == move::flag::king_castle
+             ? std::array{make_square(rank, 7), make_square(rank, 5)}
+             : std::array{make_square(rank, 0), make_square(rank, 3)};
+}
+//------------------------------------------------------------------------------
+auto parse_number(std::string_view const field, std::string_view const fen)
+    -> std::uint16_t {
+  std::uint16_t value = 0;
+  auto const [ptr, ec] =
+      std::from_chars(field.data(), field.data() + field.size(), value);
+  if (ec != std::errc{} || ptr != field.data() + field.size()) {
+    throw std::invalid_argument{"invalid move counter in FEN: " +
+                                std::string{fen}};
+  }
+  return value;
+}
+} // namespace
+//==============================================================================
+position::position() { m_mailbox.fill(piece::none); }
+//------------------------------------------------------------------------------
+auto position::from_fen(std::string_view const fen) -> position {
+  auto       pos    = position{};
+  auto       fields = std::array<std::string_view, 6>{};
+  auto       rest   = fen;
+  auto       count  = std::size_t{0};
+  while (!rest.empty() && count < fields.size()) {
+    auto const begin = rest.find_first_not_of(' ');
+    if (begin == std::string_view::npos) {
+      break;
+    }
+    rest            = rest.substr(begin);
+    auto const end  = rest.find(' ');
+    fields[count++] = rest.substr(0, end);
+    rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end);
+  }
+  if (count < 4) {
+    throw std::invalid_argument{"incomplete FEN: " + std::string{fen}};
+  }
+
+  // piece placement, rank 8 first
+  auto rank = std::size_t{7};
+  auto file = std::size_t{0};
+  for (auto const c : fields[0]) {
+    if (c == '/') {
+      if (file != 8 || rank == 0) {
+        throw std::invalid_argument{"invalid rank in FEN: " + std::string{fen}};
+      }
+      --rank;
+      file = 0;
+    } else if (c >= '1' && c <= '8') {
+      file += static_cast<std::size_t>(c - '0');
+    } else if (auto const p = piece_chars.find(c);
+               p != std::string_view::npos && file < 8) {
+      pos.put_piece(static_cast<piece>(p), make_square(rank, file++));
+    } else {
+      throw std::invalid_argument{"invalid piece placement in FEN: " +
+                                  std::string{fen}};
+    }
+    if (file > 8) {
+      throw std::invalid_argument{"invalid rank in FEN: " + std::string{fen}};
+    }
+  }
+  if (rank != 0 || file != 8 ||
+      popcount(pos.pieces(color::white, piece_type::king)) != 1 ||
+      popcount(pos.pieces(color::black, piece_type::king)) != 1) {
+    throw std::invalid_argument{"invalid piece placement in FEN: " +
+                                std::string{fen}};
+  }
+
+  // side to move
+  if (fields[1] == "w") {
+    pos.m_side_to_move = color::white;
+  } else if (fields[1] == "b") {
+    pos.m_side_to_move = color::black;
+  } else {
+    throw std::invalid_argument{"invalid side to move in FEN: " +
+                                std::string{fen}};
+  }
+
+  // castling rights, only kept if king and rook are still on their squares
+  if (fields[2] != "-") {
+    for (auto const c : fields[2]) {
+      switch (c) {
+        case 'K': pos.m_castling |= white_king_side; break;
+        case 'Q': pos.m_castling |= white_queen_side; break;
+        case 'k': pos.m_castling |= black_king_side; break;
+        case 'q': pos.m_castling |= black_queen_side; break;
+        default:
+          throw std::invalid_argument{"invalid castling rights in FEN: " +
+                                      std::string{fen}};
+      }
+    }
+  }
+  if (pos.piece_at(e1) != piece::white_king) {
+    pos.m_castling &= ~(white_king_side | white_queen_side);
+  }
+  if (pos.piece_at(h1) != piece::white_rook) {
+    pos.m_castling &= ~white_king_side;
+  }
+  if (pos.piece_at(a1) != piece::white_rook) {
+    pos.m_castling &= ~white_queen_side;
+  }
+  if (pos.piece_at(e8) != piece::black_king) {
+    pos.m_castling &= ~(black_king_side | black_queen_side);
+  }
+  if (pos.piece_at(h8) != piece::black_rook) {
+    pos.m_castling &= ~black_king_side;
+  }
+  if (pos.piece_at(a8) != piece::black_rook) {
+    pos.m_castling &= ~black_queen_side;
+  }
+
+  // en passant square, only recorded if a pawn of the side to move can
+  // actually capture onto it so that equal positions compare equal
+  if (fields[3] != "-") {
+    auto const &ep = fields[3];
+    if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' ||
+        (ep[1] != '3' && ep[1] != '6')) {
+      throw std::invalid_argument{"invalid en passant square in FEN: " +
+                                  std::string{fen}};
+    }
+    auto const ep_square = make_square(static_cast<std::size_t>(ep[1] - '1'),
+                                       static_cast<std::size_t>(ep[0] - 'a'));
+    auto const us        = pos.m_side_to_move;
+    // the pawn that just moved stands one rank behind the en passant square
+    // from the point of view of the side to move
+    auto const pushed =
+        us == color::white ? square_bb(ep_square) >> 8 : square_bb(ep_square) << 8;
+    auto const adjacent =
+        ((pushed << 1) & ~file_a_bb) | ((pushed >> 1) & ~file_h_bb);
+    if ((pushed & pos.pieces(~us, piece_type::pawn)) != 0 &&
+        (adjacent & pos.pieces(us, piece_type::pawn)) != 0) {
+      pos.m_en_passant = ep_square;
+    }
+  }
+
+  if (count > 4) {
+    pos.m_halfmove_clock = parse_number(fields[4], fen);
+  }
+  if (count > 5) {
+    pos.m_fullmove_number = std::max<std::uint16_t>(1, parse_number(fields[5], fen));
+  }
+  pos.m_key = pos.compute_key();
+  return pos;
+}
+//------------------------------------------------------------------------------
+auto position::to_fen() const -> std::string {
+  auto fen = std::string{};
+  for (auto rank = std::size_t{8}; rank-- > 0;) {
+    auto empty = 0;
+    for (auto file = std::size_t{0}; file < 8; ++file) {
+      auto const p = piece_at(make_square(rank, file));
+      if (p == piece::none) {
+        ++empty;
+        continue;
+      }
+      if (empty > 0) {
+        fen += static_cast<char>('0' + empty);
+        empty = 0;
+      }
+      fen += piece_chars[static_cast<std::size_t>(p)];
+    }
+    if (empty > 0) {
+      fen += static_cast<char>('0' + empty);
+    }
+    if (rank > 0) {
+      fen += '/';
+    }
+  }
+  fen += m_side_to_move == color::white ? " w " : " b ";
+  if (m_castling == no_castling) {
+    fen += '-';
+  } else {
+    if (m_castling & white_king_side) fen += 'K';
+    if (m_castling & white_queen_side) fen += 'Q';
+    if (m_castling & black_king_side) fen += 'k';
+    if (m_castling & black_queen_side) fen += 'q';
+  }
+  fen += ' ';
+  if (m_en_passant == no_square) {
+    fen += '-';
+  } else {
+    fen += static_cast<char>('a' + file_of(m_en_passant));
+    fen += static_cast<char>('1' + rank_of(m_en_passant));
+  }
+  fen += ' ' + std::to_string(m_halfmove_clock) + ' ' +
+         std::to_string(m_fullmove_number);
+  return fen;
+}
+//------------------------------------------------------------------------------
+auto position::make_move(move const m) -> undo_info {
+  auto const us    = m_side_to_move;
+  auto const them  = ~us;
+  auto const from  = m.from();
+  auto const to    = m.to();
+  auto const moved = m_mailbox[from];
+  auto       undo  = undo_info{m_key, piece::none, m_castling, m_en_passant,
+                               m_halfmove_clock};
+
+  ++m_halfmove_clock;
+  if (m.is_en_passant()) {
+    auto const sq = static_cast<square>(us == color::white ? to - 8 : to + 8);
+    undo.captured = m_mailbox[sq];
+    remove_piece(sq);
+  } else if (m.is_capture()) {
+    undo.captured = m_mailbox[to];
+    remove_piece(to);
+  }
+  if (m.is_capture() || type_of(moved) == piece_type::pawn) {
+    m_halfmove_clock = 0;
+  }
+
+  remove_piece(from);
+  put_piece(m.is_promotion() ? make_piece(us, m.promotion_type()) : moved, to);
+
+  if (m.is_castling()) {
+    auto const [rook_from, rook_to] = castling_rook_squares(m);
+    remove_piece(rook_from);
+    put_piece(make_piece(us, piece_type::rook), rook_to);
+  }
+  m_key ^= zobrist::castling(m_castling);
+  m_castling &= castling_masks[from] & castling_masks[to];
+  m_key ^= zobrist::castling(m_castling);
+
+  // same rule as in from_fen, the square is only kept if it can be captured on
+  if (m_en_passant != no_square) {
+    m_key ^= zobrist::en_passant(m_en_passant);
+  }
+  m_en_passant = no_square;
+  if (m.get_flag() == move::flag::double_pawn_push) {
+    auto const ep = static_cast<square>((from + to) / 2);
+    if ((pawn_attacks(us, ep) & pieces(them, piece_type::pawn)) != 0) {
+      m_en_passant = ep;
+      m_key ^= zobrist::en_passant(ep);
+    }
+  }
+
+  if (us == color::black) {
+    ++m_fullmove_number;
+  }
+  m_side_to_move = them;
+  m_key ^= zobrist::white_to_move;
+
+  return undo;
+}
+//------------------------------------------------------------------------------
+void position::unmake_move(move const m, undo_info const &undo) {
+  auto const them = m_side_to_move;
+  auto const us   = ~them;
+  auto const from = m.from();
+  auto const to   = m.to();
+
+  auto const moved = m.is_promotion() ? make_piece(us, piece_type::pawn)
+                                      : m_mailbox[to];
+  remove_piece(to);
+  put_piece(moved, from);
+
+  if (m.is_castling()) {
+    auto const [rook_from, rook_to] = castling_rook_squares(m);
+    remove_piece(rook_to);
+    put_piece(make_piece(us, piece_type::rook), rook_from);
+  }
+  if (m.is_en_passant()) {
+    put_piece(undo.captured,
+              static_cast<square>(us == color::white ? to - 8 : to + 8));
+  } else if (undo.captured != piece::none) {
+    put_piece(undo.captured, to);
+  }
+
+  if (us == color::black) {
+    --m_fullmove_number;
+  }
+  m_side_to_move   = us;
+  m_castling       = undo.castling;
+  m_en_passant     = undo.en_passant;
+  m_halfmove_clock = undo.halfmove_clock;
+  m_key            = undo.key;
+}
+//------------------------------------------------------------------------------
+auto position::make_null_move() -> undo_info {
+  auto const undo = undo_info{m_key, piece::none, m_castling, m_en_passant,
+                              m_halfmove_clock};
+  if (m_en_passant != no_square) {
+    m_key ^= zobrist::en_passant(m_en_passant);
+    m_en_passant = no_square;
+  }
+  m_halfmove_clock = 0;
+  m_side_to_move   = ~m_side_to_move;
+  m_key ^= zobrist::white_to_move;
+  return undo;
+}
+//------------------------------------------------------------------------------
+void position::unmake_null_move(undo_info const &undo) {
+  m_side_to_move   = ~m_side_to_move;
+  m_en_passant     = undo.en_passant;
+  m_halfmove_clock = undo.halfmove_clock;
+  m_key            = undo.key;
+}
+//------------------------------------------------------------------------------
+auto position::compute_key() const -> std::uint64_t {
+  auto key      = std::uint64_t{0};
+  auto occupied = m_occupied;
+  while (occupied != 0) {
+    auto const sq = pop_lsb(occupied);
+    key ^= zobrist::piece_square(m_mailbox[sq], sq);
+  }
+  key ^= zobrist::castling(m_castling);
+  if (m_en_passant != no_square) {
+    key ^= zobrist::en_passant(m_en_passant);
+  }
+  if (m_side_to_move == color::white) {
+    key ^= zobrist::white_to_move;
+  }
+  return key;
+}
+//------------------------------------------------------------------------------
+void position::put_piece(piece const p, square const sq) {
+  auto const bb = square_bb(sq);
+  m_pieces[static_cast<std::size_t>(p)] |= bb;
+  m_occupancy[static_cast<std::size_t>(color_of(p))] |= bb;
+  m_occupied |= bb;
+  m_mailbox[sq] = p;
+  m_key ^= zobrist::piece_square(p, sq);
+}
+//------------------------------------------------------------------------------
+void position::remove_piece(square const sq) {
+  auto const p = m_mailbox[sq];
+  if (p == piece::none) {
+    return;
+  }
+  auto const bb = square_bb(sq);
+  m_pieces[static_cast<std::size_t>(p)] &= ~bb;
+  m_occupancy[static_cast<std::size_t>(color_of(p))] &= ~bb;
+  m_occupied &= ~bb;
+  m_mailbox[sq] = piece::none;
+  m_key ^= zobrist::piece_square(p, sq);
+}
+//==============================================================================
+} // namespace chess
+//==============================================================================
@@ -0,0 +1,282 @@
+#include "chess/replication.h"
+
+#include <algorithm>
+#include <stdexcept>
+//==============================================================================
+namespace chess {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+template <typename T>
+void put(std::vector<std::uint8_t> &out, T const value) {
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+  }
+}
+//------------------------------------------------------------------------------
+/// Reads little endian values front to back and throws std::invalid_argument
+/// when the update ends too early.
+class reader {
+ public:
+  explicit reader(std::span<std::uint8_t const> const bytes)
+      : m_bytes{bytes} {}
+  //----------------------------------------------------------------------------
+  template <typename T>
+  auto get() -> T {
+    if (m_bytes.size() < sizeof(T)) {
+      throw std::invalid_argument{"truncated replication update"};
+    }
+    auto value = T{0};
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+      value |= static_cast<T>(static_cast<T>(m_bytes[i]) << (8 * i));
+    }
+    m_bytes = m_bytes.subspan(sizeof(T));
+    return value;
+  }
+  //----------------------------------------------------------------------------
+  auto empty() const { return m_bytes.empty(); }
+
+ private:
+  std::span<std::uint8_t const> m_bytes;
+};
+//------------------------------------------------------------------------------
+auto to_piece(std::uint8_t const nibble) -> piece {
+  if (nibble > static_cast<std::uint8_t>(piece::none)) {
+    throw std::invalid_argument{"invalid piece in replication update"};
+  }
+  return static_cast<piece>(nibble);
+}
+//------------------------------------------------------------------------------
+auto to_color(std::uint8_t const value) -> color {
+  if (value > 1) {
+    throw std::invalid_argument{"invalid color in replication update"};
+  }
+  return static_cast<color>(value);
+}
+//------------------------------------------------------------------------------
+auto to_status(std::uint8_t const value) -> game_status {
+  if (value > static_cast<std::uint8_t>(game_status::aborted)) {
+    throw std::invalid_argument{"invalid status in replication update"};
+  }
+  return static_cast<game_status>(value);
+}
+//------------------------------------------------------------------------------
+/// Pieces of the squares in mask, two per byte with the lower square in the
+/// low nibble.
+void put_pieces(std::vector<std::uint8_t> &out,
+                std::array<piece, 64> const &squares, bitboard mask) {
+  while (mask != 0) {
+    auto byte = static_cast<std::uint8_t>(squares[pop_lsb(mask)]);
+    if (mask != 0) {
+      byte |= static_cast<std::uint8_t>(
+          static_cast<std::uint8_t>(squares[pop_lsb(mask)]) << 4);
+    }
+    out.push_back(byte);
+  }
+}
+//------------------------------------------------------------------------------
+void get_pieces(reader &in, std::array<piece, 64> &squares, bitboard mask) {
+  while (mask != 0) {
+    auto const byte = in.get<std::uint8_t>();
+    squares[pop_lsb(mask)] = to_piece(byte & 0xF);
+    if (mask != 0) {
+      squares[pop_lsb(mask)] = to_piece(byte >> 4);
+    }
+  }
+}
+//------------------------------------------------------------------------------
+void put_header(std::vector<std::uint8_t> &out, update_kind const kind,
+                network_id const id, std::uint32_t const version) {
+  put(out, static_cast<std::uint8_t>(kind));
+  put(out, id);
+  put(out, version);
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+auto update_header::read(std::span<std::uint8_t const> const update)
+    -> update_header {
+  auto in   = reader{update};
+  auto kind = in.get<std::uint8_t>();
+  if (kind > static_cast<std::uint8_t>(update_kind::delta)) {
+    throw std::invalid_argument{"unknown replication update kind"};
+  }
+  auto const id      = in.get<network_id>();
+  auto const version = in.get<std::uint32_t>();
+  return {static_cast<update_kind>(kind), id, version};
+}
+//==============================================================================
+replicated_game::replicated_game() { m_squares.fill(piece::none); }
+//------------------------------------------------------------------------------
+void replicated_game::mark_changed(std::uint8_t const fields) {
+  m_changed_fields |= fields;
+  mark_dirty();
+}
+//------------------------------------------------------------------------------
+void replicated_game::set_piece(square const sq, piece const p) {
+  if (m_squares[sq] == p) {
+    return;
+  }
+  m_squares[sq] = p;
+  m_changed_squares |= square_bb(sq);
+  mark_dirty();
+}
+//------------------------------------------------------------------------------
+void replicated_game::set_side_to_move(color const c) {
+  if (m_side_to_move != c) {
+    m_side_to_move = c;
+    mark_changed(side_field);
+  }
+}
+//------------------------------------------------------------------------------
+void replicated_game::set_clock(color const c,
+                                std::uint32_t const milliseconds) {
+  auto &clock = m_clocks[static_cast<int>(c)];
+  if (clock != milliseconds) {
+    clock = milliseconds;
+    mark_changed(clocks_field);
+  }
+}
+//------------------------------------------------------------------------------
+void replicated_game::set_status(game_status const s) {
+  if (m_status != s) {
+    m_status = s;
+    mark_changed(status_field);
+  }
+}
+//------------------------------------------------------------------------------
+void replicated_game::sync(position const &pos) {
+  for (auto sq = 0; sq < 64; ++sq) {
+    set_piece(static_cast<square>(sq), pos.piece_at(static_cast<square>(sq)));
+  }
+  set_side_to_move(pos.side_to_move());
+}
+//------------------------------------------------------------------------------
+void replicated_game::write_keyframe(std::vector<std::uint8_t> &out) const {
+  put_header(out, update_kind::keyframe, get_network_id(), m_version);
+  put_pieces(out, m_squares, ~bitboard{0});
+  put(out, static_cast<std::uint8_t>(m_side_to_move));
+  put(out, static_cast<std::uint8_t>(m_status));
+  put(out, m_clocks[0]);
+  put(out, m_clocks[1]);
+}
+//------------------------------------------------------------------------------
+void replicated_game::write_delta(std::vector<std::uint8_t> &out) const {
+  put_header(out, update_kind::delta, get_network_id(), m_version + 1);
+  put(out, m_changed_squares);
+  put_pieces(out, m_squares, m_changed_squares);
+  put(out, m_changed_fields);
+  if (m_changed_fields & side_field) {
+    put(out, static_cast<std::uint8_t>(m_side_to_move));
+  }
+  if (m_changed_fields & clocks_field) {
+    put(out, m_clocks[0]);
+    put(out, m_clocks[1]);
+  }
+  if (m_changed_fields & status_field) {
+    put(out, static_cast<std::uint8_t>(m_status));
+  }
+}
+//------------------------------------------------------------------------------
+void replicated_game::commit() {
+  ++m_version;
+  m_changed_squares = 0;
+  m_changed_fields  = 0;
+  clear_dirty();
+}
+//------------------------------------------------------------------------------
+auto replicated_game::apply(std::span<std::uint8_t const> const update)
+    -> apply_result {
+  auto const header = update_header::read(update);
+  if (is_registered() && header.id != get_network_id()) {
+    throw std::invalid_argument{"replication update of another instance"};
+  }
+  if (header.kind == update_kind::delta && !is_registered()) {
+    return apply_result::needs_keyframe;
+  }
+  if (is_registered() && header.version <= m_version) {
+    return apply_result::stale;
+  }
+  if (header.kind == update_kind::delta && header.version != m_version + 1) {
+    return apply_result::needs_keyframe;
+  }
+
+  // Decode into a copy so that a malformed update leaves the state untouched
+  auto next = m_squares;
+  auto in   = reader{update.subspan(update_header::size)};
+  auto side = m_side_to_move;
+  auto status = m_status;
+  auto clocks = m_clocks;
+  if (header.kind == update_kind::keyframe) {
+    get_pieces(in, next, ~bitboard{0});
+    side      = to_color(in.get<std::uint8_t>());
+    status    = to_status(in.get<std::uint8_t>());
+    clocks[0] = in.get<std::uint32_t>();
+    clocks[1] = in.get<std::uint32_t>();
+  } else {
+    get_pieces(in, next, in.get<bitboard>());
+    auto const fields = in.get<std::uint8_t>();
+    if (fields & side_field) {
+      side = to_color(in.get<std::uint8_t>());
+    }
+    if (fields & clocks_field) {
+      clocks[0] = in.get<std::uint32_t>();
+      clocks[1] = in.get<std::uint32_t>();
+    }
+    if (fields & status_field) {
+      status = to_status(in.get<std::uint8_t>());
+    }
+  }
+  if (!in.empty()) {
+    throw std::invalid_argument{"trailing bytes in replication update"};
+  }
+  m_squares      = next;
+  m_side_to_move = side;
+  m_status       = status;
+  m_clocks       = clocks;
+  m_version      = header.version;
+  set_network_id(header.id);
+  return apply_result::applied;
+}
+//==============================================================================
+replication_registry::replication_registry(
+    std::uint32_t const keyframe_interval)
+    : m_keyframe_interval{std::max<std::uint32_t>(keyframe_interval, 1)} {}
+//------------------------------------------------------------------------------
+auto replication_registry::add(replicated_game &game) -> network_id {
+  if (game.is_registered()) {
+    throw std::logic_error{"game is registered already"};
+  }
+  auto const id = m_next_id++;
+  game.set_network_id(id);
+  m_games.emplace(id, &game);
+  return id;
+}
+//------------------------------------------------------------------------------
+void replication_registry::remove(replicated_game &game) {
+  auto const it = m_games.find(game.get_network_id());
+  if (it != end(m_games) && it->second == &game) {
+    m_games.erase(it);
+    game.set_network_id(no_network_id);
+  }
+}
+//------------------------------------------------------------------------------
+auto replication_registry::find(network_id const id) const
+    -> replicated_game * {
+  auto const it = m_games.find(id);
+  return it == end(m_games) ? nullptr : it->second;
+}
+//------------------------------------------------------------------------------
+auto replication_registry::keyframe(network_id const id,
+                                    std::vector<std::uint8_t> &out) const
+    -> bool {
+  auto const *game = find(id);
+  if (game == nullptr) {
+    return false;
+  }
+  game->write_keyframe(out);
+  return true;
+}
+//==============================================================================
+} // namespace chess
+//==============================================================================
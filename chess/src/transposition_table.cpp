@@ -0,0 +1,213 @@
+#include "chess/transposition_table.h"
+
+#include <algorithm>
+#include <limits>
+//==============================================================================
+namespace chess {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+// Packed slot layout:
+//   bits  0-15 best move
+//   bits 16-31 score
+//   bits 32-47 static evaluation
+//   bits 48-55 depth - min_depth + 1, never zero for a used slot
+//   bits 56-57 bound
+//   bits 58-63 age of the search that stored the entry
+constexpr auto age_bits = 6;
+constexpr auto age_mask = (1 << age_bits) - 1;
+static_assert(256 % (age_mask + 1) == 0);
+//------------------------------------------------------------------------------
+constexpr auto pack(tt_entry const &e, std::uint8_t const age)
+    -> std::uint64_t {
+  auto const depth = std::clamp(e.depth, transposition_table::min_depth, 254 +
+                                             transposition_table::min_depth) -
+                     transposition_table::min_depth + 1;
+  return std::uint64_t{e.best_move.raw()} |
+         std::uint64_t{static_cast<std::uint16_t>(e.score)} << 16 |
+         std::uint64_t{static_cast<std::uint16_t>(e.eval)} << 32 |
+         static_cast<std::uint64_t>(depth) << 48 |
+         static_cast<std::uint64_t>(e.type) << 56 |
+         static_cast<std::uint64_t>(age & age_mask) << 58;
+}
+//------------------------------------------------------------------------------
+constexpr auto unpack(std::uint64_t const data) -> tt_entry {
+  return {move::from_raw(static_cast<std::uint16_t>(data)),
+          static_cast<std::int16_t>(data >> 16),
+          static_cast<std::int16_t>(data >> 32),
+          static_cast<int>((data >> 48) & 0xFF) - 1 +
+              transposition_table::min_depth,
+          static_cast<bound>((data >> 56) & 3)};
+}
+//------------------------------------------------------------------------------
+constexpr auto depth_of(std::uint64_t const data) -> int {
+  return static_cast<int>((data >> 48) & 0xFF);
+}
+constexpr auto age_of(std::uint64_t const data) -> std::uint8_t {
+  return static_cast<std::uint8_t>(data >> 58);
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+transposition_table::transposition_table(std::size_t const megabytes) {
+  resize(megabytes);
+}
+//------------------------------------------------------------------------------
+void transposition_table::resize(std::size_t const megabytes) {
+  m_bucket_count =
+      std::max<std::size_t>(1, megabytes * 1024 * 1024 / sizeof(bucket));
+  m_buckets.reset();
+  m_buckets = std::make_unique<bucket[]>(m_bucket_count);
+  m_age.store(0, std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+void transposition_table::clear() {
+  for (auto i = std::size_t{0}; i < m_bucket_count; ++i) {
+    for (auto &s : m_buckets[i].slots) {
+      s.key_xor_data.store(0, std::memory_order_relaxed);
+      s.data.store(0, std::memory_order_relaxed);
+    }
+  }
+  m_age.store(0, std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+void transposition_table::new_search() {
+  if (m_age_interval == std::chrono::steady_clock::duration::zero()) {
+    m_age.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // of the searches starting in one interval only the first ages the entries
+  auto const now  = std::chrono::steady_clock::now().time_since_epoch();
+  auto       next = m_next_age.load(std::memory_order_relaxed);
+  if (now.count() >= next &&
+      m_next_age.compare_exchange_strong(next, (now + m_age_interval).count(),
+                                         std::memory_order_relaxed)) {
+    m_age.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+//------------------------------------------------------------------------------
+void transposition_table::set_age_interval(
+    std::chrono::milliseconds const interval) {
+  m_age_interval = interval;
+  m_next_age.store(0, std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+auto transposition_table::age() const -> std::uint8_t {
+  return static_cast<std::uint8_t>(m_age.load(std::memory_order_relaxed) &
+                                   age_mask);
+}
+//------------------------------------------------------------------------------
+auto transposition_table::probe(std::uint64_t const key, counters &stats) const
+    -> std::optional<tt_entry> {
+  ++stats.probes;
+  for (auto const &s : m_buckets[bucket_index(key)].slots) {
+    auto const data = s.data.load(std::memory_order_relaxed);
+    if ((s.key_xor_data.load(std::memory_order_relaxed) ^ data) == key &&
+        data != 0) {
+      ++stats.hits;
+      return unpack(data);
+    }
+  }
+  return std::nullopt;
+}
+//------------------------------------------------------------------------------
+void transposition_table::store(std::uint64_t const key, tt_entry const &entry,
+                                counters &stats) {
+  ++stats.stores;
+  auto &b = m_buckets[bucket_index(key)];
+
+  // prefer the slot that already holds this position, then an empty one and
+  // otherwise evict the shallowest entry, counting every search of age as
+  // eight plies of depth
+  auto *victim       = &b.slots[0];
+  auto  victim_data  = std::uint64_t{0};
+  auto  victim_worth = std::numeric_limits<int>::max();
+  auto  same_key     = false;
+  auto const current = age();
+  for (auto &s : b.slots) {
+    auto const data = s.data.load(std::memory_order_relaxed);
+    if (data == 0) {
+      if (victim_worth > std::numeric_limits<int>::min()) {
+        victim       = &s;
+        victim_data  = 0;
+        victim_worth = std::numeric_limits<int>::min();
+      }
+      continue;
+    }
+    if ((s.key_xor_data.load(std::memory_order_relaxed) ^ data) == key) {
+      victim      = &s;
+      victim_data = data;
+      same_key    = true;
+      break;
+    }
+    auto const relative_age = (current - age_of(data)) & age_mask;
+    auto const worth        = depth_of(data) - 8 * relative_age;
+    if (worth < victim_worth) {
+      victim       = &s;
+      victim_data  = data;
+      victim_worth = worth;
+    }
+  }
+
+  auto updated = entry;
+  if (same_key) {
+    auto const old = unpack(victim_data);
+    // keep deeper results of the current search unless the new one is exact
+    if (entry.type != bound::exact && age_of(victim_data) == current &&
+        old.depth > entry.depth + 3) {
+      return;
+    }
+    if (updated.best_move.is_null()) {
+      updated.best_move = old.best_move;
+    }
+  } else if (victim_data != 0) {
+    ++stats.collisions;
+  }
+
+  auto const data = pack(updated, current);
+  victim->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+  victim->data.store(data, std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+auto transposition_table::size_in_megabytes() const -> std::size_t {
+  return m_bucket_count * sizeof(bucket) / (1024 * 1024);
+}
+//------------------------------------------------------------------------------
+auto transposition_table::hashfull() const -> int {
+  auto const buckets = std::min<std::size_t>(m_bucket_count, 250);
+  auto       used    = std::size_t{0};
+  auto const current = age();
+  for (auto i = std::size_t{0}; i < buckets; ++i) {
+    for (auto const &s : m_buckets[i].slots) {
+      auto const data = s.data.load(std::memory_order_relaxed);
+      if (data != 0 && age_of(data) == current) {
+        ++used;
+      }
+    }
+  }
+  return static_cast<int>(used * 1000 / (buckets * slots_per_bucket));
+}
+//------------------------------------------------------------------------------
+void transposition_table::add_counters(counters const &stats) {
+  m_probes.fetch_add(stats.probes, std::memory_order_relaxed);
+  m_hits.fetch_add(stats.hits, std::memory_order_relaxed);
+  m_stores.fetch_add(stats.stores, std::memory_order_relaxed);
+  m_collisions.fetch_add(stats.collisions, std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+auto transposition_table::get_counters() const -> counters {
+  return {m_probes.load(std::memory_order_relaxed),
+          m_hits.load(std::memory_order_relaxed),
+          m_stores.load(std::memory_order_relaxed),
+          m_collisions.load(std::memory_order_relaxed)};
+}
+//------------------------------------------------------------------------------
+void transposition_table::reset_counters() {
+  m_probes.store(0, std::memory_order_relaxed);
+  m_hits.store(0, std::memory_order_relaxed);
+  m_stores.store(0, std::memory_order_relaxed);
+  m_collisions.store(0, std::memory_order_relaxed);
+}
+//==============================================================================
+} // namespace chess
+//==============================================================================
@@ -0,0 +1,291 @@
+#include <catch2/catch_test_macros.hpp>
+//==============================================================================
+#include <chess/chessboard.h>
+#include <chess/movegen.h>
+#include <chess/replication.h>
+#include <chess/transposition_table.h>
+//==============================================================================
+#include <array>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+//==============================================================================
+using chess::chess_board;
+using chess::move_list;
+using chess::position;
+using chess::transposition_table;
+//==============================================================================
+TEST_CASE( "position::from_fen, position::to_fen" ) {
+  auto const fen =
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+  REQUIRE(position::from_fen(fen).to_fen() == fen);
+  // en passant squares nobody can capture on are dropped
+  REQUIRE(position::from_fen(
+              "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1")
+              .en_passant() == chess::no_square);
+}
+//==============================================================================
+TEST_CASE( "chess_board::make_move, chess_board::unmake_move" ) {
+  auto board   = chess_board{};
+  auto initial = board.get_position();
+  auto rng     = std::mt19937{42};
+
+  // random playouts, checking the incremental key against a full recompute
+  for (auto game = 0; game < 20; ++game) {
+    for (auto ply = 0; ply < 200; ++ply) {
+      auto moves = move_list{};
+      board.get_possible_moves(moves);
+      if (moves.empty()) {
+        break;
+      }
+      board.make_move(moves[rng() % moves.size()]);
+      REQUIRE(board.get_key() == board.get_position().compute_key());
+    }
+    while (board.get_ply() > 0) {
+      board.unmake_move();
+    }
+    REQUIRE(board.get_position() == initial);
+  }
+}
+//==============================================================================
+TEST_CASE( "zobrist key transpositions" ) {
+  auto play = [](std::initializer_list<char const *> const moves) {
+    auto pos = position::from_fen(position::start_fen);
+    for (auto const uci : moves) {
+      pos.make_move(chess::parse_move(pos, uci));
+    }
+    return pos.key();
+  };
+  REQUIRE(play({"g1f3", "g8f6", "b1c3"}) == play({"b1c3", "g8f6", "g1f3"}));
+  REQUIRE(play({"e2e4"}) != play({"e2e3"}));
+  // the same placement with different castling rights is another position
+  REQUIRE(play({"g1f3", "g8f6", "h1g1", "f6g8", "g1h1", "g8f6"}) !=
+          play({"g1f3", "g8f6"}));
+}
+//==============================================================================
+TEST_CASE( "zobrist keys are Polyglot keys" ) {
+  auto play = [](std::initializer_list<char const *> const moves) {
+    auto pos = position::from_fen(position::start_fen);
+    for (auto const uci : moves) {
+      pos.make_move(chess::parse_move(pos, uci));
+    }
+    // the key kept up to date by the moves is the one of the position
+    REQUIRE(position::from_fen(pos.to_fen()).key() == pos.key());
+    return pos.key();
+  };
+  // the positions of the Polyglot book format specification
+  REQUIRE(play({}) == 0x463b96181691fc9cULL);
+  REQUIRE(play({"e2e4"}) == 0x823c9b50fd114196ULL);
+  REQUIRE(play({"e2e4", "d7d5"}) == 0x0756b94461c50fb0ULL);
+  REQUIRE(play({"e2e4", "d7d5", "e4e5"}) == 0x662fafb965db29d4ULL);
+  // en passant is possible on f6
+  REQUIRE(play({"e2e4", "d7d5", "e4e5", "f7f5"}) == 0x22a48b5a8e47ff78ULL);
+  REQUIRE(play({"e2e4", "d7d5", "e4e5", "f7f5", "e1e2"}) ==
+          0x652a607ca3f242c1ULL);
+  REQUIRE(play({"e2e4", "d7d5", "e4e5", "f7f5", "e1e2", "e8f7"}) ==
+          0x00fdd303c946bdd9ULL);
+  REQUIRE(play({"a2a4", "b7b5", "h2h4", "b5b4", "c2c4"}) ==
+          0x3c8123ea7b067637ULL);
+  REQUIRE(play({"a2a4", "b7b5", "h2h4", "b5b4", "c2c4", "b4c3", "a1a3"}) ==
+          0x5c3f9b829b279560ULL);
+}
+//==============================================================================
+TEST_CASE( "chess_board::is_repetition" ) {
+  auto board = chess_board{};
+  for (auto const uci : {"g1f3", "g8f6", "f3g1"}) {
+    board.make_move(chess::parse_move(board.get_position(), uci));
+    REQUIRE_FALSE(board.is_repetition());
+  }
+  board.make_move(chess::parse_move(board.get_position(), "f6g8"));
+  REQUIRE(board.is_repetition());
+}
+//==============================================================================
+TEST_CASE( "transposition_table::store, transposition_table::probe" ) {
+  auto tt    = transposition_table{1};
+  auto stats = transposition_table::counters{};
+  auto const m = chess::move{chess::e2, chess::e4,
+                             chess::move::flag::double_pawn_push};
+
+  REQUIRE_FALSE(tt.probe(42, stats).has_value());
+  tt.store(42, {m, -300, 25, 7, chess::bound::lower}, stats);
+  auto const e = tt.probe(42, stats);
+  REQUIRE(e.has_value());
+  REQUIRE(e->best_move == m);
+  REQUIRE(e->score == -300);
+  REQUIRE(e->eval == 25);
+  REQUIRE(e->depth == 7);
+  REQUIRE(e->type == chess::bound::lower);
+
+  // a shallower result without a move keeps the known best move
+  tt.store(42, {chess::move{}, 10, 25, 6, chess::bound::exact}, stats);
+  REQUIRE(tt.probe(42, stats)->best_move == m);
+  REQUIRE(tt.probe(42, stats)->score == 10);
+
+  REQUIRE(stats.probes == 4);
+  REQUIRE(stats.hits == 3);
+
+  tt.resize(2);
+  REQUIRE(tt.size_in_megabytes() == 2);
+  REQUIRE_FALSE(tt.probe(42, stats).has_value());
+}
+//==============================================================================
+TEST_CASE( "transposition_table concurrent access" ) {
+  auto tt = transposition_table{1};
+  // every entry is derived from its key, so a probe returning a mix of two
+  // stores would be noticed
+  auto const score_of = [](std::uint64_t const key) {
+    return static_cast<std::int16_t>(key >> 48);
+  };
+  auto const depth_of = [](std::uint64_t const key) {
+    return static_cast<int>(key % 64);
+  };
+  auto threads = std::vector<std::thread>{};
+  auto failures = std::atomic<int>{0};
+  for (auto t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      auto rng   = std::mt19937_64{static_cast<std::uint64_t>(t)};
+      auto stats = transposition_table::counters{};
+      for (auto i = 0; i < 200000; ++i) {
+        // small key space so that threads hit the same buckets
+        auto const key = rng() | 0xFF;
+        auto const k   = key & 0xFFFF0000000003FFULL;
+        if (i % 2 == 0) {
+          tt.store(k, {chess::move{}, score_of(k), 0, depth_of(k),
+                       chess::bound::exact}, stats);
+        } else if (auto const e = tt.probe(k, stats)) {
+          if (e->score != score_of(k) || e->depth != depth_of(k)) {
+            ++failures;
+          }
+        }
+      }
+      tt.add_counters(stats);
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  REQUIRE(failures == 0);
+  REQUIRE(tt.get_counters().probes == 400000);
+  REQUIRE(tt.get_counters().stores == 400000);
+}
+//==============================================================================
+TEST_CASE( "transposition_table::set_age_interval" ) {
+  auto tt    = transposition_table{1};
+  auto stats = transposition_table::counters{};
+  auto const fill = [&] {
+    for (auto key = std::uint64_t{1}; key < 4000; ++key) {
+      tt.store(key * 0x9E3779B97F4A7C15ULL, {chess::move{}, 0, 0, 1,
+                                            chess::bound::exact}, stats);
+    }
+  };
+  fill();
+  REQUIRE(tt.hashfull() > 0);
+  // every search ages the entries of a table it does not share
+  tt.new_search();
+  REQUIRE(tt.hashfull() == 0);
+
+  // concurrent searches of a shared table do not age each other's entries
+  tt.set_age_interval(std::chrono::hours{1});
+  tt.new_search();
+  fill();
+  auto const used = tt.hashfull();
+  REQUIRE(used > 0);
+  for (auto i = 0; i < 100; ++i) {
+    tt.new_search();
+  }
+  REQUIRE(tt.hashfull() == used);
+
+  // until the interval has passed
+  tt.set_age_interval(std::chrono::milliseconds{1});
+  tt.new_search();
+  fill();
+  std::this_thread::sleep_for(std::chrono::milliseconds{2});
+  tt.new_search();
+  REQUIRE(tt.hashfull() == 0);
+}
+//==============================================================================
+TEST_CASE( "replicated_game keyframes and deltas" ) {
+  auto registry = chess::replication_registry{4};
+  auto board    = chess_board{};
+  auto game     = chess::replicated_game{};
+  game.sync(board.get_position());
+  game.set_status(chess::game_status::ongoing);
+  auto const id = registry.add(game);
+  REQUIRE(id != chess::no_network_id);
+  REQUIRE(registry.find(id) == &game);
+
+  // A client that joins first gets a keyframe
+  auto joined = std::vector<std::uint8_t>{};
+  REQUIRE(registry.keyframe(id, joined));
+  REQUIRE(joined.size() == chess::replicated_game::keyframe_size);
+  auto client = chess::replicated_game{};
+  REQUIRE(client.apply(joined) == chess::apply_result::applied);
+  REQUIRE(client.get_network_id() == id);
+  REQUIRE(client.piece_at(chess::e2) == chess::piece::white_pawn);
+
+  // The first tick sends the setup, later ticks only what changed
+  auto updates = std::vector<std::vector<std::uint8_t>>{};
+  auto collect = [&](chess::replicated_game const &,
+                     std::span<std::uint8_t const> update) {
+    updates.emplace_back(update.begin(), update.end());
+  };
+  registry.tick(collect);
+  board.make_move(chess::parse_move(board.get_position(), "e2e4"));
+  game.sync(board.get_position());
+  game.set_clock(chess::color::white, 59000);
+  registry.tick(collect);
+  registry.tick(collect);
+  REQUIRE(updates.size() == 2);
+  REQUIRE(updates[1].size() < chess::replicated_game::keyframe_size);
+  REQUIRE_FALSE(game.is_dirty());
+
+  for (auto const &update : updates) {
+    REQUIRE(client.apply(update) == chess::apply_result::applied);
+  }
+  REQUIRE(client.apply(updates[0]) == chess::apply_result::stale);
+  REQUIRE(client.piece_at(chess::e2) == chess::piece::none);
+  REQUIRE(client.piece_at(chess::e4) == chess::piece::white_pawn);
+  REQUIRE(client.side_to_move() == chess::color::black);
+  REQUIRE(client.clock(chess::color::white) == 59000);
+  REQUIRE(client.status() == chess::game_status::ongoing);
+
+  // Every fourth update of a game is a keyframe
+  updates.clear();
+  game.set_clock(chess::color::black, 58000);
+  registry.tick(collect);
+  game.set_clock(chess::color::black, 57000);
+  auto const changed = std::array{id, id};
+  registry.tick(changed, collect);
+  REQUIRE(updates.size() == 2);
+  REQUIRE(chess::update_header::read(updates[0]).kind ==
+          chess::update_kind::delta);
+  REQUIRE(chess::update_header::read(updates[1]).kind ==
+          chess::update_kind::keyframe);
+  REQUIRE(client.apply(updates[1]) == chess::apply_result::applied);
+  REQUIRE(client.clock(chess::color::black) == 57000);
+
+  // A client that missed a delta has to wait for a keyframe
+  auto late = chess::replicated_game{};
+  REQUIRE(late.apply(joined) == chess::apply_result::applied);
+  game.set_status(chess::game_status::white_won);
+  updates.clear();
+  registry.tick(collect);
+  REQUIRE(updates.size() == 1);
+  REQUIRE(late.apply(updates[0]) == chess::apply_result::needs_keyframe);
+  REQUIRE(client.apply(updates[0]) == chess::apply_result::applied);
+  REQUIRE(client.status() == chess::game_status::white_won);
+
+  // Malformed updates are rejected without touching the state
+  auto truncated = joined;
+  truncated.pop_back();
+  auto fresh = chess::replicated_game{};
+  REQUIRE_THROWS_AS(fresh.apply(truncated), std::invalid_argument);
+  REQUIRE_FALSE(fresh.is_registered());
+  REQUIRE(fresh.piece_at(chess::e2) == chess::piece::none);
+
+  registry.remove(game);
+  REQUIRE_FALSE(game.is_registered());
+  REQUIRE(registry.add(game) != id);
+}
@@ -0,0 +1,95 @@
+#include <chess/engine/search.h>
+//==============================================================================
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+//==============================================================================
+namespace {
+//==============================================================================
+constexpr auto positions = std::array<std::string_view, 6>{
+    chess::position::start_fen,
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+//------------------------------------------------------------------------------
+struct measurement {
+  std::uint64_t nodes   = 0;
+  double        seconds = 0;
+  int           depth   = 0;
+};
+//------------------------------------------------------------------------------
+/// Searches every position for movetime with an empty table.
+auto measure(std::size_t const threads, std::chrono::milliseconds const movetime,
+             std::size_t const hash_megabytes) -> measurement {
+  auto tt     = chess::transposition_table{hash_megabytes};
+  auto search = chess::engine::searcher{tt};
+  auto total  = measurement{};
+  for (auto const fen : positions) {
+    tt.clear();
+    auto const begin  = std::chrono::steady_clock::now();
+    auto const result = search.search(
+        chess::chess_board{fen}, {.time = movetime, .threads = threads});
+    total.seconds += std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    total.nodes += result.nodes;
+    total.depth += result.depth;
+  }
+  return total;
+}
+//------------------------------------------------------------------------------
+auto parse(std::string_view const arg, std::size_t &value) -> bool {
+  auto const [ptr, ec] =
+      std::from_chars(arg.data(), arg.data() + arg.size(), value);
+  return ec == std::errc{} && value > 0;
+}
+//==============================================================================
+} // namespace
+//==============================================================================
+// usage: engine.bench [max-threads [movetime-ms [hash-mb]]]
+// Reports nodes per second and speedup over one thread for 1, 2, 4, ... and
+// max-threads threads, which defaults to the number of cores.
+auto main(int argc, char **argv) -> int {
+  auto max_threads =
+      static_cast<std::size_t>(std::max(std::thread::hardware_concurrency(), 1U));
+  auto movetime       = std::size_t{1000};
+  auto hash_megabytes = std::size_t{64};
+  if ((argc > 1 && !parse(argv[1], max_threads)) ||
+      (argc > 2 && !parse(argv[2], movetime)) ||
+      (argc > 3 && !parse(argv[3], hash_megabytes))) {
+    std::cerr << "usage: engine.bench [max-threads [movetime-ms [hash-mb]]]\n";
+    return 2;
+  }
+
+  auto counts = std::vector<std::size_t>{};
+  for (auto t = std::size_t{1}; t < max_threads; t *= 2) {
+    counts.push_back(t);
+  }
+  counts.push_back(max_threads);
+
+  std::cout << "threads        nodes      nodes/s  speedup  avg depth\n";
+  auto single = 0.0;
+  for (auto const threads : counts) {
+    auto const m =
+        measure(threads, std::chrono::milliseconds{movetime}, hash_megabytes);
+    auto const nps = static_cast<double>(m.nodes) / std::max(m.seconds, 1e-9);
+    if (threads == 1) {
+      single = nps;
+    }
+    std::cout << std::setw(7) << threads << std::setw(13) << m.nodes
+              << std::setw(13) << static_cast<std::uint64_t>(nps)
+              << std::setw(8) << std::fixed << std::setprecision(2)
+              << nps / single << 'x' << std::setw(11) << std::setprecision(1)
+              << static_cast<double>(m.depth) / positions.size() << '\n';
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+//==============================================================================
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <chess/move.h>
+#include <chess/position.h>
+
+#include "mapped_file.h"
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+struct book_move {
+  move          m;
+  std::uint16_t weight = 0;
+};
+//------------------------------------------------------------------------------
+/// How a game picks among the book moves of a position.
+struct book_settings {
+  /// The book is only consulted for this many plies of a game.
+  int           max_ply = 30;
+  /// Moves with a lower weight are never played.
+  std::uint16_t min_weight = 1;
+  /// Picks moves with a probability proportional to their weight if set and
+  /// always the heaviest move otherwise.
+  bool          weighted_random = true;
+};
+//==============================================================================
+/// Opening book in Polyglot format, memory-mapped read-only.
+///
+/// A Polyglot file is a sequence of 16 byte big endian entries (key, move,
+/// weight, learn) sorted by key, so probing is a binary search directly on the
+/// mapping. Nothing is parsed or copied on construction and one book can be
+/// shared by any number of games and threads.
+///
+/// Entries are looked up by position::key, which is computed from Polyglot's
+/// Random64 table with its castling and en passant rules, so books made by
+/// other Polyglot tools can be probed directly.
+class polyglot_book {
+ public:
+  struct entry {
+    std::uint64_t key;
+    book_move     m;
+  };
+  static constexpr std::size_t entry_size = 16;
+  //----------------------------------------------------------------------------
+  /// Throws std::system_error if the file cannot be mapped and
+  /// std::runtime_error if its size is not a multiple of entry_size.
+  explicit polyglot_book(std::filesystem::path const &path);
+  //----------------------------------------------------------------------------
+  /// Legal book moves of pos in file order, which is usually heaviest first.
+  auto probe(position const &pos) const -> std::vector<book_move>;
+  /// Picks a book move for pos according to settings or returns a null move
+  /// if there is none. ply is the number of plies played in the game.
+  auto pick(position const &pos, int ply, book_settings const &settings,
+            std::mt19937_64 &rng) const -> move;
+  auto size() const { return m_file.size() / entry_size; }
+  //----------------------------------------------------------------------------
+  /// Polyglot encoding of m, castling is encoded as the king capturing its
+  /// rook.
+  static auto encode_move(move m) -> std::uint16_t;
+  /// Writes entries sorted by key as a Polyglot file. Throws
+  /// std::runtime_error if the file cannot be written.
+  static void write(std::filesystem::path const &path,
+                    std::vector<entry> entries);
+
+ private:
+  auto key_at(std::size_t index) const -> std::uint64_t;
+  //----------------------------------------------------------------------------
+  mapped_file m_file;
+};
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
@@ -0,0 +1,30 @@
+#pragma once
+//==============================================================================
+#include <chess/position.h>
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+inline constexpr int pawn_value   = 100;
+inline constexpr int knight_value = 320;
+inline constexpr int bishop_value = 330;
+inline constexpr int rook_value   = 500;
+inline constexpr int queen_value  = 900;
+//------------------------------------------------------------------------------
+constexpr auto piece_value(piece_type const t) -> int {
+  switch (t) {
+    case piece_type::pawn:   return pawn_value;
+    case piece_type::knight: return knight_value;
+    case piece_type::bishop: return bishop_value;
+    case piece_type::rook:   return rook_value;
+    case piece_type::queen:  return queen_value;
+    default:                 return 0;
+  }
+}
+//==============================================================================
+/// Handcrafted evaluation: material, piece-square tables and a king table
+/// blended between middlegame and endgame. The score is in centipawns from the
+/// point of view of the side to move.
+auto evaluate(position const &pos) -> int;
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
@@ -0,0 +1,41 @@
+#pragma once
+//==============================================================================
+#include <cstddef>
+#include <filesystem>
+#include <span>
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+/// Read-only memory mapping of a whole file.
+///
+/// The mapping is shared, so every process and every mapped_file of the same
+/// file use the same pages of the page cache and nothing is read before it
+/// is touched.
+class mapped_file {
+ public:
+  mapped_file() = default;
+  /// Throws std::system_error if the file cannot be opened or mapped.
+  explicit mapped_file(std::filesystem::path const &path);
+  mapped_file(mapped_file &&other) noexcept;
+  auto operator=(mapped_file &&other) noexcept -> mapped_file &;
+  mapped_file(mapped_file const &)                    = delete;
+  auto operator=(mapped_file const &) -> mapped_file & = delete;
+  ~mapped_file();
+  //----------------------------------------------------------------------------
+  auto data() const -> std::byte const * { return m_data; }
+  auto size() const { return m_size; }
+  auto bytes() const { return std::span{m_data, m_size}; }
+  auto empty() const { return m_size == 0; }
+
+ private:
+  void unmap();
+  //----------------------------------------------------------------------------
+  std::byte const *m_data = nullptr;
+  std::size_t      m_size = 0;
+#if defined(_WIN32)
+  void *m_mapping = nullptr;
+#endif
+};
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
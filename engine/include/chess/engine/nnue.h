@@ -0,0 +1,149 @@
+#pragma once
+//==============================================================================
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include <chess/move.h>
+#include <chess/position.h>
+
+#include "mapped_file.h"
+//==============================================================================
+/// Efficiently updatable neural network evaluation.
+///
+/// The network has a 768 -> 256x2 -> 1 architecture. Every (piece color,
+/// piece type, square) triple seen from one side is an input feature. The
+/// first layer is kept per side in an accumulator that moves only change by
+/// adding and subtracting a few weight columns, so evaluating a position
+/// costs one clipped dot product over both accumulators instead of a pass
+/// over the board.
+namespace chess::engine::nnue {
+//==============================================================================
+inline constexpr std::size_t feature_count = 768;
+inline constexpr std::size_t hidden_size   = 256;
+/// Accumulator values are clipped to [0, activation_max] before the output
+/// layer, whose weights are scaled by weight_scale.
+inline constexpr int activation_max = 255;
+inline constexpr int weight_scale   = 64;
+/// Centipawns per unit of the network output.
+inline constexpr int output_scale = 400;
+//------------------------------------------------------------------------------
+/// Index of the feature of piece p on sq from the point of view of
+/// perspective. Black sees the board flipped with its pieces as own pieces.
+constexpr auto feature_index(color const perspective, piece const p,
+                             square const sq) -> std::size_t {
+  auto const relative_sq = perspective == color::white ? sq : sq ^ 56;
+  auto const own         = color_of(p) == perspective ? 0 : 6;
+  return 64 * (own + static_cast<std::size_t>(type_of(p))) + relative_sq;
+}
+//==============================================================================
+/// Vector instruction sets the kernels are available for.
+enum class simd : std::uint8_t { scalar, sse41, avx2 };
+/// Best instruction set supported by the running CPU.
+auto detect_simd() -> simd;
+auto to_string(simd level) -> std::string_view;
+//==============================================================================
+/// Network weights mapped read-only from a file, so loading is instant and all
+/// searchers of a process share one copy.
+///
+/// File layout, all values little endian:
+///   header          64 bytes: magic, version, hidden_size, zero padding
+///   feature weights int16[feature_count][hidden_size]
+///   feature biases  int16[hidden_size]
+///   output weights  int16[2 * hidden_size], side to move first
+///   output bias     int32
+class network {
+ public:
+  static constexpr std::uint32_t magic       = 0x4555'4E4E; // "NNUE"
+  static constexpr std::uint32_t version     = 1;
+  static constexpr std::size_t   header_size = 64;
+  static constexpr std::size_t   file_size =
+      header_size + 2 * (feature_count * hidden_size + hidden_size +
+                         2 * hidden_size) +
+      4;
+  //----------------------------------------------------------------------------
+  /// Throws std::system_error if the file cannot be mapped and
+  /// std::runtime_error if it is not a network of this architecture.
+  explicit network(std::filesystem::path const &path);
+  //----------------------------------------------------------------------------
+  auto feature_weights(std::size_t const feature) const
+      -> std::int16_t const * {
+    return m_feature_weights + feature * hidden_size;
+  }
+  auto feature_biases() const { return m_feature_biases; }
+  auto output_weights() const { return m_output_weights; }
+  auto output_bias() const { return m_output_bias; }
+
+ private:
+  mapped_file         m_file;
+  std::int16_t const *m_feature_weights = nullptr;
+  std::int16_t const *m_feature_biases  = nullptr;
+  std::int16_t const *m_output_weights  = nullptr;
+  std::int32_t        m_output_bias     = 0;
+};
+//==============================================================================
+namespace detail {
+/// A move adds and removes at most two features per perspective.
+inline constexpr std::size_t max_changes = 2;
+//------------------------------------------------------------------------------
+/// Weight columns to add to and subtract from the parent accumulator.
+struct feature_changes {
+  std::array<std::int16_t const *, max_changes> added{};
+  std::array<std::int16_t const *, max_changes> removed{};
+  std::size_t                                   added_count   = 0;
+  std::size_t                                   removed_count = 0;
+};
+//------------------------------------------------------------------------------
+/// Kernels of one instruction set. update writes parent + added - removed to
+/// out, which may alias parent. output returns the dot product of the
+/// clipped accumulators with the output weights.
+struct kernels {
+  void (*update)(std::int16_t *out, std::int16_t const *parent,
+                 feature_changes const &changes);
+  auto (*output)(std::int16_t const *us, std::int16_t const *them,
+                 std::int16_t const *weights) -> std::int32_t;
+};
+} // namespace detail
+//==============================================================================
+/// First layer output of one position for both perspectives.
+struct alignas(64) accumulator {
+  std::array<std::array<std::int16_t, hidden_size>, 2> values;
+};
+//==============================================================================
+/// Accumulators of the positions along the path a search is on.
+///
+/// push has to be called with the position before each make_move and pop
+/// after each unmake_move, which makes taking a move back free.
+class evaluator {
+ public:
+  explicit evaluator(network const &net, simd level = detect_simd());
+  //----------------------------------------------------------------------------
+  /// Computes the accumulator of pos from scratch and makes it the only one
+  /// on the stack.
+  void refresh(position const &pos);
+  /// Derives the accumulator after m from the current one, pos is the
+  /// position before m is played.
+  void push(position const &pos, move m);
+  void push_null();
+  void pop() { --m_top; }
+  //----------------------------------------------------------------------------
+  /// Score of pos, whose accumulator has to be the current one, in
+  /// centipawns from the point of view of the side to move.
+  auto evaluate(position const &pos) const -> int;
+  auto current() const -> accumulator const & { return m_stack[m_top]; }
+  auto level() const { return m_level; }
+
+ private:
+  network const           *m_net;
+  simd                     m_level;
+  // Chosen once, updates and evaluations call them without dispatching
+  detail::kernels          m_kernels;
+  std::vector<accumulator> m_stack;
+  std::size_t              m_top = 0;
+};
+//==============================================================================
+} // namespace chess::engine::nnue
+//==============================================================================
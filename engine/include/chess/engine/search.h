@@ -0,0 +1,123 @@
+#pragma once
+//==============================================================================
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <chess/chessboard.h>
+#include <chess/transposition_table.h>
+
+#include "nnue.h"
+#include "thread_budget.h"
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+inline constexpr int max_ply        = 128;
+inline constexpr int mate_score     = 32000;
+inline constexpr int infinite_score = 32001;
+/// Scores at least this far from zero announce a forced mate.
+inline constexpr int mate_in_max_ply = mate_score - max_ply;
+//==============================================================================
+/// Conditions that end a search. Unset limits do not apply, a search without
+/// any limit runs until searcher::stop is called or max_ply is reached. The
+/// first iteration always completes so that a move is available. The node
+/// limit counts the nodes of all threads.
+struct search_limits {
+  std::optional<int>                       depth{};
+  std::optional<std::uint64_t>             nodes{};
+  std::optional<std::chrono::milliseconds> time{};
+  /// Threads to search with, fewer are used if the searcher's thread budget
+  /// is exhausted.
+  std::size_t                              threads = 1;
+};
+//------------------------------------------------------------------------------
+/// Outcome of the deepest completed iteration. score is in centipawns from the
+/// point of view of the side to move.
+struct search_result {
+  move                      best_move{};
+  int                       score = 0;
+  int                       depth = 0;
+  /// Nodes searched by all threads.
+  std::uint64_t             nodes = 0;
+  std::chrono::milliseconds elapsed{0};
+  std::size_t               threads = 1;
+  std::vector<move>         pv;
+};
+//==============================================================================
+/// Iterative deepening principal variation search with aspiration windows,
+/// quiescence search, null move pruning and killer and history move ordering.
+///
+/// Multi-threaded searches use Lazy SMP: helper threads search the same root
+/// independently, half of them one ply deeper, and only cooperate through the
+/// transposition table. The result is the one of the calling thread, which
+/// profits from the entries stored by the helpers.
+///
+/// Positions are evaluated by the network if one is set and by the
+/// handcrafted evaluation otherwise.
+///
+/// The transposition table is shared with other searchers, everything else is
+/// owned by one search call. stop may be called from any thread. Helper
+/// threads are started by the first search that needs them and sleep between
+/// searches until the searcher is destroyed.
+class searcher {
+ public:
+  /// Called after every completed iteration.
+  using info_callback = std::function<void(search_result const &)>;
+  //----------------------------------------------------------------------------
+  /// Without a thread budget every search gets the threads it asks for.
+  explicit searcher(transposition_table &tt, thread_budget *budget = nullptr);
+  searcher(searcher const &)                    = delete;
+  auto operator=(searcher const &) -> searcher & = delete;
+  ~searcher();
+  //----------------------------------------------------------------------------
+  /// Searches board, which is copied, until one of the limits is reached.
+  auto search(chess_board const &board, search_limits const &limits)
+      -> search_result;
+  /// Makes a running search return the result of its last completed
+  /// iteration as soon as possible.
+  void stop() { m_stop.store(true, std::memory_order_relaxed); }
+  void set_info_callback(info_callback callback) {
+    m_on_info = std::move(callback);
+  }
+  /// Takes effect with the next search. Clear the transposition table when
+  /// switching evaluations, it keeps static evaluations of the old one.
+  void set_network(std::shared_ptr<nnue::network const> network) {
+    m_network = std::move(network);
+  }
+
+ private:
+  /// Runs job(0) to job(count - 1) on parked helpers and waits for them.
+  /// job has to return once the search is stopped.
+  void run_helpers(std::size_t count,
+                   std::function<void(std::size_t)> const &job);
+  /// Loop of helper index, which sleeps while there is no job for it.
+  void park(std::size_t index, std::uint64_t generation);
+  //----------------------------------------------------------------------------
+  transposition_table                 *m_tt;
+  thread_budget                       *m_budget;
+  std::atomic<bool>                    m_stop{false};
+  info_callback                        m_on_info;
+  std::shared_ptr<nnue::network const> m_network;
+  // Helper threads and their current job, guarded by m_pool_mutex. A new
+  // generation wakes the first m_active helpers.
+  std::vector<std::thread>                m_helpers;
+  std::mutex                              m_pool_mutex;
+  std::condition_variable                 m_wake;
+  std::condition_variable                 m_done;
+  std::function<void(std::size_t)> const *m_job        = nullptr;
+  std::size_t                             m_active     = 0;
+  std::size_t                             m_running    = 0;
+  std::uint64_t                           m_generation = 0;
+  bool                                    m_quit       = false;
+};
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
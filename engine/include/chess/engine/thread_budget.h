@@ -0,0 +1,86 @@
+#pragma once
+//==============================================================================
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+/// Number of search threads all concurrent searches of a process may use
+/// together, so that many small searches and a few large ones can share the
+/// cores of a machine.
+///
+/// A search leases threads for its duration. The thread calling search is
+/// counted as well but never refused, a search that gets no threads from an
+/// exhausted budget still runs single-threaded.
+class thread_budget {
+ public:
+  class lease {
+   public:
+    lease() = default;
+    lease(lease &&other) noexcept
+        : m_budget{std::exchange(other.m_budget, nullptr)},
+          m_reserved{std::exchange(other.m_reserved, 0)} {}
+    auto operator=(lease &&other) noexcept -> lease & {
+      if (this != &other) {
+        release();
+        m_budget   = std::exchange(other.m_budget, nullptr);
+        m_reserved = std::exchange(other.m_reserved, 0);
+      }
+      return *this;
+    }
+    ~lease() { release(); }
+    //--------------------------------------------------------------------------
+    /// Threads the search may run, including the calling one.
+    auto threads() const { return std::max<std::size_t>(m_reserved, 1); }
+
+   private:
+    friend class thread_budget;
+    lease(thread_budget &budget, std::size_t const reserved)
+        : m_budget{&budget}, m_reserved{reserved} {}
+    void release() {
+      if (m_budget != nullptr && m_reserved != 0) {
+        m_budget->m_available.fetch_add(m_reserved, std::memory_order_relaxed);
+      }
+      m_budget = nullptr;
+    }
+    //--------------------------------------------------------------------------
+    thread_budget *m_budget   = nullptr;
+    std::size_t    m_reserved = 0;
+  };
+  //----------------------------------------------------------------------------
+  explicit thread_budget(
+      std::size_t const threads = std::max(std::thread::hardware_concurrency(),
+                                           1U))
+      : m_capacity{threads}, m_available{threads} {}
+  thread_budget(thread_budget const &)                    = delete;
+  auto operator=(thread_budget const &) -> thread_budget & = delete;
+  //----------------------------------------------------------------------------
+  /// Reserves up to wanted threads. Outstanding leases must not outlive the
+  /// budget.
+  auto acquire(std::size_t const wanted) -> lease {
+    auto available = m_available.load(std::memory_order_relaxed);
+    auto reserved  = std::size_t{0};
+    do {
+      reserved = std::min(wanted, available);
+    } while (reserved != 0 &&
+             !m_available.compare_exchange_weak(available,
+                                                available - reserved,
+                                                std::memory_order_relaxed));
+    return lease{*this, reserved};
+  }
+  //----------------------------------------------------------------------------
+  auto capacity() const { return m_capacity; }
+  auto available() const {
+    return m_available.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::size_t              m_capacity;
+  std::atomic<std::size_t> m_available;
+};
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
@@ -0,0 +1,136 @@
+#include "chess/engine/book.h"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+#include <chess/movegen.h>
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+template <typename T>
+auto read_big_endian(std::byte const *const data) -> T {
+  auto value = T{0};
+  for (auto i = std::size_t{0}; i < sizeof(T); ++i) {
+    value = static_cast<T>(value << 8 | static_cast<T>(data[i]));
+  }
+  return value;
+}
+//------------------------------------------------------------------------------
+template <typename T>
+void write_big_endian(std::ostream &out, T const value) {
+  for (auto i = sizeof(T); i > 0; --i) {
+    out.put(static_cast<char>((value >> (8 * (i - 1))) & 0xFF));
+  }
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+polyglot_book::polyglot_book(std::filesystem::path const &path)
+    : m_file{path} {
+  if (m_file.size() % entry_size != 0) {
+    throw std::runtime_error{path.string() + " is not a Polyglot book"};
+  }
+}
+//------------------------------------------------------------------------------
+auto polyglot_book::key_at(std::size_t const index) const -> std::uint64_t {
+  return read_big_endian<std::uint64_t>(m_file.data() + index * entry_size);
+}
+//------------------------------------------------------------------------------
+auto polyglot_book::probe(position const &pos) const -> std::vector<book_move> {
+  auto const key = pos.key();
+  // first entry whose key is not less than key
+  auto first = std::size_t{0};
+  auto count = size();
+  while (count > 0) {
+    auto const half = count / 2;
+    if (key_at(first + half) < key) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+
+  auto found = std::vector<book_move>{};
+  if (first == size() || key_at(first) != key) {
+    return found;
+  }
+  auto legal = move_list{};
+  generate_legal_moves(pos, legal);
+  for (auto i = first; i < size() && key_at(i) == key; ++i) {
+    auto const *const e      = m_file.data() + i * entry_size;
+    auto const        raw    = read_big_endian<std::uint16_t>(e + 8);
+    auto const        weight = read_big_endian<std::uint16_t>(e + 10);
+    // entries of colliding positions or broken books may not be legal here
+    auto const m = std::ranges::find_if(
+        legal, [raw](move const m) { return encode_move(m) == raw; });
+    if (m != legal.end()) {
+      found.push_back({*m, weight});
+    }
+  }
+  return found;
+}
+//------------------------------------------------------------------------------
+auto polyglot_book::pick(position const &pos, int const ply,
+                         book_settings const &settings,
+                         std::mt19937_64     &rng) const -> move {
+  if (ply >= settings.max_ply) {
+    return move{};
+  }
+  auto candidates = probe(pos);
+  std::erase_if(candidates, [&settings](book_move const &b) {
+    return b.weight < settings.min_weight || b.weight == 0;
+  });
+  if (candidates.empty()) {
+    return move{};
+  }
+  if (!settings.weighted_random) {
+    return std::ranges::max(candidates, {}, &book_move::weight).m;
+  }
+  auto const total = std::accumulate(
+      candidates.begin(), candidates.end(), std::uint64_t{0},
+      [](std::uint64_t const sum, book_move const &b) { return sum + b.weight; });
+  auto pick = std::uniform_int_distribution<std::uint64_t>{0, total - 1}(rng);
+  for (auto const &b : candidates) {
+    if (pick < b.weight) {
+      return b.m;
+    }
+    pick -= b.weight;
+  }
+  return candidates.back().m;
+}
+//------------------------------------------------------------------------------
+auto polyglot_book::encode_move(move const m) -> std::uint16_t {
+  auto to = m.to();
+  if (m.is_castling()) {
+    to = make_square(rank_of(m.from()),
+                     m.get_flag() == move::flag::king_castle ? 7 : 0);
+  }
+  auto const promotion =
+      m.is_promotion() ? static_cast<unsigned>(m.promotion_type()) : 0U;
+  return static_cast<std::uint16_t>(
+      file_of(to) | rank_of(to) << 3 | file_of(m.from()) << 6 |
+      rank_of(m.from()) << 9 | promotion << 12);
+}
+//------------------------------------------------------------------------------
+void polyglot_book::write(std::filesystem::path const &path,
+                          std::vector<entry>           entries) {
+  std::ranges::stable_sort(entries, {}, &entry::key);
+  auto out = std::ofstream{path, std::ios::binary};
+  for (auto const &e : entries) {
+    write_big_endian(out, e.key);
+    write_big_endian(out, encode_move(e.m.m));
+    write_big_endian(out, e.m.weight);
+    write_big_endian(out, std::uint32_t{0});
+  }
+  if (!out) {
+    throw std::runtime_error{"cannot write " + path.string()};
+  }
+}
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
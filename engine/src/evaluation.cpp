@@ -0,0 +1,124 @@
+#include "chess/engine/evaluation.h"
+
+#include <algorithm>
+#include <array>
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+using table = std::array<int, 64>;
+// Tables are written as seen from white with rank 8 in the first row, so a
+// white piece on sq uses entry sq ^ 56 and a black piece entry sq.
+// clang-format off
+constexpr auto pawn_table = table{
+   0,  0,  0,  0,  0,  0,  0,  0,
+  50, 50, 50, 50, 50, 50, 50, 50,
+  10, 10, 20, 30, 30, 20, 10, 10,
+   5,  5, 10, 25, 25, 10,  5,  5,
+   0,  0,  0, 20, 20,  0,  0,  0,
+   5, -5,-10,  0,  0,-10, -5,  5,
+   5, 10, 10,-20,-20, 10, 10,  5,
+   0,  0,  0,  0,  0,  0,  0,  0};
+constexpr auto knight_table = table{
+ -50,-40,-30,-30,-30,-30,-40,-50,
+ -40,-20,  0,  0,  0,  0,-20,-40,
+ -30,  0, 10, 15, 15, 10,  0,-30,
+ -30,  5, 15, 20, 20, 15,  5,-30,
+ -30,  0, 15, 20, 20, 15,  0,-30,
+ -30,  5, 10, 15, 15, 10,  5,-30,
+ -40,-20,  0,  5,  5,  0,-20,-40,
+ -50,-40,-30,-30,-30,-30,-40,-50};
+constexpr auto bishop_table = table{
+ -20,-10,-10,-10,-10,-10,-10,-20,
+ -10,  0,  0,  0,  0,  0,  0,-10,
+ -10,  0,  5, 10, 10,  5,  0,-10,
+ -10,  5,  5, 10, 10,  5,  5,-10,
+ -10,  0, 10, 10, 10, 10,  0,-10,
+ -10, 10, 10, 10, 10, 10, 10,-10,
+ -10,  5,  0,  0,  0,  0,  5,-10,
+ -20,-10,-10,-10,-10,-10,-10,-20};
+constexpr auto rook_table = table{
+   0,  0,  0,  0,  0,  0,  0,  0,
+   5, 10, 10, 10, 10, 10, 10,  5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+   0,  0,  0,  5,  5,  0,  0,  0};
+constexpr auto queen_table = table{
+ -20,-10,-10, -5, -5,-10,-10,-20,
+ -10,  0,  0,  0,  0,  0,  0,-10,
+ -10,  0,  5,  5,  5,  5,  0,-10,
+  -5,  0,  5,  5,  5,  5,  0, -5,
+   0,  0,  5,  5,  5,  5,  0, -5,
+ -10,  5,  5,  5,  5,  5,  0,-10,
+ -10,  0,  5,  0,  0,  0,  0,-10,
+ -20,-10,-10, -5, -5,-10,-10,-20};
+constexpr auto king_middlegame_table = table{
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -20,-30,-30,-40,-40,-30,-30,-20,
+ -10,-20,-20,-20,-20,-20,-20,-10,
+  20, 20,  0,  0,  0,  0, 20, 20,
+  20, 30, 10,  0,  0, 10, 30, 20};
+constexpr auto king_endgame_table = table{
+ -50,-40,-30,-20,-20,-30,-40,-50,
+ -30,-20,-10,  0,  0,-10,-20,-30,
+ -30,-10, 20, 30, 30, 20,-10,-30,
+ -30,-10, 30, 40, 40, 30,-10,-30,
+ -30,-10, 30, 40, 40, 30,-10,-30,
+ -30,-10, 20, 30, 30, 20,-10,-30,
+ -30,-30,  0,  0,  0,  0,-30,-30,
+ -50,-30,-30,-30,-30,-30,-30,-50};
+// clang-format on
+constexpr auto tables =
+    std::array{pawn_table, knight_table, bishop_table, rook_table, queen_table};
+//------------------------------------------------------------------------------
+/// Game phase weight of knights, bishops, rooks and queens, 24 with all
+/// pieces on the board.
+constexpr auto phase_weights = std::array{0, 1, 1, 2, 4};
+constexpr auto max_phase     = 24;
+constexpr auto bishop_pair   = 30;
+constexpr auto tempo         = 10;
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+auto evaluate(position const &pos) -> int {
+  auto score = std::array{0, 0};
+  auto phase = 0;
+  for (auto const c : {color::white, color::black}) {
+    auto const flip = c == color::white ? 56 : 0;
+    auto      &s    = score[static_cast<std::size_t>(c)];
+    for (auto t = std::size_t{0}; t < tables.size(); ++t) {
+      auto pieces = pos.pieces(c, static_cast<piece_type>(t));
+      phase += phase_weights[t] * popcount(pieces);
+      s += piece_value(static_cast<piece_type>(t)) * popcount(pieces);
+      while (pieces != 0) {
+        s += tables[t][pop_lsb(pieces) ^ flip];
+      }
+    }
+    if (more_than_one(pos.pieces(c, piece_type::bishop))) {
+      s += bishop_pair;
+    }
+  }
+  phase = std::min(phase, max_phase);
+
+  auto king = std::array{0, 0};
+  for (auto const c : {color::white, color::black}) {
+    auto const sq = pos.king_square(c) ^ (c == color::white ? 56 : 0);
+    king[static_cast<std::size_t>(c)] =
+        (king_middlegame_table[sq] * phase +
+         king_endgame_table[sq] * (max_phase - phase)) /
+        max_phase;
+  }
+
+  auto const white = score[0] + king[0] - score[1] - king[1];
+  return (pos.side_to_move() == color::white ? white : -white) + tempo;
+}
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
@@ -0,0 +1,134 @@
+#include "chess/engine/mapped_file.h"
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+#if defined(_WIN32)
+//------------------------------------------------------------------------------
+mapped_file::mapped_file(std::filesystem::path const &path) {
+  auto const fail = [&path] {
+    throw std::system_error{static_cast<int>(GetLastError()),
+                            std::system_category(),
+                            "cannot map " + path.string()};
+  };
+  auto const file =
+      CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                  OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    fail();
+  }
+  auto size = LARGE_INTEGER{};
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    fail();
+  }
+  m_size = static_cast<std::size_t>(size.QuadPart);
+  if (m_size == 0) {
+    CloseHandle(file);
+    return;
+  }
+  m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (m_mapping == nullptr) {
+    fail();
+  }
+  m_data = static_cast<std::byte const *>(
+      MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+    fail();
+  }
+}
+//------------------------------------------------------------------------------
+void mapped_file::unmap() {
+  if (m_data != nullptr) {
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+  }
+  m_data    = nullptr;
+  m_mapping = nullptr;
+  m_size    = 0;
+}
+//------------------------------------------------------------------------------
+#else
+//------------------------------------------------------------------------------
+mapped_file::mapped_file(std::filesystem::path const &path) {
+  auto const fail = [&path] {
+    throw std::system_error{errno, std::generic_category(),
+                            "cannot map " + path.string()};
+  };
+  auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fail();
+  }
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    fail();
+  }
+  m_size = static_cast<std::size_t>(info.st_size);
+  if (m_size == 0) {
+    ::close(fd);
+    return;
+  }
+  auto *const data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping keeps the file alive on its own
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    m_size = 0;
+    fail();
+  }
+  m_data = static_cast<std::byte const *>(data);
+}
+//------------------------------------------------------------------------------
+void mapped_file::unmap() {
+  if (m_data != nullptr) {
+    ::munmap(const_cast<std::byte *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+//------------------------------------------------------------------------------
+#endif
+//==============================================================================
+mapped_file::mapped_file(mapped_file &&other) noexcept
+    : m_data{std::exchange(other.m_data, nullptr)},
+      m_size{std::exchange(other.m_size, 0)}
+#if defined(_WIN32)
+      ,
+      m_mapping{std::exchange(other.m_mapping, nullptr)}
+#endif
+{
+}
+//------------------------------------------------------------------------------
+auto mapped_file::operator=(mapped_file &&other) noexcept -> mapped_file & {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+#if defined(_WIN32)
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+  }
+  return *this;
+}
+//------------------------------------------------------------------------------
+mapped_file::~mapped_file() { unmap(); }
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
@@ -0,0 +1,297 @@
+#include "chess/engine/nnue.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define CHESS_NNUE_X86 1
+#include <immintrin.h>
+#endif
+//==============================================================================
+namespace chess::engine::nnue {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+using detail::feature_changes;
+using detail::kernels;
+using detail::max_changes;
+//==============================================================================
+void update_scalar(std::int16_t *const out, std::int16_t const *const parent,
+                   feature_changes const &changes) {
+  for (auto i = std::size_t{0}; i < hidden_size; ++i) {
+    auto v = parent[i];
+    for (auto a = std::size_t{0}; a < changes.added_count; ++a) {
+      v = static_cast<std::int16_t>(v + changes.added[a][i]);
+    }
+    for (auto r = std::size_t{0}; r < changes.removed_count; ++r) {
+      v = static_cast<std::int16_t>(v - changes.removed[r][i]);
+    }
+    out[i] = v;
+  }
+}
+//------------------------------------------------------------------------------
+auto output_scalar(std::int16_t const *const us, std::int16_t const *const them,
+                   std::int16_t const *const weights) -> std::int32_t {
+  auto sum = std::int32_t{0};
+  for (auto i = std::size_t{0}; i < hidden_size; ++i) {
+    sum += std::clamp<std::int32_t>(us[i], 0, activation_max) * weights[i];
+    sum += std::clamp<std::int32_t>(them[i], 0, activation_max) *
+           weights[hidden_size + i];
+  }
+  return sum;
+}
+//==============================================================================
+#if defined(CHESS_NNUE_X86)
+//------------------------------------------------------------------------------
+// The vector kernels are compiled for their instruction set only, the rest of
+// the binary keeps running on any x86 CPU. Loads are unaligned because
+// mapped weights are only guaranteed to be 2 byte aligned.
+__attribute__((target("sse4.1"))) void
+update_sse41(std::int16_t *const out, std::int16_t const *const parent,
+             feature_changes const &changes) {
+  for (auto i = std::size_t{0}; i < hidden_size; i += 8) {
+    auto v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(parent + i));
+    for (auto a = std::size_t{0}; a < changes.added_count; ++a) {
+      v = _mm_add_epi16(v, _mm_loadu_si128(reinterpret_cast<__m128i const *>(
+                               changes.added[a] + i)));
+    }
+    for (auto r = std::size_t{0}; r < changes.removed_count; ++r) {
+      v = _mm_sub_epi16(v, _mm_loadu_si128(reinterpret_cast<__m128i const *>(
+                               changes.removed[r] + i)));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+  }
+}
+//------------------------------------------------------------------------------
+__attribute__((target("sse4.1"))) auto
+output_sse41(std::int16_t const *const us, std::int16_t const *const them,
+             std::int16_t const *const weights) -> std::int32_t {
+  auto const zero = _mm_setzero_si128();
+  auto const max  = _mm_set1_epi16(activation_max);
+  auto       sum  = _mm_setzero_si128();
+  // lambdas would not inherit the target of the function
+  for (auto const &[acc, w] : {std::pair{us, weights},
+                               std::pair{them, weights + hidden_size}}) {
+    for (auto i = std::size_t{0}; i < hidden_size; i += 8) {
+      auto const a =
+          _mm_loadu_si128(reinterpret_cast<__m128i const *>(acc + i));
+      auto const b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(w + i));
+      auto const v = _mm_min_epi16(_mm_max_epi16(a, zero), max);
+      sum          = _mm_add_epi32(sum, _mm_madd_epi16(v, b));
+    }
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+  return _mm_cvtsi128_si32(sum);
+}
+//------------------------------------------------------------------------------
+__attribute__((target("avx2"))) void
+update_avx2(std::int16_t *const out, std::int16_t const *const parent,
+            feature_changes const &changes) {
+  for (auto i = std::size_t{0}; i < hidden_size; i += 16) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(parent + i));
+    for (auto a = std::size_t{0}; a < changes.added_count; ++a) {
+      v = _mm256_add_epi16(v,
+                           _mm256_loadu_si256(reinterpret_cast<__m256i const *>(
+                               changes.added[a] + i)));
+    }
+    for (auto r = std::size_t{0}; r < changes.removed_count; ++r) {
+      v = _mm256_sub_epi16(v,
+                           _mm256_loadu_si256(reinterpret_cast<__m256i const *>(
+                               changes.removed[r] + i)));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+  }
+}
+//------------------------------------------------------------------------------
+__attribute__((target("avx2"))) auto
+output_avx2(std::int16_t const *const us, std::int16_t const *const them,
+            std::int16_t const *const weights) -> std::int32_t {
+  auto const zero = _mm256_setzero_si256();
+  auto const max  = _mm256_set1_epi16(activation_max);
+  auto       sum  = _mm256_setzero_si256();
+  // lambdas would not inherit the target of the function
+  for (auto const &[acc, w] : {std::pair{us, weights},
+                               std::pair{them, weights + hidden_size}}) {
+    for (auto i = std::size_t{0}; i < hidden_size; i += 16) {
+      auto const a =
+          _mm256_loadu_si256(reinterpret_cast<__m256i const *>(acc + i));
+      auto const b =
+          _mm256_loadu_si256(reinterpret_cast<__m256i const *>(w + i));
+      auto const v = _mm256_min_epi16(_mm256_max_epi16(a, zero), max);
+      sum          = _mm256_add_epi32(sum, _mm256_madd_epi16(v, b));
+    }
+  }
+  auto half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                            _mm256_extracti128_si256(sum, 1));
+  half      = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+  half      = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+  return _mm_cvtsi128_si32(half);
+}
+//------------------------------------------------------------------------------
+#endif
+//==============================================================================
+auto kernels_for(simd const level) -> kernels {
+  switch (level) {
+#if defined(CHESS_NNUE_X86)
+    case simd::avx2:  return {update_avx2, output_avx2};
+    case simd::sse41: return {update_sse41, output_sse41};
+#endif
+    default:          return {update_scalar, output_scalar};
+  }
+}
+//------------------------------------------------------------------------------
+template <typename T>
+auto read_little_endian(std::byte const *const data) -> T {
+  auto value = T{};
+  std::memcpy(&value, data, sizeof(T));
+  return value;
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+auto detect_simd() -> simd {
+#if defined(CHESS_NNUE_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return simd::avx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return simd::sse41;
+  }
+#endif
+  return simd::scalar;
+}
+//------------------------------------------------------------------------------
+auto to_string(simd const level) -> std::string_view {
+  switch (level) {
+    case simd::avx2:  return "avx2";
+    case simd::sse41: return "sse4.1";
+    default:          return "scalar";
+  }
+}
+//==============================================================================
+network::network(std::filesystem::path const &path) : m_file{path} {
+  if constexpr (std::endian::native != std::endian::little) {
+    throw std::runtime_error{"networks can only be used on little endian "
+                             "machines"};
+  }
+  auto const *const data = m_file.data();
+  if (m_file.size() != file_size ||
+      read_little_endian<std::uint32_t>(data) != magic ||
+      read_little_endian<std::uint32_t>(data + 4) != version ||
+      read_little_endian<std::uint32_t>(data + 8) != hidden_size) {
+    throw std::runtime_error{path.string() +
+                             " is not a network of this architecture"};
+  }
+  // the mapping is page aligned and every section starts at an even offset
+  m_feature_weights =
+      reinterpret_cast<std::int16_t const *>(data + header_size);
+  m_feature_biases = m_feature_weights + feature_count * hidden_size;
+  m_output_weights = m_feature_biases + hidden_size;
+  m_output_bias    = read_little_endian<std::int32_t>(
+      reinterpret_cast<std::byte const *>(m_output_weights + 2 * hidden_size));
+}
+//==============================================================================
+evaluator::evaluator(network const &net, simd const level)
+    : m_net{&net},
+      m_level{std::min(level, detect_simd())},
+      m_kernels{kernels_for(m_level)},
+      m_stack(256) {}
+//------------------------------------------------------------------------------
+void evaluator::refresh(position const &pos) {
+  auto &acc = m_stack[0];
+  m_top          = 0;
+  for (auto const perspective : {color::white, color::black}) {
+    auto *const out = acc.values[static_cast<std::size_t>(perspective)].data();
+    std::copy_n(m_net->feature_biases(), hidden_size, out);
+    auto occupied = pos.occupied();
+    while (occupied != 0) {
+      auto const sq      = pop_lsb(occupied);
+      auto       changes = feature_changes{};
+      changes.added[changes.added_count++] = m_net->feature_weights(
+          feature_index(perspective, pos.piece_at(sq), sq));
+      m_kernels.update(out, out, changes);
+    }
+  }
+}
+//------------------------------------------------------------------------------
+void evaluator::push(position const &pos, move const m) {
+  if (m_top + 1 == m_stack.size()) {
+    m_stack.resize(2 * m_stack.size());
+  }
+  auto const us     = pos.side_to_move();
+  auto const moved  = pos.piece_at(m.from());
+  auto const placed = m.is_promotion() ? make_piece(us, m.promotion_type())
+                                       : moved;
+
+  // features as (piece, square) pairs, translated per perspective below
+  struct change {
+    piece  p;
+    square sq;
+  };
+  auto added     = std::array<change, max_changes>{};
+  auto removed   = std::array<change, max_changes>{};
+  auto n_added   = std::size_t{0};
+  auto n_removed = std::size_t{0};
+  removed[n_removed++] = {moved, m.from()};
+  added[n_added++]     = {placed, m.to()};
+  if (m.is_en_passant()) {
+    auto const captured =
+        static_cast<square>(us == color::white ? m.to() - 8 : m.to() + 8);
+    removed[n_removed++] = {make_piece(~us, piece_type::pawn), captured};
+  } else if (m.is_capture()) {
+    removed[n_removed++] = {pos.piece_at(m.to()), m.to()};
+  } else if (m.is_castling()) {
+    auto const king_side = m.get_flag() == move::flag::king_castle;
+    auto const rank      = rank_of(m.from());
+    auto const rook      = make_piece(us, piece_type::rook);
+    removed[n_removed++] = {rook, make_square(rank, king_side ? 7 : 0)};
+    added[n_added++]     = {rook, make_square(rank, king_side ? 5 : 3)};
+  }
+
+  auto const &parent = m_stack[m_top];
+  auto       &child  = m_stack[++m_top];
+  for (auto const perspective : {color::white, color::black}) {
+    auto changes          = feature_changes{};
+    changes.added_count   = n_added;
+    changes.removed_count = n_removed;
+    for (auto i = std::size_t{0}; i < n_added; ++i) {
+      changes.added[i] = m_net->feature_weights(
+          feature_index(perspective, added[i].p, added[i].sq));
+    }
+    for (auto i = std::size_t{0}; i < n_removed; ++i) {
+      changes.removed[i] = m_net->feature_weights(
+          feature_index(perspective, removed[i].p, removed[i].sq));
+    }
+    auto const side = static_cast<std::size_t>(perspective);
+    m_kernels.update(child.values[side].data(), parent.values[side].data(),
+                     changes);
+  }
+}
+//------------------------------------------------------------------------------
+void evaluator::push_null() {
+  if (m_top + 1 == m_stack.size()) {
+    m_stack.resize(2 * m_stack.size());
+  }
+  m_stack[m_top + 1] = m_stack[m_top];
+  ++m_top;
+}
+//------------------------------------------------------------------------------
+auto evaluator::evaluate(position const &pos) const -> int {
+  auto const &acc = m_stack[m_top];
+  auto const  us  = static_cast<std::size_t>(pos.side_to_move());
+  auto const  sum = m_kernels.output(acc.values[us].data(),
+                                     acc.values[us ^ 1].data(),
+                                     m_net->output_weights());
+  return static_cast<int>(
+      (static_cast<std::int64_t>(sum) + m_net->output_bias()) * output_scale /
+      (activation_max * weight_scale));
+}
+//==============================================================================
+} // namespace chess::engine::nnue
+//==============================================================================
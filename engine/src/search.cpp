@@ -0,0 +1,588 @@
+#include "chess/engine/search.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <thread>
+
+#include <chess/movegen.h>
+
+#include "chess/engine/evaluation.h"
+//==============================================================================
+namespace chess::engine {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+using clock       = std::chrono::steady_clock;
+using move_scores = std::array<int, move_list::capacity>;
+//------------------------------------------------------------------------------
+constexpr auto aspiration_min_depth = 4;
+constexpr auto aspiration_window    = 25;
+/// The clock is read once per this many nodes.
+constexpr auto time_check_interval = std::uint64_t{1024};
+//------------------------------------------------------------------------------
+// move ordering buckets, history scores stay below killer_bonus
+constexpr auto tt_move_bonus = 1 << 30;
+constexpr auto capture_bonus = 1 << 28;
+constexpr auto killer_bonus  = 1 << 26;
+constexpr auto history_limit = 1 << 24;
+//------------------------------------------------------------------------------
+/// Mate scores are stored relative to the position instead of the root.
+constexpr auto score_to_tt(int const score, int const ply) -> std::int16_t {
+  if (score >= mate_in_max_ply) {
+    return static_cast<std::int16_t>(score + ply);
+  }
+  if (score <= -mate_in_max_ply) {
+    return static_cast<std::int16_t>(score - ply);
+  }
+  return static_cast<std::int16_t>(score);
+}
+constexpr auto score_from_tt(int const score, int const ply) -> int {
+  if (score >= mate_in_max_ply) {
+    return score - ply;
+  }
+  if (score <= -mate_in_max_ply) {
+    return score + ply;
+  }
+  return score;
+}
+//------------------------------------------------------------------------------
+auto captured_type(position const &pos, move const m) -> piece_type {
+  return m.is_en_passant() ? piece_type::pawn
+                           : type_of(pos.piece_at(m.to()));
+}
+//------------------------------------------------------------------------------
+/// Null moves are unsound in pawn endings where zugzwang is common.
+auto has_non_pawn_material(position const &pos, color const c) -> bool {
+  return (pos.pieces(c) & ~pos.pieces(c, piece_type::pawn) &
+          ~pos.pieces(c, piece_type::king)) != 0;
+}
+//==============================================================================
+/// Everything the threads of one search have in common.
+struct shared_state {
+  transposition_table       &tt;
+  search_limits const       &limits;
+  std::atomic<bool> const   &stop;
+  nnue::network const       *network;
+  clock::time_point          start = clock::now();
+  /// Nodes of all threads, each thread adds its count in batches.
+  std::atomic<std::uint64_t> nodes{0};
+};
+//==============================================================================
+/// State of one search thread over a private copy of the board. Worker 0 is
+/// the main thread that manages time and reports results, the others are
+/// helpers that only fill the transposition table until they are stopped.
+class worker {
+ public:
+  worker(chess_board const &board, shared_state &shared, std::size_t const id)
+      : m_board{board}, m_shared{shared}, m_tt{shared.tt},
+        m_limits{shared.limits}, m_id{id} {
+    m_board.reserve_history(max_ply);
+    if (shared.network != nullptr) {
+      m_nnue.emplace(*shared.network);
+      m_nnue->refresh(m_board.get_position());
+    }
+  }
+  //----------------------------------------------------------------------------
+  auto run(searcher::info_callback const &on_info) -> search_result {
+    auto       result    = search_result{};
+    auto const max_depth = std::min(m_limits.depth.value_or(max_ply - 1),
+                                    max_ply - 1);
+    for (m_depth = 1; m_depth <= max_depth; ++m_depth) {
+      auto const score = aspiration_search(m_depth, result.score);
+      if (m_aborted) {
+        break;
+      }
+      result.depth     = m_depth;
+      result.score     = score;
+      result.pv        = {m_pv[0].begin(), m_pv[0].begin() + m_pv_length[0]};
+      result.best_move = result.pv.empty() ? move{} : result.pv.front();
+      result.nodes     = total_nodes();
+      result.elapsed   = elapsed();
+      if (on_info) {
+        on_info(result);
+      }
+      // deeper iterations cannot find a shorter mate than one within depth
+      auto const mate_found = std::abs(score) >= mate_in_max_ply &&
+                              mate_score - std::abs(score) <= m_depth;
+      if (result.best_move.is_null() || mate_found ||
+          stop_before_iteration()) {
+        break;
+      }
+    }
+    finish();
+    result.elapsed = elapsed();
+    return result;
+  }
+  //----------------------------------------------------------------------------
+  /// Searches with increasing depth until the main thread is done. Every
+  /// other helper starts one ply deeper so that the threads spread over
+  /// different depths instead of duplicating each other's work.
+  void run_helper() {
+    auto       score     = 0;
+    auto const max_depth = std::min(m_limits.depth.value_or(max_ply - 1),
+                                    max_ply - 1);
+    for (m_depth = 1 + static_cast<int>(m_id % 2); m_depth <= max_depth;
+         ++m_depth) {
+      auto const result = aspiration_search(m_depth, score);
+      if (m_aborted) {
+        break;
+      }
+      score = result;
+    }
+    finish();
+  }
+
+ private:
+  //----------------------------------------------------------------------------
+  auto elapsed() const -> std::chrono::milliseconds {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        clock::now() - m_shared.start);
+  }
+  //----------------------------------------------------------------------------
+  auto total_nodes() const -> std::uint64_t {
+    return m_shared.nodes.load(std::memory_order_relaxed) + m_nodes -
+           m_flushed_nodes;
+  }
+  void flush_nodes() {
+    m_shared.nodes.fetch_add(m_nodes - m_flushed_nodes,
+                             std::memory_order_relaxed);
+    m_flushed_nodes = m_nodes;
+  }
+  void finish() {
+    flush_nodes();
+    m_tt.add_counters(m_counters);
+  }
+  //----------------------------------------------------------------------------
+  /// An iteration usually takes longer than all previous ones together, so
+  /// starting one after half of the time is spent would most likely waste it.
+  auto stop_before_iteration() const -> bool {
+    return m_shared.stop.load(std::memory_order_relaxed) ||
+           (m_limits.time && elapsed() * 2 >= *m_limits.time) ||
+           (m_limits.nodes && total_nodes() >= *m_limits.nodes);
+  }
+  //----------------------------------------------------------------------------
+  auto should_abort() -> bool {
+    if (m_aborted) {
+      return true;
+    }
+    // the first iteration of the main thread always finishes so that there
+    // is a move to play
+    if (m_id == 0 && m_depth == 1) {
+      return false;
+    }
+    if (m_limits.nodes && total_nodes() >= *m_limits.nodes) {
+      m_aborted = true;
+    } else if ((m_nodes % time_check_interval) == 0) {
+      flush_nodes();
+      m_aborted = m_shared.stop.load(std::memory_order_relaxed) ||
+                  (m_id == 0 && m_limits.time && elapsed() >= *m_limits.time);
+    }
+    return m_aborted;
+  }
+  //----------------------------------------------------------------------------
+  // the network's accumulators follow every move made on the board
+  void play(move const m) {
+    if (m_nnue) {
+      m_nnue->push(m_board.get_position(), m);
+    }
+    m_board.make_move(m);
+  }
+  void play_null() {
+    if (m_nnue) {
+      m_nnue->push_null();
+    }
+    m_board.make_null_move();
+  }
+  void take_back() {
+    if (m_nnue) {
+      m_nnue->pop();
+    }
+    m_board.unmake_move();
+  }
+  auto static_evaluation() const -> int {
+    auto const &pos = m_board.get_position();
+    return m_nnue ? m_nnue->evaluate(pos) : evaluate(pos);
+  }
+  //----------------------------------------------------------------------------
+  auto aspiration_search(int const depth, int const previous) -> int {
+    if (depth < aspiration_min_depth) {
+      return search(-infinite_score, infinite_score, depth, 0, true);
+    }
+    auto delta = aspiration_window;
+    auto alpha = std::max(previous - delta, -infinite_score);
+    auto beta  = std::min(previous + delta, infinite_score);
+    while (true) {
+      auto const score = search(alpha, beta, depth, 0, true);
+      if (m_aborted) {
+        return score;
+      }
+      if (score <= alpha) {
+        alpha = std::max(score - delta, -infinite_score);
+      } else if (score >= beta) {
+        beta = std::min(score + delta, infinite_score);
+      } else {
+        return score;
+      }
+      delta *= 2;
+    }
+  }
+  //----------------------------------------------------------------------------
+  void score_moves(move_list const &moves, move_scores &scores,
+                   move const tt_move, int const ply) const {
+    auto const &pos  = m_board.get_position();
+    auto const  side = static_cast<std::size_t>(pos.side_to_move());
+    for (auto i = std::size_t{0}; i < moves.size(); ++i) {
+      auto const m = moves[i];
+      if (m == tt_move) {
+        scores[i] = tt_move_bonus;
+      } else if (m.is_capture() || m.is_promotion()) {
+        // most valuable victim, least valuable attacker
+        auto const victim =
+            m.is_capture() ? piece_value(captured_type(pos, m)) : 0;
+        auto const promotion =
+            m.is_promotion() ? piece_value(m.promotion_type()) : 0;
+        scores[i] = capture_bonus + 16 * (victim + promotion) -
+                    static_cast<int>(type_of(pos.piece_at(m.from())));
+      } else if (m == m_killers[ply][0]) {
+        scores[i] = killer_bonus + 1;
+      } else if (m == m_killers[ply][1]) {
+        scores[i] = killer_bonus;
+      } else {
+        scores[i] = m_history[side][m.from()][m.to()];
+      }
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Moves the best scored move of the remaining ones to index i.
+  static auto pick_move(move_list &moves, move_scores &scores,
+                        std::size_t const i) -> move {
+    auto best = i;
+    for (auto j = i + 1; j < moves.size(); ++j) {
+      if (scores[j] > scores[best]) {
+        best = j;
+      }
+    }
+    std::swap(moves[i], moves[best]);
+    std::swap(scores[i], scores[best]);
+    return moves[i];
+  }
+  //----------------------------------------------------------------------------
+  void update_quiet_stats(move const m, int const depth, int const ply) {
+    if (m_killers[ply][0] != m) {
+      m_killers[ply][1] = m_killers[ply][0];
+      m_killers[ply][0] = m;
+    }
+    auto const side =
+        static_cast<std::size_t>(m_board.get_position().side_to_move());
+    auto &h = m_history[side][m.from()][m.to()];
+    h += depth * depth;
+    if (h >= history_limit) {
+      for (auto &from : m_history[side]) {
+        for (auto &to : from) {
+          to /= 2;
+        }
+      }
+    }
+  }
+  //----------------------------------------------------------------------------
+  void update_pv(int const ply, move const m) {
+    m_pv[ply][ply] = m;
+    for (auto i = ply + 1; i < m_pv_length[ply + 1]; ++i) {
+      m_pv[ply][i] = m_pv[ply + 1][i];
+    }
+    m_pv_length[ply] = std::max(m_pv_length[ply + 1], ply + 1);
+  }
+  //----------------------------------------------------------------------------
+  auto search(int alpha, int beta, int depth, int const ply,
+              bool const allow_null) -> int {
+    auto const pv_node = beta - alpha > 1;
+    m_pv_length[ply]   = ply;
+    if (depth <= 0) {
+      return quiescence(alpha, beta, ply);
+    }
+    ++m_nodes;
+    if (should_abort()) {
+      return 0;
+    }
+
+    auto const &pos = m_board.get_position();
+    if (ply > 0) {
+      if (pos.halfmove_clock() >= 100 || m_board.is_repetition()) {
+        return 0;
+      }
+      if (ply >= max_ply - 1) {
+        return static_evaluation();
+      }
+      // no line can be better than mating right here
+      alpha = std::max(alpha, -mate_score + ply);
+      beta  = std::min(beta, mate_score - ply - 1);
+      if (alpha >= beta) {
+        return alpha;
+      }
+    }
+
+    auto const key     = m_board.get_key();
+    auto const entry   = m_tt.probe(key, m_counters);
+    auto const tt_move = entry ? entry->best_move : move{};
+    if (entry && !pv_node && entry->depth >= depth) {
+      auto const score = score_from_tt(entry->score, ply);
+      if (entry->type == bound::exact ||
+          (entry->type == bound::lower && score >= beta) ||
+          (entry->type == bound::upper && score <= alpha)) {
+        return score;
+      }
+    }
+
+    auto const in_check = pos.in_check();
+    if (in_check) {
+      ++depth;
+    }
+    auto const static_eval = in_check ? -infinite_score
+                             : entry  ? entry->eval
+                                      : static_evaluation();
+
+    // if passing still fails high, a real move will do so as well
+    if (!pv_node && !in_check && allow_null && depth >= 3 &&
+        static_eval >= beta &&
+        has_non_pawn_material(pos, pos.side_to_move())) {
+      auto const reduction = 2 + depth / 4;
+      play_null();
+      auto const score =
+          -search(-beta, -beta + 1, depth - 1 - reduction, ply + 1, false);
+      take_back();
+      if (m_aborted) {
+        return 0;
+      }
+      if (score >= beta) {
+        return score >= mate_in_max_ply ? beta : score;
+      }
+    }
+
+    auto moves = move_list{};
+    generate_legal_moves(pos, moves);
+    if (moves.empty()) {
+      return in_check ? -mate_score + ply : 0;
+    }
+    auto scores = move_scores{};
+    score_moves(moves, scores, tt_move, ply);
+
+    auto const original_alpha = alpha;
+    auto       best_score     = -infinite_score;
+    auto       best_move      = move{};
+    for (auto i = std::size_t{0}; i < moves.size(); ++i) {
+      auto const m = pick_move(moves, scores, i);
+      play(m);
+      auto score = 0;
+      if (i == 0) {
+        score = -search(-beta, -alpha, depth - 1, ply + 1, true);
+      } else {
+        // prove with a null window that the move is worse than the best one
+        // so far and only search it fully if that fails
+        score = -search(-alpha - 1, -alpha, depth - 1, ply + 1, true);
+        if (score > alpha && score < beta) {
+          score = -search(-beta, -alpha, depth - 1, ply + 1, true);
+        }
+      }
+      take_back();
+      if (m_aborted) {
+        return 0;
+      }
+
+      if (score > best_score) {
+        best_score = score;
+        if (score > alpha) {
+          best_move = m;
+          alpha     = score;
+          update_pv(ply, m);
+          if (score >= beta) {
+            if (!m.is_capture() && !m.is_promotion()) {
+              update_quiet_stats(m, depth, ply);
+            }
+            break;
+          }
+        }
+      }
+    }
+
+    auto const type = best_score >= beta             ? bound::lower
+                      : best_score > original_alpha ? bound::exact
+                                                     : bound::upper;
+    m_tt.store(key,
+               {best_move, score_to_tt(best_score, ply),
+                static_cast<std::int16_t>(in_check ? 0 : static_eval), depth,
+                type},
+               m_counters);
+    return best_score;
+  }
+  //----------------------------------------------------------------------------
+  /// Resolves captures until the position is quiet so that the static
+  /// evaluation is not taken in the middle of an exchange. While in check all
+  /// evasions are searched.
+  auto quiescence(int alpha, int const beta, int const ply) -> int {
+    ++m_nodes;
+    if (should_abort()) {
+      return 0;
+    }
+    auto const &pos = m_board.get_position();
+    if (ply >= max_ply - 1) {
+      return static_evaluation();
+    }
+
+    auto const in_check   = pos.in_check();
+    auto       best_score = -infinite_score;
+    if (!in_check) {
+      // the side to move may decline every capture
+      best_score = static_evaluation();
+      if (best_score >= beta) {
+        return best_score;
+      }
+      alpha = std::max(alpha, best_score);
+    }
+
+    auto moves = move_list{};
+    if (in_check) {
+      generate_legal_moves(pos, moves);
+      if (moves.empty()) {
+        return -mate_score + ply;
+      }
+    } else {
+      generate_legal_captures(pos, moves);
+    }
+    auto scores = move_scores{};
+    score_moves(moves, scores, move{}, ply);
+
+    for (auto i = std::size_t{0}; i < moves.size(); ++i) {
+      auto const m = pick_move(moves, scores, i);
+      play(m);
+      auto const score = -quiescence(-beta, -alpha, ply + 1);
+      take_back();
+      if (m_aborted) {
+        return 0;
+      }
+      if (score > best_score) {
+        best_score = score;
+        if (score > alpha) {
+          alpha = score;
+          if (score >= beta) {
+            break;
+          }
+        }
+      }
+    }
+    return best_score;
+  }
+  //----------------------------------------------------------------------------
+  chess_board                    m_board;
+  shared_state                  &m_shared;
+  transposition_table           &m_tt;
+  transposition_table::counters  m_counters;
+  search_limits const           &m_limits;
+  std::size_t                    m_id;
+  std::optional<nnue::evaluator> m_nnue;
+  std::uint64_t                  m_nodes         = 0;
+  std::uint64_t                  m_flushed_nodes = 0;
+  int                            m_depth         = 0;
+  bool                           m_aborted       = false;
+
+  std::array<std::array<move, 2>, max_ply>             m_killers{};
+  std::array<std::array<std::array<int, 64>, 64>, 2>  m_history{};
+  std::array<std::array<move, max_ply>, max_ply>       m_pv{};
+  std::array<int, max_ply + 1>                         m_pv_length{};
+};
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+searcher::searcher(transposition_table &tt, thread_budget *const budget)
+    : m_tt{&tt}, m_budget{budget} {}
+//------------------------------------------------------------------------------
+searcher::~searcher() {
+  {
+    auto lock = std::scoped_lock{m_pool_mutex};
+    m_quit    = true;
+  }
+  m_wake.notify_all();
+  for (auto &h : m_helpers) {
+    h.join();
+  }
+}
+//------------------------------------------------------------------------------
+void searcher::run_helpers(std::size_t const                       count,
+                           std::function<void(std::size_t)> const &job) {
+  if (count == 0) {
+    return;
+  }
+  {
+    auto lock = std::scoped_lock{m_pool_mutex};
+    while (m_helpers.size() < count) {
+      m_helpers.emplace_back([this, index = m_helpers.size(),
+                              generation = m_generation] {
+        park(index, generation);
+      });
+    }
+    m_job     = &job;
+    m_active  = count;
+    m_running = count;
+    ++m_generation;
+  }
+  m_wake.notify_all();
+}
+//------------------------------------------------------------------------------
+void searcher::park(std::size_t const index, std::uint64_t generation) {
+  auto lock = std::unique_lock{m_pool_mutex};
+  while (true) {
+    m_wake.wait(lock, [&] { return m_quit || m_generation != generation; });
+    if (m_quit) {
+      return;
+    }
+    generation = m_generation;
+    if (index >= m_active) {
+      continue;
+    }
+    auto const &job = *m_job;
+    lock.unlock();
+    job(index);
+    lock.lock();
+    if (--m_running == 0) {
+      m_done.notify_one();
+    }
+  }
+}
+//------------------------------------------------------------------------------
+auto searcher::search(chess_board const &board, search_limits const &limits)
+    -> search_result {
+  m_stop.store(false, std::memory_order_relaxed);
+  m_tt->new_search();
+
+  auto const lease = m_budget != nullptr ? m_budget->acquire(limits.threads)
+                                         : thread_budget::lease{};
+  auto const threads = m_budget != nullptr
+                           ? lease.threads()
+                           : std::max<std::size_t>(limits.threads, 1);
+  auto shared = shared_state{*m_tt, limits, m_stop, m_network.get()};
+
+  // the tables of a worker are too large for the stack of helper threads
+  auto workers = std::vector<std::unique_ptr<worker>>{};
+  workers.reserve(threads);
+  for (auto id = std::size_t{0}; id < threads; ++id) {
+    workers.push_back(std::make_unique<worker>(board, shared, id));
+  }
+  auto const job = std::function<void(std::size_t)>{
+      [&](std::size_t const index) { workers[index + 1]->run_helper(); }};
+  run_helpers(threads - 1, job);
+
+  auto result = workers.front()->run(m_on_info);
+  m_stop.store(true, std::memory_order_relaxed);
+  {
+    auto lock = std::unique_lock{m_pool_mutex};
+    m_done.wait(lock, [&] { return m_running == 0; });
+  }
+  result.nodes   = shared.nodes.load(std::memory_order_relaxed);
+  result.threads = threads;
+  return result;
+}
+//==============================================================================
+} // namespace chess::engine
+//==============================================================================
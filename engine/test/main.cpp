@@ -0,0 +1,283 @@
+#include <catch2/catch_test_macros.hpp>
+//==============================================================================
+#include <chess/engine/book.h>
+#include <chess/engine/evaluation.h>
+#include <chess/engine/nnue.h>
+#include <chess/engine/search.h>
+#include <chess/movegen.h>
+//==============================================================================
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+//==============================================================================
+using chess::chess_board;
+using chess::position;
+using chess::transposition_table;
+using chess::engine::search_limits;
+using chess::engine::searcher;
+namespace nnue = chess::engine::nnue;
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+/// Writes a network with small random weights and returns its path.
+auto write_random_network(std::uint32_t const seed) -> std::filesystem::path {
+  auto const path = std::filesystem::temp_directory_path() /
+                    ("engine_test_" + std::to_string(seed) + ".nnue");
+  auto rng    = std::mt19937{seed};
+  auto weight = std::uniform_int_distribution<int>{-64, 64};
+  auto out    = std::ofstream{path, std::ios::binary};
+  auto const write = [&out](auto const value) {
+    out.write(reinterpret_cast<char const *>(&value), sizeof(value));
+  };
+  write(nnue::network::magic);
+  write(nnue::network::version);
+  write(static_cast<std::uint32_t>(nnue::hidden_size));
+  for (auto i = std::size_t{12}; i < nnue::network::header_size; ++i) {
+    write(std::uint8_t{0});
+  }
+  auto const count = (nnue::feature_count + 3) * nnue::hidden_size;
+  for (auto i = std::size_t{0}; i < count; ++i) {
+    write(static_cast<std::int16_t>(weight(rng)));
+  }
+  write(std::int32_t{1234});
+  return path;
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+TEST_CASE( "evaluate" ) {
+  // the start position is symmetric, only the tempo bonus remains
+  auto const start = position::from_fen(position::start_fen);
+  auto const black_to_move = position::from_fen(
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b KQkq - 0 1");
+  REQUIRE(chess::engine::evaluate(start) ==
+          chess::engine::evaluate(black_to_move));
+  // a queen up is good for the side that has it
+  auto const up = position::from_fen("4k3/8/8/8/8/8/8/3QK3 w - - 0 1");
+  auto const down = position::from_fen("4k3/8/8/8/8/8/8/3QK3 b - - 0 1");
+  REQUIRE(chess::engine::evaluate(up) > 800);
+  REQUIRE(chess::engine::evaluate(down) < -800);
+}
+//==============================================================================
+TEST_CASE( "searcher::search finds mates" ) {
+  auto tt = transposition_table{1};
+  auto s  = searcher{tt};
+
+  // back rank mate in one
+  auto const mate_in_one =
+      s.search(chess_board{"6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"},
+               search_limits{.depth = 4});
+  REQUIRE(mate_in_one.best_move.to_uci() == "a1a8");
+  REQUIRE(mate_in_one.score == chess::engine::mate_score - 1);
+
+  // mate in three starting with a queen sacrifice
+  auto const mate_in_three = s.search(
+      chess_board{"r1b3kr/ppp1Bp1p/1b6/n2P4/2p3q1/2Q2N2/P4PPP/RN2R1K1 w - - 1 0"},
+      search_limits{.depth = 6});
+  REQUIRE(mate_in_three.best_move.to_uci() == "c3h8");
+  REQUIRE(mate_in_three.score == chess::engine::mate_score - 5);
+}
+//==============================================================================
+TEST_CASE( "searcher::search handles positions without moves" ) {
+  auto tt = transposition_table{1};
+  auto s  = searcher{tt};
+  auto const mated =
+      s.search(chess_board{"R5k1/5ppp/8/8/8/8/8/6K1 b - - 0 1"}, {});
+  REQUIRE(mated.best_move.is_null());
+  REQUIRE(mated.score == -chess::engine::mate_score);
+  auto const stalemate =
+      s.search(chess_board{"k7/8/1Q6/8/8/8/8/6K1 b - - 0 1"}, {});
+  REQUIRE(stalemate.best_move.is_null());
+  REQUIRE(stalemate.score == 0);
+}
+//==============================================================================
+TEST_CASE( "searcher::search respects limits" ) {
+  auto tt    = transposition_table{4};
+  auto s     = searcher{tt};
+  auto board = chess_board{};
+
+  auto const by_depth = s.search(board, search_limits{.depth = 3});
+  REQUIRE(by_depth.depth == 3);
+  REQUIRE(!by_depth.best_move.is_null());
+  REQUIRE(by_depth.pv.front() == by_depth.best_move);
+
+  auto const by_nodes = s.search(board, search_limits{.nodes = 20000});
+  REQUIRE(!by_nodes.best_move.is_null());
+  REQUIRE(by_nodes.nodes <= 20000 + 1000);
+
+  using namespace std::chrono_literals;
+  auto const by_time = s.search(board, search_limits{.time = 100ms});
+  REQUIRE(!by_time.best_move.is_null());
+  REQUIRE(by_time.elapsed < 150ms);
+}
+//==============================================================================
+TEST_CASE( "searcher::search with helper threads" ) {
+  auto tt     = transposition_table{4};
+  auto budget = chess::engine::thread_budget{3};
+  auto s      = searcher{tt, &budget};
+
+  auto const result =
+      s.search(chess_board{"6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"},
+               search_limits{.depth = 6, .threads = 4});
+  REQUIRE(result.threads == 3);
+  REQUIRE(result.best_move.to_uci() == "a1a8");
+  REQUIRE(budget.available() == 3);
+
+  auto const by_nodes = s.search(
+      chess_board{}, search_limits{.nodes = 50000, .threads = 2});
+  REQUIRE(!by_nodes.best_move.is_null());
+  REQUIRE(by_nodes.nodes < 50000 + 2 * 2048);
+
+  // parked helpers are reused and more are started when needed
+  auto unbounded = searcher{tt};
+  for (auto const threads : {std::size_t{2}, std::size_t{4}, std::size_t{3}}) {
+    auto const again = unbounded.search(
+        chess_board{"6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"},
+        search_limits{.depth = 4, .threads = threads});
+    REQUIRE(again.threads == threads);
+    REQUIRE(again.best_move.to_uci() == "a1a8");
+  }
+}
+//==============================================================================
+TEST_CASE( "thread_budget" ) {
+  auto budget = chess::engine::thread_budget{4};
+  {
+    auto const a = budget.acquire(3);
+    auto const b = budget.acquire(3);
+    auto const c = budget.acquire(3);
+    REQUIRE(a.threads() == 3);
+    REQUIRE(b.threads() == 1);
+    // an exhausted budget still lets the calling thread search
+    REQUIRE(c.threads() == 1);
+    REQUIRE(budget.available() == 0);
+  }
+  REQUIRE(budget.available() == 4);
+}
+//==============================================================================
+TEST_CASE( "nnue::network rejects foreign files" ) {
+  auto const path =
+      std::filesystem::temp_directory_path() / "engine_test_foreign.nnue";
+  std::ofstream{path} << "not a network";
+  REQUIRE_THROWS_AS(nnue::network{path}, std::runtime_error);
+  std::filesystem::remove(path);
+  REQUIRE_THROWS_AS(nnue::network{path}, std::system_error);
+}
+//==============================================================================
+TEST_CASE( "nnue::evaluator incremental updates" ) {
+  auto const path = write_random_network(7);
+  auto const net  = nnue::network{path};
+  auto rng        = std::mt19937{42};
+
+  for (auto level = nnue::simd::scalar; level <= nnue::detect_simd();
+       level = static_cast<nnue::simd>(static_cast<int>(level) + 1)) {
+    INFO(nnue::to_string(level));
+    auto incremental = nnue::evaluator{net, level};
+    auto fresh       = nnue::evaluator{net, level};
+    auto reference   = nnue::evaluator{net, nnue::simd::scalar};
+    for (auto game = 0; game < 20; ++game) {
+      auto board = chess_board{
+          "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"};
+      incremental.refresh(board.get_position());
+      auto plies = 0;
+      for (; plies < 80; ++plies) {
+        auto moves = chess::move_list{};
+        board.get_possible_moves(moves);
+        if (moves.empty()) {
+          break;
+        }
+        auto const m = moves[std::uniform_int_distribution<std::size_t>{
+            0, moves.size() - 1}(rng)];
+        incremental.push(board.get_position(), m);
+        board.make_move(m);
+
+        fresh.refresh(board.get_position());
+        reference.refresh(board.get_position());
+        REQUIRE(incremental.current().values == fresh.current().values);
+        REQUIRE(incremental.evaluate(board.get_position()) ==
+                reference.evaluate(board.get_position()));
+      }
+      // taking moves back restores the earlier accumulators
+      for (; plies > 0; --plies) {
+        incremental.pop();
+        board.unmake_move();
+      }
+      fresh.refresh(board.get_position());
+      REQUIRE(incremental.current().values == fresh.current().values);
+    }
+  }
+  std::filesystem::remove(path);
+}
+//==============================================================================
+TEST_CASE( "searcher::search with a network" ) {
+  auto const path = write_random_network(11);
+  auto tt         = transposition_table{1};
+  auto s          = searcher{tt};
+  s.set_network(std::make_shared<nnue::network const>(path));
+  // even a random network does not miss a mate
+  auto const result =
+      s.search(chess_board{"6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"},
+               search_limits{.depth = 4, .threads = 2});
+  REQUIRE(result.best_move.to_uci() == "a1a8");
+  std::filesystem::remove(path);
+}
+//==============================================================================
+TEST_CASE( "polyglot_book" ) {
+  using chess::engine::book_move;
+  using chess::engine::polyglot_book;
+  auto const start    = position::from_fen(position::start_fen);
+  auto const castling = position::from_fen(
+      "r3k2r/pppppppp/8/8/8/8/PPPPPPPP/R3K2R w KQkq - 0 1");
+  auto const e2e4 = chess::parse_move(start, "e2e4");
+  auto const d2d4 = chess::parse_move(start, "d2d4");
+  auto const g1f3 = chess::parse_move(start, "g1f3");
+  auto const o_o  = chess::parse_move(castling, "e1g1");
+  // Polyglot encodes castling as the king capturing its rook
+  auto const king_takes_rook = chess::move{chess::e1, chess::h1};
+  REQUIRE(polyglot_book::encode_move(o_o) ==
+          polyglot_book::encode_move(king_takes_rook));
+
+  auto const path =
+      std::filesystem::temp_directory_path() / "engine_test_book.bin";
+  polyglot_book::write(
+      path, {{castling.key(), {o_o, 3}},
+             // the start position as any Polyglot book stores it
+             {0x463b96181691fc9cULL, {e2e4, 10}},
+             {start.key(), {d2d4, 5}},
+             {start.key(), {g1f3, 0}},
+             // legal in the castling position only, dropped when probed
+             {start.key(), {o_o, 7}}});
+  auto const book = polyglot_book{path};
+  REQUIRE(book.size() == 5);
+
+  auto const moves = book.probe(start);
+  REQUIRE(moves.size() == 3);
+  REQUIRE(moves[0].m == e2e4);
+  REQUIRE(moves[0].weight == 10);
+  REQUIRE(book.probe(castling).front().m == o_o);
+  REQUIRE(book.probe(position::from_fen(
+                         "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b "
+                         "KQkq - 0 1"))
+              .empty());
+
+  auto rng      = std::mt19937_64{1};
+  auto settings = chess::engine::book_settings{};
+  auto seen_e4  = 0;
+  auto seen_d4  = 0;
+  for (auto i = 0; i < 300; ++i) {
+    auto const m = book.pick(start, 0, settings, rng);
+    REQUIRE((m == e2e4 || m == d2d4));
+    (m == e2e4 ? seen_e4 : seen_d4)++;
+  }
+  REQUIRE(seen_e4 > seen_d4);
+  REQUIRE(seen_d4 > 0);
+
+  settings.weighted_random = false;
+  REQUIRE(book.pick(start, 0, settings, rng) == e2e4);
+  settings.max_ply = 10;
+  REQUIRE(book.pick(start, 10, settings, rng).is_null());
+  std::filesystem::remove(path);
+}
+//==============================================================================
@@ -3,6 +3,7 @@
 #include <asio.hpp>
 #include <iostream>
 #include "connection.h"
+#include "local_channel.h"
 //==============================================================================
 namespace chess::networking {
 //==============================================================================
@@ -13,13 +14,32 @@ class client_interface {
   //----------------------------------------------------------------------------
   virtual ~client_interface() { disconnect(); }
   //----------------------------------------------------------------------------
-  void connect(std::string const &host, std::uint16_t const port) {
+  // With resumable sessions a connection after the first one resumes the
+  // session of the previous, session_resumed() tells whether it did
+  void connect(std::string const &host, std::uint16_t const port,
+               io_options const &io = {}) {
+    if (m_connection || m_local)
+      disconnect();
     try {
-      m_connection = std::make_unique<connection<MessageTag>>(
+      if (io.transport == transport_kind::shared_memory) {
+        // Shared memory only reaches processes on this host
+        if (host != "localhost" && host != "127.0.0.1" && host != "::1")
+          throw std::invalid_argument{host + " is not a local endpoint"};
+        m_local = local_channel<MessageTag>::connect(local_channel_name(port),
+                                                     m_messages_in);
+        return;
+      }
+      // A context that was stopped needs a restart before it runs again
+      m_asio_context.restart();
+      m_connection = std::make_shared<connection<MessageTag>>(
           connection<MessageTag>::owner::client,
           m_asio_context,
           asio::ip::tcp::socket{m_asio_context},
-          m_messages_in);
+          m_messages_in,
+          write_options{},
+          backpressure_options{},
+          io);
+      m_connection->set_session_ticket(m_session);
 
       asio::ip::tcp::resolver resolver{m_asio_context};
       auto endpoints = resolver.resolve(host, std::to_string(port));
@@ -34,6 +54,9 @@ class client_interface {
   }
   //----------------------------------------------------------------------------
   void disconnect() {
+    // Joins the channel's reader, nothing is left running afterwards
+    m_local.reset();
+
     if (is_connected())
       m_connection->disconnect();
 
@@ -41,10 +64,32 @@ class client_interface {
     if (m_thread_context.joinable())
       m_thread_context.join();
 
-    m_connection.release();
+    // Handlers of the old socket must not outlive the connection, closing
+    // it completes them with an error and they run here. The server keeps
+    // the session for a while, the next connect resumes it.
+    if (m_connection) {
+      m_connection->close_now();
+      m_asio_context.restart();
+      m_asio_context.poll();
+      m_session = m_connection->get_session_ticket();
+    }
+    m_connection.reset();
+  }
+  //----------------------------------------------------------------------------
+  // Whether the last connection continued the previous session without
+  // missing a message. If not, the client needs the full state again.
+  bool session_resumed() const {
+    return m_connection && m_connection->session_replayed();
+  }
+  //----------------------------------------------------------------------------
+  // Makes the next connect start a new session
+  void forget_session() {
+    m_session = {};
   }
   //----------------------------------------------------------------------------
   bool is_connected() {
+    if (m_local)
+      return m_local->is_connected();
     if (m_connection)
       return m_connection->is_connected();
     return false;
@@ -54,7 +99,10 @@ class client_interface {
     if (!is_connected())
       return;
 
-    m_connection->send(msg);
+    if (m_local)
+      m_local->send(msg);
+    else
+      m_connection->send(msg);
   }
   //----------------------------------------------------------------------------
   auto& incoming() {
@@ -64,9 +112,11 @@ class client_interface {
  protected:
   asio::io_context m_asio_context;
   std::thread m_thread_context;
-  std::unique_ptr<connection<MessageTag>> m_connection;
+  std::shared_ptr<connection<MessageTag>> m_connection;
+  session_ticket m_session;
+  std::unique_ptr<local_channel<MessageTag>> m_local;
  private:
-  queue<owned_message<MessageTag>> m_messages_in;
+  mpsc_queue<owned_message<MessageTag>> m_messages_in;
 };
 //==============================================================================
 } // namespace chess:networking
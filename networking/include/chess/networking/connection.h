@@ -1,14 +1,130 @@
 #pragma once
 //==============================================================================
 #include "message.h"
-#include "queue.h"
+#include "mpsc_queue.h"
+#include "session.h"
+#include "wheel_service.h"
 #include <asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 //==============================================================================
 namespace chess::networking {
 //==============================================================================
+/// Limits for coalescing queued messages into one vectored socket write.
+struct write_options {
+  /// Pending bytes from which a send starts writing at once. Smaller amounts
+  /// wait until the handlers already queued on the connection's context ran,
+  /// so that a burst of sends leaves in one write.
+  std::size_t flush_threshold        = 1024;
+  std::size_t max_messages_per_write = 64;
+  /// A single message larger than this is still written, on its own.
+  std::size_t max_bytes_per_write    = 64 * 1024;
+};
+//------------------------------------------------------------------------------
+/// What a connection does when its outgoing queue would exceed its limits.
+enum class overflow_policy {
+  /// Close the connection, a peer that cannot keep up is dropped.
+  disconnect,
+  /// Drop the oldest waiting droppable messages to make room. Disconnects if
+  /// that is not enough and the new message is not droppable itself.
+  drop_oldest
+};
+//------------------------------------------------------------------------------
+/// Bounds of a connection's outgoing queue.
+struct backpressure_options {
+  std::size_t     max_queued_bytes    = 1024 * 1024;
+  std::size_t     max_queued_messages = 4096;
+  /// Queued bytes from which the connection counts as congested and below
+  /// which it stops to be.
+  std::size_t     high_watermark      = 256 * 1024;
+  std::size_t     low_watermark       = 64 * 1024;
+  overflow_policy on_overflow         = overflow_policy::drop_oldest;
+};
+//------------------------------------------------------------------------------
+/// How a connection drives its socket.
+enum class io_model {
+  /// Chains of completion handlers, one read and one write at a time.
+  callbacks,
+  /// A reader and a writer coroutine per connection.
+  coroutines
+};
+//------------------------------------------------------------------------------
+/// What carries the messages of a client.
+enum class transport_kind {
+  tcp,
+  /// The rings of a local_channel, for a server on the same host that
+  /// listens on local_channel_name(port). The other options do not apply.
+  shared_memory
+};
+//------------------------------------------------------------------------------
+struct io_options {
+  io_model                  model = io_model::callbacks;
+  transport_kind            transport = transport_kind::tcp;
+  /// Closes the connection if no complete message arrived for this long.
+  /// Zero disables it.
+  std::chrono::milliseconds idle_timeout{0};
+  /// Closes the connection if the body of a message whose header arrived
+  /// does not follow within this time, which is checked with that
+  /// resolution. Zero disables it.
+  std::chrono::milliseconds read_timeout{0};
+  resume_options            resume{};
+};
+//------------------------------------------------------------------------------
+/// How a single message may be treated under backpressure.
+struct send_policy {
+  /// A waiting message with the same non-zero key is replaced by the new
+  /// one, for example a key per game for clock updates.
+  std::uint64_t coalesce_key = 0;
+  /// The message is superseded by later state and may be dropped.
+  bool          droppable    = false;
+};
+//==============================================================================
+/// One end of a TCP stream of messages.
+///
+/// A connection is bound to the io_context it was created with and touches its
+/// socket and outgoing queue only from handlers running on that context.
+/// send, disconnect, is_connected and recycle may be called from any thread.
+///
+/// Incoming bodies too large for a message's inline storage are read into
+/// buffers of a small per-connection pool and moved into the incoming queue.
+/// Whoever consumes a message hands its body back with recycle(), so once the
+/// pool is warm receiving does not allocate. Headers announcing more than
+/// message_limits allows close the connection.
+///
+/// With io_model::coroutines a reader and a writer coroutine own a reference
+/// to the connection each. Closing the socket cancels both, so the connection
+/// is destroyed as soon as they returned and the last outside reference is
+/// gone.
+///
+/// With resume_options::enabled a server connection is a resumable session.
+/// Losing its socket only detaches it: it stays connected, numbers and keeps
+/// what is sent to it, and takes over the socket of the client's next
+/// connection, see session.h. Only disconnect, a protocol violation, an
+/// overflowing queue or the end of the linger time close it.
+///
+/// Timeouts are timers on the wheel_service of the connection's context, which
+/// all its connections share, so they cost neither a coroutine nor a system
+/// timer per connection.
+///
+/// A full incoming queue pauses reading from the socket instead of blocking
+/// the context's thread, which serves other connections as well. The held
+/// message is offered again every millisecond until the consumer made room,
+/// and meanwhile the peer's writes back up in its own queue.
+///
+/// The outgoing queue is bounded by backpressure_options. Messages that are
+/// not written yet can be coalesced by key or dropped, and the backpressure
+/// handler learns when the queue crosses the watermarks so that game logic
+/// can hold back non-essential traffic.
 template <typename MessageTag>
-class connection : std::enable_shared_from_this<connection<MessageTag>> {
+class connection
+    : public std::enable_shared_from_this<connection<MessageTag>> {
  public: 
   enum class owner {
     server,
@@ -19,17 +135,33 @@ class connection : std::enable_shared_from_this<connection<MessageTag>> {
     owner parent,
     asio::io_context &asio_context,
     asio::ip::tcp::socket socket,
-    queue<owned_message<MessageTag>> &messages_in)
+    mpsc_queue<owned_message<MessageTag>> &messages_in,
+    write_options const &options = {},
+    backpressure_options const &limits = {},
+    io_options const &io = {})
       : m_asio_context{asio_context}
       , m_socket{std::move(socket)}
-      , m_messages_in{messages_in} {}
+      , m_write_signal{asio_context}
+      , m_read_signal{asio_context}
+      , m_timers{asio::use_service<wheel_service>(asio_context)}
+      , m_messages_in{messages_in}
+      , m_owner_type{parent}
+      , m_write_options{options}
+      , m_backpressure{limits}
+      , m_io{io} {
+    m_watchdog.set_callback([this] { check_timeouts(); });
+    m_read_retry.set_callback([this] { retry_incoming(); });
+  }
   //----------------------------------------------------------------------------
   virtual ~connection() = default;
   //----------------------------------------------------------------------------
   void connect_to_client(uint32_t uid = 0) {
     if (m_owner_type == owner::server && m_socket.is_open()) {
       id = uid;
-      read_header();
+      m_connected = true;
+      // The acceptor may run on another context, start reading on ours.
+      asio::post(m_asio_context,
+                 [self = this->shared_from_this()] { self->start(); });
     }
   }
   //----------------------------------------------------------------------------
@@ -39,9 +171,11 @@ class connection : std::enable_shared_from_this<connection<MessageTag>> {
       // Request asio attempts to connect to an endpoint
       asio::async_connect(
           m_socket, endpoints,
-          [this](std::error_code ec, asio::ip::tcp::endpoint endpoint) {
+          [self = this->shared_from_this()](std::error_code ec,
+                                            asio::ip::tcp::endpoint) {
             if (!ec) {
-              read_header();
+              self->m_connected = true;
+              self->start();
             }
           });
     }
@@ -53,100 +187,658 @@ class connection : std::enable_shared_from_this<connection<MessageTag>> {
   //----------------------------------------------------------------------------
   void disconnect() {
     if (is_connected())
-      asio::post(m_asio_context, [this]() { m_socket.close(); });
+      asio::post(m_asio_context,
+                 [self = this->shared_from_this()] { self->close(); });
   }
   //----------------------------------------------------------------------------
   bool is_connected() const {
-    return m_socket.is_open();
+    return m_connected;
+  }
+  //----------------------------------------------------------------------------
+  // Closes the socket right away instead of on the context. Only while no
+  // thread runs the context, handlers still pending see the socket closed.
+  void close_now() {
+    close();
+  }
+  //----------------------------------------------------------------------------
+  // Server connections of resumable sessions: hello decides what becomes of a
+  // new connection, resume reports that a session took over a new socket
+  using hello_handler =
+      std::function<void(connection &, session_hello const &hello)>;
+  using resume_handler = std::function<void(connection &, bool replayed)>;
+  //----------------------------------------------------------------------------
+  // Must be set before the connection starts
+  void set_session_handlers(hello_handler hello, resume_handler resume) {
+    m_hello_handler  = std::move(hello);
+    m_resume_handler = std::move(resume);
+  }
+  //----------------------------------------------------------------------------
+  // Client side, the session to resume. Must be set before connecting.
+  void set_session_ticket(session_ticket const &ticket) {
+    m_session_token = ticket.token;
+    m_last_received = ticket.last_received;
+  }
+  // Only consistent once the connection's context stopped
+  auto get_session_ticket() const -> session_ticket {
+    return {m_session_token, m_last_received};
+  }
+  auto session_token() const { return m_session_token; }
+  // Client side, whether the last handshake continued the session without
+  // missing a message
+  bool session_replayed() const {
+    return m_replayed.load(std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  // Server side, answers the hello of this new connection with a new
+  // session and starts it. On the connection's context.
+  void accept_session(std::uint64_t const token) {
+    m_session_token = token;
+    send_welcome({token, m_next_sequence, 0});
+  }
+  //----------------------------------------------------------------------------
+  // Server side, moves the socket of this new connection to session, which
+  // resumes with it. On this connection's context, from the hello handler.
+  void hand_over(connection &session, std::uint32_t const last_received) {
+    try {
+      auto const protocol = m_socket.local_endpoint().protocol();
+      auto const handle   = m_socket.release();
+      asio::post(session.m_asio_context,
+                 [target = session.shared_from_this(), protocol, handle,
+                  last_received] {
+                   target->adopt(protocol, handle, last_received);
+                 });
+    } catch (std::exception const &) {
+      std::cout << "[" << id << "] Hand Over Fail.\n";
+    }
+    close();
   }
   //----------------------------------------------------------------------------
   void start_listening() {}
   //----------------------------------------------------------------------------
  public:
+  // Immutable message that many connections send from the same memory
+  using shared_message = std::shared_ptr<message<MessageTag> const>;
+  // Called on the connection's context with true when the outgoing queue
+  // reaches the high watermark and with false when it drained to the low one
+  using backpressure_handler = std::function<void(connection &, bool congested)>;
+  //----------------------------------------------------------------------------
   // ASYNC - Send a message, connections are one-to-one so no need to specifiy
   // the target, for a client, the target is the server and vice versa
-  void send(message<MessageTag> const &msg) {
-    asio::post(m_asio_context, [this, msg]() {
-      // If the queue has a message in it, then we must
-      // assume that it is in the process of asynchronously being written.
-      // Either way add the message to the queue to be output. If no messages
-      // were available to be written, then start the process of writing the
-      // message at the front of the queue.
-      auto writing_msg = !m_messages_out.empty();
-      m_messages_out.push_back(msg);
-      if (!writing_msg) {
-        write_header();
-      }
+  void send(message<MessageTag> const &msg, send_policy const policy = {}) {
+    asio::post(m_asio_context, [self = this->shared_from_this(), msg,
+                                policy]() mutable {
+      self->queue_outgoing(outgoing_message{std::move(msg), nullptr}, policy);
     });
   }
+  //----------------------------------------------------------------------------
+  // ASYNC - Send a message that is shared with other connections, only the
+  // reference is queued
+  void send(shared_message msg, send_policy const policy = {}) {
+    asio::post(m_asio_context, [self = this->shared_from_this(),
+                                msg = std::move(msg), policy]() mutable {
+      self->enqueue_on_context(std::move(msg), policy);
+    });
+  }
+  //----------------------------------------------------------------------------
+  // Queues a shared message right away, must be called from a handler running
+  // on this connection's context. Lets a broadcast reach every connection of
+  // a context with a single post.
+  void enqueue_on_context(shared_message msg, send_policy const policy = {}) {
+    queue_outgoing(outgoing_message{{}, std::move(msg)}, policy);
+  }
+  //----------------------------------------------------------------------------
+  // Must be set before the connection sends anything
+  void set_backpressure_handler(backpressure_handler handler) {
+    m_backpressure_handler = std::move(handler);
+  }
+  //----------------------------------------------------------------------------
+  // Whether the outgoing queue is above the watermarks, from any thread
+  bool is_congested() const {
+    return m_congested.load(std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  // Messages dropped or replaced because the peer did not keep up
+  auto dropped_count() const {
+    return m_dropped_count.load(std::memory_order_relaxed);
+  }
+  auto coalesced_count() const {
+    return m_coalesced_count.load(std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  auto context() -> asio::io_context & {
+    return m_asio_context;
+  }
+  //----------------------------------------------------------------------------
+  void set_write_options(write_options const &options) {
+    asio::post(m_asio_context,
+               [self = this->shared_from_this(), options] {
+                 self->m_write_options = options;
+               });
+  }
+  //----------------------------------------------------------------------------
+  // Returns the body of a consumed message to the receive buffer pool. Inline
+  // bodies have nothing to return, large buffers and buffers beyond the pool
+  // size are freed instead.
+  void recycle(typename message<MessageTag>::body_t &&body) {
+    if (!body.is_inline() && body.capacity() <= max_recycled_capacity)
+      m_free_buffers.try_enqueue(body);
+  }
+  //----------------------------------------------------------------------------
+  // Number of socket writes issued so far
+  auto write_count() const {
+    return m_write_count.load(std::memory_order_relaxed);
+  }
 
  private:
-  // ASYNC - Prime context to write a message header
-  void write_header() {
-    // If this function is called, we know the outgoing message queue must have
-    // at least one message to send. So allocate a transmission buffer to hold
-    // the message, and issue the work - asio, send these bytes
+  // A queued message, either owned by the queue or shared with others
+  struct outgoing_message {
+    message<MessageTag> owned;
+    shared_message      shared;
+    // Written instead of the message's own header, which may be shared
+    message_header<MessageTag> header{};
+    send_policy         policy  = {};
+    //--------------------------------------------------------------------------
+    auto get() const -> message<MessageTag> const & {
+      return shared ? *shared : owned;
+    }
+    //--------------------------------------------------------------------------
+    auto frame_size() const -> std::size_t {
+      return sizeof(message_header<MessageTag>) + get().body.size();
+    }
+  };
+
+  using clock = std::chrono::steady_clock;
+  //----------------------------------------------------------------------------
+  // Messages gathered into m_write_buffers: the first count queue entries,
+  // which take bytes on the wire
+  struct write_batch {
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+  };
+
+  // Closes the socket and wakes the coroutines, must run on the connection's
+  // context
+  void close() {
+    // Before m_connected, whoever sees the connection closed may destroy it
+    // on another thread
+    m_watchdog.cancel();
+    m_read_retry.cancel();
+    asio::error_code ec;
+    m_socket.close(ec);
+    m_write_signal.cancel();
+    m_read_signal.cancel();
+    m_connected = false;
+  }
+
+  // Called when the socket failed. Detaches a resumable session and closes
+  // anything else.
+  void lose() {
+    if (m_owner_type == owner::server && m_session_token != 0 && m_connected &&
+        !m_detached) {
+      detach();
+      return;
+    }
+    close();
+  }
+
+  // Drops the socket of a session, which waits for its client to resume it.
+  // Whatever was queued is in the replay buffer.
+  void detach() {
+    ++m_generation;
+    m_detached    = true;
+    m_detached_at = clock::now();
+    m_read_retry.cancel();
+    m_read_paused = false;
+    asio::error_code ec;
+    m_socket.close(ec);
+    m_write_signal.cancel();
+    m_read_signal.cancel();
+    reset_outgoing();
+    check_timeouts();
+  }
+
+  // Forgets the outgoing queue, handlers of the old socket see another
+  // generation and leave it alone
+  void reset_outgoing() {
+    m_messages_out.clear();
+    m_coalesce_index.clear();
+    m_queued_bytes = 0;
+    m_queued_count = 0;
+    m_in_flight    = 0;
+    m_writing      = false;
+    update_congestion();
+  }
+
+  // Starts the connection on its context, with the session handshake first
+  // if sessions are resumable
+  void start() {
+    m_last_receive = clock::now();
+    if (m_io.idle_timeout.count() > 0 || m_io.read_timeout.count() > 0) {
+      check_timeouts();
+    }
+    if (!m_io.resume.enabled) {
+      start_streams();
+    } else if (m_owner_type == owner::server) {
+      read_hello();
+    } else {
+      write_hello();
+    }
+  }
+
+  // Starts to read, and for coroutines to write
+  void start_streams() {
+    if (m_io.model == io_model::callbacks) {
+      read_header();
+      if (!m_messages_out.empty() && !m_writing) {
+        write_messages();
+      }
+      return;
+    }
+    auto self = this->shared_from_this();
+    asio::co_spawn(m_asio_context, run_reader(self, m_generation),
+                   asio::detached);
+    asio::co_spawn(m_asio_context, run_writer(self, m_generation),
+                   asio::detached);
+  }
+
+  // ASYNC - Server side, waits for the client's hello and lets the hello
+  // handler decide
+  void read_hello() {
+    asio::async_read(
+        m_socket, asio::buffer(&m_hello, sizeof(m_hello)),
+        [self = this->shared_from_this()](std::error_code ec, std::size_t) {
+          if (ec || self->m_hello.magic != session_hello::protocol ||
+              !self->m_hello_handler) {
+            std::cout << "[" << self->id << "] Handshake Fail.\n";
+            self->close();
+            return;
+          }
+          self->m_hello_handler(*self, self->m_hello);
+        });
+  }
+
+  // ASYNC - Server side, sends the welcome and then the queued messages.
+  // Sends wait until the welcome is written.
+  void send_welcome(session_welcome const &welcome) {
+    m_welcome = welcome;
+    m_writing = true;
     asio::async_write(
-        m_socket,
-        asio::buffer(&m_messages_out.front().header, sizeof(message_header<MessageTag>)),
-        [this](std::error_code ec, std::size_t length) {
-          // asio has now sent the bytes - if there was a problem
-          // an error would be available...
-          if (!ec) {
-            // ... no error, so check if the message header just sent also
-            // has a message body...
-            if (!m_messages_out.front().body.empty()) {
-              // ...it does, so issue the task to write the body bytes
-              write_body();
+        m_socket, asio::buffer(&m_welcome, sizeof(m_welcome)),
+        [self = this->shared_from_this(),
+         generation = m_generation](std::error_code ec, std::size_t) {
+          if (generation != self->m_generation) {
+            return;
+          }
+          self->m_writing = false;
+          if (ec) {
+            std::cout << "[" << self->id << "] Handshake Fail.\n";
+            self->lose();
+            return;
+          }
+          self->start_streams();
+        });
+  }
 
-            } else {
-              // ...it didnt, so we are done with this message. Remove it from
-              // the outgoing message queue
-              m_messages_out.pop_front();
-
-              // If the queue is not empty, there are more messages to send, so
-              // make this happen by issuing the task to send the next header.
-              if (!m_messages_out.empty()) {
-                write_header();
-              }
-            }
+  // ASYNC - Client side, asks to resume the session of the ticket, if any,
+  // and starts once the server answered
+  void write_hello() {
+    m_hello   = {session_hello::protocol, m_last_received, m_session_token};
+    m_writing = true;
+    asio::async_write(
+        m_socket, asio::buffer(&m_hello, sizeof(m_hello)),
+        [self = this->shared_from_this()](std::error_code ec, std::size_t) {
+          if (ec) {
+            std::cout << "[" << self->id << "] Handshake Fail.\n";
+            self->close();
+            return;
+          }
+          self->read_welcome();
+        });
+  }
+
+  void read_welcome() {
+    asio::async_read(
+        m_socket, asio::buffer(&m_welcome, sizeof(m_welcome)),
+        [self = this->shared_from_this()](std::error_code ec, std::size_t) {
+          if (ec) {
+            std::cout << "[" << self->id << "] Handshake Fail.\n";
+            self->close();
+            return;
+          }
+          auto &welcome = self->m_welcome;
+          self->m_replayed.store(welcome.replayed != 0 &&
+                                     welcome.token == self->m_session_token,
+                                 std::memory_order_relaxed);
+          self->m_session_token = welcome.token;
+          self->m_last_received = welcome.next_sequence - 1;
+          self->m_writing       = false;
+          self->start_streams();
+        });
+  }
+
+  // Server side, continues the session on the socket a new connection handed
+  // over. Replays the messages after last_received if they were all kept.
+  void adopt(asio::ip::tcp::socket::protocol_type const protocol,
+             asio::ip::tcp::socket::native_handle_type const handle,
+             std::uint32_t const last_received) {
+    auto socket = asio::ip::tcp::socket{m_asio_context};
+    try {
+      socket.assign(protocol, handle);
+    } catch (std::exception const &) {
+      std::cout << "[" << id << "] Resume Fail.\n";
+      return;
+    }
+    if (!m_connected) {
+      // The session expired meanwhile, the client starts a new one
+      return;
+    }
+    if (!m_detached) {
+      // The client noticed the loss before the server did
+      detach();
+    }
+    m_socket       = std::move(socket);
+    m_detached     = false;
+    m_last_receive = clock::now();
+    m_reading_body = false;
+
+    auto const oldest = m_replay_count == 0
+                            ? m_next_sequence
+                            : replay_entry(0).header.sequence;
+    auto const replayed = last_received < m_next_sequence &&
+                          last_received + 1 >= oldest;
+    if (replayed) {
+      for (auto i = std::size_t{0}; i < m_replay_count; ++i) {
+        if (auto const &out = replay_entry(i);
+            out.header.sequence > last_received) {
+          m_queued_bytes += out.frame_size();
+          ++m_queued_count;
+          m_messages_out.push_back(out);
+        }
+      }
+      update_congestion();
+    }
+    std::cout << "[" << id << "] Session Resumed.\n";
+    send_welcome({m_session_token,
+                  replayed ? last_received + 1 : m_next_sequence,
+                  replayed ? 1u : 0u});
+    check_timeouts();
+    if (m_resume_handler) {
+      m_resume_handler(*this, replayed);
+    }
+  }
+
+  // Numbers a message of a session and keeps it for the replay. A shared
+  // message is kept by reference, an owned one is copied into the body
+  // buffer of its ring slot, which is reused once the slot has grown to the
+  // size of the messages sent, so neither allocates.
+  void sequence(outgoing_message &out) {
+    out.header.sequence = m_next_sequence++;
+    if (m_replay.empty()) {
+      m_replay.resize(std::max<std::size_t>(m_io.resume.replay_messages, 1));
+    }
+    if (m_replay_count == m_replay.size()) {
+      forget_oldest_replay();
+    }
+    auto &entry  = replay_entry(m_replay_count++);
+    entry.header = out.header;
+    entry.shared = out.shared;
+    if (!out.shared) {
+      entry.owned = out.owned;
+    }
+    m_replay_bytes += entry.frame_size();
+    while (m_replay_count != 0 &&
+           (m_replay_count > m_io.resume.replay_messages ||
+            m_replay_bytes > m_io.resume.replay_bytes)) {
+      forget_oldest_replay();
+    }
+  }
+
+  // Entry i of the replay ring, 0 is the oldest
+  auto replay_entry(std::size_t const i) -> outgoing_message & {
+    return m_replay[(m_replay_first + i) % m_replay.size()];
+  }
+
+  void forget_oldest_replay() {
+    auto &oldest = replay_entry(0);
+    m_replay_bytes -= oldest.frame_size();
+    oldest.shared.reset();
+    m_replay_first = (m_replay_first + 1) % m_replay.size();
+    --m_replay_count;
+  }
+
+  // Add the message to the queue to be output. If no write is in flight,
+  // start one - unless only a few bytes are waiting, then give the other
+  // sends that are already posted to this context a chance to join the same
+  // write.
+  void queue_outgoing(outgoing_message &&out, send_policy const policy) {
+    if (!m_connected) {
+      return;
+    }
+    out.policy = policy;
+    out.header = out.get().header;
+    if (m_owner_type == owner::server && m_session_token != 0) {
+      sequence(out);
+      if (m_detached) {
+        return;
+      }
+    }
+
+    // A waiting message with the same key is replaced in place, it keeps its
+    // position in the queue. A numbered one goes to the back instead: the
+    // client ignores numbers below the last it got, so the messages queued
+    // in between would be lost behind the replacement's higher number.
+    if (policy.coalesce_key != 0) {
+      auto const it = m_coalesce_index.find(policy.coalesce_key);
+      if (it != end(m_coalesce_index)) {
+        auto const i = it->second - m_front_sequence;
+        m_coalesced_count.fetch_add(1, std::memory_order_relaxed);
+        if (out.header.sequence == 0) {
+          auto &queued = m_messages_out[i];
+          m_queued_bytes += out.frame_size();
+          m_queued_bytes -= queued.frame_size();
+          queued = std::move(out);
+          update_congestion();
+          return;
+        }
+        erase_waiting(i);
+      }
+    }
+
+    if (!make_room(out)) {
+      return;
+    }
+    if (policy.coalesce_key != 0) {
+      m_coalesce_index[policy.coalesce_key] =
+          m_front_sequence + m_messages_out.size();
+    }
+    m_queued_bytes += out.frame_size();
+    ++m_queued_count;
+    m_messages_out.push_back(std::move(out));
+    update_congestion();
+    if (m_io.model == io_model::coroutines) {
+      // Wakes the writer if it waits for work, the wake up runs after the
+      // handlers already posted, which gives them a chance to queue more
+      m_write_signal.cancel();
+      return;
+    }
+    if (m_writing || m_flush_scheduled) {
+      return;
+    }
+    if (m_queued_bytes >= m_write_options.flush_threshold) {
+      write_messages();
+    } else {
+      m_flush_scheduled = true;
+      asio::post(m_asio_context, [self = this->shared_from_this()] {
+        self->m_flush_scheduled = false;
+        if (!self->m_writing) {
+          self->write_messages();
+        }
+      });
+    }
+  }
+
+  // Makes the queue able to take out according to the overflow policy.
+  // Returns false if out is not queued.
+  bool make_room(outgoing_message const &out) {
+    auto const fits = [&] {
+      return m_queued_bytes + out.frame_size() <=
+                 m_backpressure.max_queued_bytes &&
+             m_queued_count < m_backpressure.max_queued_messages;
+    };
+    while (!fits()) {
+      if (m_backpressure.on_overflow == overflow_policy::drop_oldest &&
+          drop_oldest_droppable()) {
+        continue;
+      }
+      m_dropped_count.fetch_add(1, std::memory_order_relaxed);
+      if (!out.policy.droppable) {
+        std::cout << "[" << id << "] Outgoing Queue Overflow.\n";
+        close();
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // Removes the oldest droppable message that is not being written
+  bool drop_oldest_droppable() {
+    for (auto i = m_in_flight; i < m_messages_out.size(); ++i) {
+      if (m_messages_out[i].policy.droppable) {
+        erase_waiting(i);
+        m_dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Removes entry i, which is not being written, from the queue. The
+  // entries behind it move up, so a peer that never reads cannot make the
+  // queue grow beyond its limits.
+  void erase_waiting(std::size_t const i) {
+    auto const sequence = m_front_sequence + i;
+    forget_coalesce_key(m_messages_out[i], sequence);
+    m_queued_bytes -= m_messages_out[i].frame_size();
+    --m_queued_count;
+    m_messages_out.erase(begin(m_messages_out) + i);
+    for (auto &[key, queued] : m_coalesce_index) {
+      if (queued > sequence) {
+        --queued;
+      }
+    }
+  }
+
+  // Keeps a message from being replaced once it is written or removed
+  void forget_coalesce_key(outgoing_message const &out,
+                           std::size_t const sequence) {
+    if (out.policy.coalesce_key == 0) {
+      return;
+    }
+    auto const it = m_coalesce_index.find(out.policy.coalesce_key);
+    if (it != end(m_coalesce_index) && it->second == sequence) {
+      m_coalesce_index.erase(it);
+    }
+  }
+
+  // Tells the backpressure handler when the queue crosses a watermark
+  void update_congestion() {
+    auto const congested = m_congested.load(std::memory_order_relaxed);
+    if (!congested && m_queued_bytes >= m_backpressure.high_watermark) {
+      m_congested.store(true, std::memory_order_relaxed);
+      if (m_backpressure_handler) {
+        m_backpressure_handler(*this, true);
+      }
+    } else if (congested && m_queued_bytes <= m_backpressure.low_watermark) {
+      m_congested.store(false, std::memory_order_relaxed);
+      if (m_backpressure_handler) {
+        m_backpressure_handler(*this, false);
+      }
+    }
+  }
+
+  // Gathers as many queued messages as the write options allow into
+  // m_write_buffers. Headers and bodies are written straight from the queued
+  // messages, messages queued while the write is in flight are appended
+  // behind them and do not move them.
+  auto gather_batch() -> write_batch {
+    m_write_buffers.clear();
+    auto batch = write_batch{};
+    for (auto const &out : m_messages_out) {
+      auto const &msg  = out.get();
+      auto const  size = out.frame_size();
+      // A message larger than the cap still goes out on its own
+      if (batch.count == m_write_options.max_messages_per_write ||
+          (batch.count > 0 &&
+           batch.bytes + size > m_write_options.max_bytes_per_write)) {
+        break;
+      }
+      forget_coalesce_key(out, m_front_sequence + batch.count);
+      m_write_buffers.push_back(
+          asio::buffer(&out.header, sizeof(message_header<MessageTag>)));
+      if (!msg.body.empty()) {
+        m_write_buffers.push_back(
+            asio::buffer(msg.body.data(), msg.body.size()));
+      }
+      batch.bytes += size;
+      ++batch.count;
+    }
+    return batch;
+  }
+
+  // Removes a batch from the front of the queue once it was written
+  void release_batch(write_batch const &batch) {
+    m_messages_out.erase(begin(m_messages_out),
+                         begin(m_messages_out) + batch.count);
+    m_front_sequence += batch.count;
+    m_queued_bytes -= batch.bytes;
+    m_queued_count -= batch.count;
+    update_congestion();
+  }
+
+  // ASYNC - Prime context to write as many queued messages as the write
+  // options allow with one vectored write
+  void write_messages() {
+    auto const batch = gather_batch();
+    if (batch.count == 0) {
+      // The queue was reset meanwhile
+      return;
+    }
+    m_writing   = true;
+    m_in_flight = batch.count;
+    m_write_count.fetch_add(1, std::memory_order_relaxed);
+    asio::async_write(
+        m_socket, m_write_buffers,
+        [self = this->shared_from_this(), batch,
+         generation = m_generation](std::error_code ec, std::size_t) {
+          if (generation != self->m_generation) {
+            return;
+          }
+          self->m_writing   = false;
+          self->m_in_flight = 0;
+          if (!ec) {
+            // Sending was successful, so we are done with these messages and
+            // remove them from the queue
+            self->pop_written(batch);
           } else {
-            // ...asio failed to write the message, we could analyse why but
-            // for now simply assume the connection has died by closing the
-            // socket. When a future attempt to write to this client fails due
-            // to the closed socket, it will be tidied up.
-            std::cout << "[" << id << "] Write Header Fail.\n";
-            m_socket.close();
+            // ...asio failed to write, we could analyse why but for now simply
+            // assume the connection has died by closing the socket. When a
+            // future attempt to write to this client fails due to the closed
+            // socket, it will be tidied up.
+            std::cout << "[" << self->id << "] Write Fail.\n";
+            self->lose();
           }
         });
   }
 
-  // ASYNC - Prime context to write a message body
-  void write_body() {
-    // If this function is called, a header has just been sent, and that header
-    // indicated a body existed for this message. Fill a transmission buffer
-    // with the body data, and send it!
-    asio::async_write(m_socket,
-                      asio::buffer(m_messages_out.front().body.data(),
-                                   m_messages_out.front().body.size()),
-                      [this](std::error_code ec, std::size_t length) {
-                        if (!ec) {
-                          // Sending was successful, so we are done with the
-                          // message and remove it from the queue
-                          m_messages_out.pop_front();
-
-                          // If the queue still has messages in it, then issue the
-                          // task to send the next messages' header.
-                          if (!m_messages_out.empty()) {
-                            write_header();
-                          }
-                        } else {
-                          // Sending failed, see WriteHeader() equivalent for
-                          // description :P
-                          std::cout << "[" << id << "] Write Body Fail.\n";
-                          m_socket.close();
-                        }
-                      });
+  // Removes a written batch and writes the next one if there is one
+  void pop_written(write_batch const &batch) {
+    release_batch(batch);
+
+    // If the queue still has messages in it, then issue the task to send the
+    // next batch.
+    if (!m_messages_out.empty()) {
+      write_messages();
+    }
   }
 
   // ASYNC - Prime context ready to read a message header
@@ -159,25 +851,29 @@ class connection : std::enable_shared_from_this<connection<MessageTag>> {
     asio::async_read(
         m_socket,
         asio::buffer(&m_msg_temp_in.header, sizeof(message_header<MessageTag>)),
-        [this](std::error_code ec, std::size_t length) {
+        [self = this->shared_from_this(),
+         generation = m_generation](std::error_code ec, std::size_t) {
+          if (generation != self->m_generation) {
+            return;
+          }
           if (!ec) {
             // A complete message header has been read, check if this message
             // has a body to follow...
-            if (m_msg_temp_in.header.size() > 0) {
-              // ...it does, so allocate enough space in the messages' body
-              // vector, and issue asio with the task to read the body.
-              m_msg_temp_in.body.resize(m_msg_temp_in.header.size());
-              read_body();
+            if (!self->prepare_body()) {
+              self->close();
+            } else if (self->m_msg_temp_in.header.body_size > 0) {
+              // ...it does, so issue asio with the task to read the body.
+              self->read_body();
             } else {
               // it doesn't, so add this bodyless message to the connections
               // incoming message queue
-              add_to_incoming_message_queue();
+              self->add_to_incoming_message_queue();
             }
           } else {
             // Reading form the client went wrong, most likely a disconnect
             // has occurred. Close the socket and let the system tidy it up later.
-            std::cout << "[" << id << "] Read Header Fail.\n";
-            m_socket.close();
+            std::cout << "[" << self->id << "] Read Header Fail.\n";
+            self->lose();
           }
         });
   }
@@ -190,27 +886,101 @@ class connection : std::enable_shared_from_this<connection<MessageTag>> {
     asio::async_read(
         m_socket,
         asio::buffer(m_msg_temp_in.body.data(), m_msg_temp_in.body.size()),
-        [this](std::error_code ec, std::size_t length) {
+        [self = this->shared_from_this(),
+         generation = m_generation](std::error_code ec, std::size_t) {
+          if (generation != self->m_generation) {
+            return;
+          }
           if (!ec) {
             // ...and they have! The message is now complete, so add
             // the whole message to incoming queue
-            add_to_incoming_message_queue();
+            self->add_to_incoming_message_queue();
           } else {
             // As above!
-            std::cout << "[" << id << "] Read Body Fail.\n";
-            m_socket.close();
+            std::cout << "[" << self->id << "] Read Body Fail.\n";
+            self->lose();
           }
         });
   }
 
+  // Buffer for the next incoming body, reused if one was recycled
+  auto acquire_buffer() -> typename message<MessageTag>::body_t {
+    auto buffer = m_free_buffers.try_dequeue();
+    if (!buffer)
+      return {};
+    buffer->clear();
+    return std::move(*buffer);
+  }
+
+  // Refuses bodies that are larger than this kind of message may be, else
+  // takes a buffer from the pool and makes it large enough for the body.
+  // Returns false if the frame is refused.
+  bool prepare_body() {
+    auto const body_size = m_msg_temp_in.header.body_size;
+    if (body_size > message_limits<MessageTag>::max_body_size(
+                        m_msg_temp_in.header.tag)) {
+      std::cout << "[" << id << "] Oversized Body Rejected.\n";
+      return false;
+    }
+    if (body_size > 0) {
+      m_msg_temp_in.body = acquire_buffer();
+      m_msg_temp_in.body.resize_for_overwrite(body_size);
+      m_frame_started = clock::now();
+      m_reading_body  = true;
+    }
+    return true;
+  }
+
+  // Shove the complete message in queue, converting it to an "owned
+  // message", by initialising with the a shared pointer from this connection
+  // object. The body buffer moves along, it is not copied. Returns false and
+  // keeps the message if the queue is full.
+  bool push_incoming() {
+    m_last_receive = clock::now();
+    m_reading_body = false;
+    auto const sequence = m_msg_temp_in.header.sequence;
+    if (sequence != 0 && sequence <= m_last_received) {
+      // A resumed session never repeats a message, but a server that lost
+      // track might
+      recycle(std::move(m_msg_temp_in.body));
+      m_msg_temp_in.body = {};
+      return true;
+    }
+    auto const queued =
+        m_owner_type == owner::server
+            ? m_messages_in.try_emplace(this->shared_from_this(),
+                                        std::move(m_msg_temp_in))
+            : m_messages_in.try_emplace(nullptr, std::move(m_msg_temp_in));
+    if (!queued) {
+      // The socket is not read until the consumer made room
+      m_read_paused = true;
+      m_timers.schedule(m_read_retry, timing_wheel::resolution{1});
+      return false;
+    }
+    m_read_paused = false;
+    if (sequence != 0) {
+      m_last_received = sequence;
+    }
+    m_msg_temp_in.body = {};
+    return true;
+  }
+
+  // Offers the held message to the incoming queue again. The reader
+  // coroutine does that itself once woken.
+  void retry_incoming() {
+    if (m_io.model == io_model::coroutines) {
+      m_read_signal.cancel();
+    } else if (push_incoming()) {
+      read_header();
+    }
+  }
+
   // Once a full message is received, add it to the incoming queue
   void add_to_incoming_message_queue() {
-    // Shove it in queue, converting it to an "owned message", by initialising
-    // with the a shared pointer from this connection object
-    if (m_owner_type == owner::server)
-      m_messages_in.enqueue_emplaced(this->shared_from_this(), m_msg_temp_in);
-    else
-      m_messages_in.enqueue_emplaced(nullptr, m_msg_temp_in);
+    if (!push_incoming()) {
+      // retry_incoming continues once there is room
+      return;
+    }
 
     // We must now prime the asio context to receive the next message. It
     // wil just sit and wait for bytes to arrive, and the message construction
@@ -218,14 +988,212 @@ class connection : std::enable_shared_from_this<connection<MessageTag>> {
     read_header();
   }
 
+  // Reads frames until the socket fails or is closed, or the session moved
+  // to another socket. self keeps the connection alive while it runs.
+  auto run_reader([[maybe_unused]] std::shared_ptr<connection> self,
+                  std::uint32_t const generation) -> asio::awaitable<void> {
+    try {
+      for (;;) {
+        co_await asio::async_read(
+            m_socket,
+            asio::buffer(&m_msg_temp_in.header,
+                         sizeof(message_header<MessageTag>)),
+            asio::use_awaitable);
+        if (generation != m_generation) {
+          co_return;
+        }
+        if (!prepare_body()) {
+          close();
+          co_return;
+        }
+        if (!m_msg_temp_in.body.empty()) {
+          co_await asio::async_read(
+              m_socket,
+              asio::buffer(m_msg_temp_in.body.data(),
+                           m_msg_temp_in.body.size()),
+              asio::use_awaitable);
+          if (generation != m_generation) {
+            co_return;
+          }
+        }
+        while (!push_incoming()) {
+          // retry_incoming and close cancel the wait
+          m_read_signal.expires_at(clock::time_point::max());
+          try {
+            co_await m_read_signal.async_wait(asio::use_awaitable);
+          } catch (std::exception const &) {
+          }
+          if (!m_connected || generation != m_generation) {
+            co_return;
+          }
+        }
+      }
+    } catch (std::exception const &) {
+      if (m_connected && generation == m_generation) {
+        std::cout << "[" << id << "] Read Fail.\n";
+        lose();
+      }
+    }
+  }
+
+  // Writes batches of queued messages and sleeps while there are none. self
+  // keeps the connection alive while it runs.
+  auto run_writer([[maybe_unused]] std::shared_ptr<connection> self,
+                  std::uint32_t const generation) -> asio::awaitable<void> {
+    try {
+      while (m_connected && generation == m_generation) {
+        if (m_messages_out.empty()) {
+          // queue_outgoing and close cancel the wait
+          m_write_signal.expires_at(clock::time_point::max());
+          try {
+            co_await m_write_signal.async_wait(asio::use_awaitable);
+          } catch (std::exception const &) {
+          }
+          continue;
+        }
+        auto const batch = gather_batch();
+        m_writing   = true;
+        m_in_flight = batch.count;
+        m_write_count.fetch_add(1, std::memory_order_relaxed);
+        co_await asio::async_write(m_socket, m_write_buffers,
+                                   asio::use_awaitable);
+        if (generation != m_generation) {
+          co_return;
+        }
+        m_writing   = false;
+        m_in_flight = 0;
+        release_batch(batch);
+      }
+    } catch (std::exception const &) {
+      if (generation != m_generation) {
+        co_return;
+      }
+      m_writing   = false;
+      m_in_flight = 0;
+      if (m_connected) {
+        std::cout << "[" << id << "] Write Fail.\n";
+        lose();
+      }
+    }
+  }
+
+  // Closes the connection when the peer stayed silent or stalled in a frame,
+  // or a detached session when its linger time is over. Else sets the
+  // watchdog for the next deadline.
+  void check_timeouts() {
+    if (!m_connected) {
+      return;
+    }
+    auto const now = clock::now();
+    if (m_detached) {
+      auto const expiry = m_detached_at + m_io.resume.linger;
+      if (expiry <= now) {
+        std::cout << "[" << id << "] Session Expired.\n";
+        close();
+        return;
+      }
+      m_timers.schedule(m_watchdog,
+                        std::chrono::ceil<timing_wheel::resolution>(expiry -
+                                                                    now));
+      return;
+    }
+    if (m_io.idle_timeout.count() <= 0 && m_io.read_timeout.count() <= 0) {
+      m_watchdog.cancel();
+      return;
+    }
+    auto deadline = clock::time_point::max();
+    // A peer whose messages wait for room is not idle
+    if (m_io.idle_timeout.count() > 0 && !m_read_paused) {
+      deadline = std::min(deadline, m_last_receive + m_io.idle_timeout);
+    }
+    if (m_io.read_timeout.count() > 0 && m_reading_body) {
+      deadline = std::min(deadline, m_frame_started + m_io.read_timeout);
+    }
+    if (deadline <= now) {
+      std::cout << "[" << id << "] Timeout.\n";
+      lose();
+      return;
+    }
+    // A frame that starts in between is noticed after at most one read
+    // timeout
+    if (m_io.read_timeout.count() > 0) {
+      deadline = std::min(deadline, now + m_io.read_timeout);
+    }
+    m_timers.schedule(m_watchdog,
+                      std::chrono::ceil<timing_wheel::resolution>(deadline -
+                                                                  now));
+  }
+
  protected:
-  asio::ip::tcp::socket             m_socket;
+  static constexpr std::size_t recycled_buffer_count = 16;
+  static constexpr std::size_t max_recycled_capacity = 16 * 1024;
+  //----------------------------------------------------------------------------
   asio::io_context                 &m_asio_context;
-  queue<message<MessageTag>>        m_messages_out;
-  queue<owned_message<MessageTag>> &m_messages_in;
+  asio::ip::tcp::socket             m_socket;
+  // Wake the writer and the reader coroutine
+  asio::steady_timer                m_write_signal;
+  asio::steady_timer                m_read_signal;
+  wheel_service                    &m_timers;
+  wheel_timer                       m_watchdog;
+  // Offers a message to the full incoming queue again
+  wheel_timer                       m_read_retry;
+  bool                              m_read_paused = false;
+  // Only touched on the connection's context
+  std::deque<outgoing_message>      m_messages_out;
+  std::vector<asio::const_buffer>   m_write_buffers;
+  // Bytes and messages queued, in flight ones included
+  std::size_t                       m_queued_bytes    = 0;
+  std::size_t                       m_queued_count    = 0;
+  // Messages at the front of the queue that are being written
+  std::size_t                       m_in_flight       = 0;
+  // Sequence number of the front message, messages are numbered in the
+  // order they were queued
+  std::size_t                       m_front_sequence  = 0;
+  // Sequence number of the waiting message of each coalesce key
+  std::unordered_map<std::uint64_t, std::size_t> m_coalesce_index;
+  bool                              m_writing         = false;
+  bool                              m_flush_scheduled = false;
+  mpsc_queue<owned_message<MessageTag>> &m_messages_in;
   message<MessageTag>               m_msg_temp_in;
+  clock::time_point                 m_last_receive;
+  clock::time_point                 m_frame_started;
+  bool                              m_reading_body = false;
+  // Filled by recycle() from any thread, drained by this connection
+  mpsc_queue<typename message<MessageTag>::body_t> m_free_buffers{
+      recycled_buffer_count};
   owner                             m_owner_type = owner::server;
   std::uint32_t                     id           = 0;
+  std::atomic<bool>                 m_connected  = false;
+  write_options                     m_write_options;
+  backpressure_options              m_backpressure;
+  backpressure_handler              m_backpressure_handler;
+  io_options                        m_io;
+  // Resumable session. The server numbers what it sends from
+  // m_next_sequence and keeps the last m_replay_count messages in the ring
+  // m_replay from m_replay_first on, the client remembers the last sequence
+  // it received.
+  std::uint64_t                     m_session_token = 0;
+  std::uint32_t                     m_next_sequence = 1;
+  std::uint32_t                     m_last_received = 0;
+  std::vector<outgoing_message>     m_replay;
+  std::size_t                       m_replay_first  = 0;
+  std::size_t                       m_replay_count  = 0;
+  std::size_t                       m_replay_bytes  = 0;
+  session_hello                     m_hello;
+  session_welcome                   m_welcome;
+  hello_handler                     m_hello_handler;
+  resume_handler                    m_resume_handler;
+  // Without a socket, waiting to be resumed
+  bool                              m_detached      = false;
+  clock::time_point                 m_detached_at;
+  // Changes whenever the socket is lost or replaced, handlers of an older
+  // socket stop at once
+  std::uint32_t                     m_generation    = 0;
+  std::atomic<bool>                 m_replayed      = false;
+  std::atomic<bool>                 m_congested       = false;
+  std::atomic<std::size_t>          m_dropped_count   = 0;
+  std::atomic<std::size_t>          m_coalesced_count = 0;
+  std::atomic<std::size_t>          m_write_count = 0;
 };
 //==============================================================================
 } // namespace chess::networking
@@ -0,0 +1,96 @@
+#pragma once
+//==============================================================================
+#include <asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+/// A fixed set of io_contexts that are each run by exactly one thread.
+///
+/// Every connection is bound to one context for its whole lifetime, so all of
+/// its completion handlers run on the same thread and never need a strand.
+/// Contexts are handed out round robin, which spreads connections evenly over
+/// the threads.
+class io_context_pool {
+ public:
+  /// Creates size contexts, at least one.
+  explicit io_context_pool(
+      std::size_t const size = std::thread::hardware_concurrency()) {
+    auto const count = size == 0 ? std::size_t{1} : size;
+    m_contexts.reserve(count);
+    m_work.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      m_contexts.push_back(std::make_unique<asio::io_context>(1));
+      m_work.push_back(asio::make_work_guard(*m_contexts.back()));
+    }
+  }
+  //----------------------------------------------------------------------------
+  io_context_pool(io_context_pool const &)                    = delete;
+  auto operator=(io_context_pool const &) -> io_context_pool & = delete;
+  //----------------------------------------------------------------------------
+  ~io_context_pool() { stop(); }
+  //----------------------------------------------------------------------------
+  /// Starts one thread per context. Calling run on a running pool does
+  /// nothing.
+  auto run() -> void {
+    if (!m_threads.empty()) {
+      return;
+    }
+    m_threads.reserve(m_contexts.size());
+    for (auto &context : m_contexts) {
+      m_threads.emplace_back([&context] { context->run(); });
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Stops all contexts and joins their threads. Handlers that did not run
+  /// yet are dropped.
+  auto stop() -> void {
+    m_work.clear();
+    for (auto &context : m_contexts) {
+      context->stop();
+    }
+    for (auto &thread : m_threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+    m_threads.clear();
+  }
+  //----------------------------------------------------------------------------
+  /// Context for the next connection.
+  auto next() -> asio::io_context & {
+    auto const i = m_next.fetch_add(1, std::memory_order_relaxed);
+    return *m_contexts[i % m_contexts.size()];
+  }
+  //----------------------------------------------------------------------------
+  auto context(std::size_t const i) -> asio::io_context & {
+    return *m_contexts[i];
+  }
+  //----------------------------------------------------------------------------
+  /// Position of context in the pool, size() if it is not part of it.
+  auto index_of(asio::io_context const &context) const -> std::size_t {
+    for (std::size_t i = 0; i < m_contexts.size(); ++i) {
+      if (m_contexts[i].get() == &context) {
+        return i;
+      }
+    }
+    return m_contexts.size();
+  }
+  //----------------------------------------------------------------------------
+  auto size() const { return m_contexts.size(); }
+
+ private:
+  using work_guard = asio::executor_work_guard<asio::io_context::executor_type>;
+  //----------------------------------------------------------------------------
+  std::vector<std::unique_ptr<asio::io_context>> m_contexts;
+  std::vector<work_guard>                        m_work;
+  std::vector<std::thread>                       m_threads;
+  std::atomic<std::size_t>                       m_next = 0;
+};
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
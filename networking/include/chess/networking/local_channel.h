@@ -0,0 +1,327 @@
+#pragma once
+//==============================================================================
+#include "message.h"
+#include "mpsc_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+#include "spsc_ring.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+/// Name of the shared memory a local_channel listens on for port, so that
+/// clients select the local transport with the port they would connect to.
+inline auto local_channel_name(std::uint16_t const port) -> std::string {
+  return "/chess-networking-" + std::to_string(port);
+}
+//==============================================================================
+#if defined(__linux__)
+/// Message channel between two processes on the same host, for example the
+/// server and an analysis engine it runs next to it.
+///
+/// Both processes map a shared memory object that holds one spsc_ring per
+/// direction. Frames are a message_header followed by the body, as on a
+/// socket, and send and the incoming queue behave like those of a
+/// connection: send may be called from any thread, and a thread of the
+/// channel moves arriving messages to the incoming queue. Messages in that
+/// queue have no remote connection.
+///
+/// Without a system call in the way a message is in the peer's incoming
+/// queue within microseconds as long as the peer's reader is spinning. An
+/// idle reader sleeps on a futex and costs one wake up. The reader also
+/// wakes now and then to notice a peer whose process died.
+///
+/// One process listens and creates the object, one other process connects.
+/// Either may close, after which the channel cannot be used again.
+template <typename MessageTag>
+class local_channel {
+ public:
+  static constexpr std::size_t default_ring_capacity = 1 << 20;
+  //----------------------------------------------------------------------------
+  enum class owner { server, client };
+  //----------------------------------------------------------------------------
+  /// Creates the shared memory name, replacing a stale one, and waits for a
+  /// client there. ring_capacity is rounded up to a power of two. Throws
+  /// std::system_error if the memory cannot be created.
+  static auto listen(std::string const                       &name,
+                     mpsc_queue<owned_message<MessageTag>>   &incoming,
+                     std::size_t const ring_capacity = default_ring_capacity)
+      -> std::unique_ptr<local_channel> {
+    auto const capacity = std::bit_ceil(std::max<std::size_t>(
+        ring_capacity, sizeof(message_header<MessageTag>) * 2));
+    ::shm_unlink(name.c_str());
+    auto const fd =
+        ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      throw_error("cannot create " + name);
+    }
+    auto const size = region_size(capacity);
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      auto const error = errno;
+      ::close(fd);
+      ::shm_unlink(name.c_str());
+      throw std::system_error{error, std::generic_category(),
+                              "cannot size " + name};
+    }
+    auto *const memory = map(fd, size, name);
+    // Fresh shared memory is zeroed, which is the empty state of the rings
+    auto *const r    = new (memory) region{};
+    r->ring_capacity = capacity;
+    r->pids[0].store(::getpid(), std::memory_order_relaxed);
+    r->magic.store(region::expected_magic, std::memory_order_release);
+    return std::unique_ptr<local_channel>{
+        new local_channel{owner::server, name, r, size, incoming}};
+  }
+  //----------------------------------------------------------------------------
+  /// Connects to the channel a server listens on at name. Throws
+  /// std::system_error if there is none and std::runtime_error if it is no
+  /// channel or has a client already.
+  static auto connect(std::string const                     &name,
+                      mpsc_queue<owned_message<MessageTag>> &incoming)
+      -> std::unique_ptr<local_channel> {
+    auto const fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+      throw_error("cannot open " + name);
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 ||
+        static_cast<std::size_t>(info.st_size) < sizeof(region)) {
+      ::close(fd);
+      throw std::runtime_error{name + " is no local channel"};
+    }
+    auto const size = static_cast<std::size_t>(info.st_size);
+    auto *const r   = static_cast<region *>(map(fd, size, name));
+    auto        client = std::int32_t{0};
+    if (r->magic.load(std::memory_order_acquire) != region::expected_magic ||
+        region_size(r->ring_capacity) != size) {
+      ::munmap(r, size);
+      throw std::runtime_error{name + " is no local channel"};
+    }
+    if (!r->pids[1].compare_exchange_strong(client, ::getpid(),
+                                            std::memory_order_acq_rel)) {
+      ::munmap(r, size);
+      throw std::runtime_error{name + " has a client already"};
+    }
+    return std::unique_ptr<local_channel>{
+        new local_channel{owner::client, name, r, size, incoming}};
+  }
+  //----------------------------------------------------------------------------
+  local_channel(local_channel const &)                    = delete;
+  auto operator=(local_channel const &) -> local_channel & = delete;
+  //----------------------------------------------------------------------------
+  ~local_channel() {
+    disconnect();
+    if (m_reader.joinable()) {
+      m_reader.join();
+    }
+    ::munmap(m_region, m_size);
+    if (m_owner == owner::server) {
+      ::shm_unlink(m_name.c_str());
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Writes msg to the peer's ring, waits while the ring is full. Does
+  /// nothing once the channel closed. Throws std::length_error if the frame
+  /// can never fit into the ring.
+  void send(message<MessageTag> const &msg) {
+    auto header      = msg.header;
+    header.body_size = static_cast<std::uint32_t>(msg.body.size());
+    header.sequence  = 0;
+    auto const body =
+        std::as_bytes(std::span{msg.body.data(), msg.body.size()});
+    auto const frame = sizeof(header) + body.size();
+    if (frame > m_out.capacity()) {
+      throw std::length_error{"message does not fit into the ring"};
+    }
+    if (!is_connected()) {
+      return;
+    }
+    std::lock_guard lock{m_send_mutex};
+    while (!m_out.try_write({std::as_bytes(std::span{&header, 1}), body})) {
+      if (!is_connected()) {
+        return;
+      }
+      m_out.wait_for_space(frame, liveness_interval);
+      check_peer();
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// False once either side closed or the peer's process is gone. A server
+  /// counts as connected while it waits for its client.
+  bool is_connected() const {
+    return !m_region->closed.load(std::memory_order_acquire);
+  }
+  //----------------------------------------------------------------------------
+  /// Whether a client connected to this server.
+  bool has_peer() const {
+    return m_region->pids[1].load(std::memory_order_acquire) != 0;
+  }
+  //----------------------------------------------------------------------------
+  /// Closes the channel for both sides.
+  void disconnect() {
+    m_region->closed.store(true, std::memory_order_release);
+    m_in.wake();
+    m_out.wake();
+  }
+
+ private:
+  // Layout of the shared memory, the ring bytes follow it. Only members whose
+  // zeroed bytes are a valid value, the memory starts zeroed.
+  struct region {
+    static constexpr std::uint64_t expected_magic = 0x314C434F4C534843; // "CHSLOCL1"
+    //--------------------------------------------------------------------------
+    std::atomic<std::uint64_t> magic{0};
+    std::uint64_t              ring_capacity = 0;
+    // Processes of server and client, zero if there is none
+    std::atomic<std::int32_t>  pids[2]{};
+    std::atomic<bool>          closed{false};
+    // Ring 0 carries messages to the server, ring 1 to the client
+    spsc_ring_control          rings[2];
+  };
+  //----------------------------------------------------------------------------
+  /// How long a blocked side sleeps before it checks on the peer's process.
+  static constexpr auto liveness_interval = std::chrono::milliseconds{100};
+  //----------------------------------------------------------------------------
+  local_channel(owner const o, std::string name, region *const r,
+                std::size_t const size,
+                mpsc_queue<owned_message<MessageTag>> &incoming)
+      : m_owner{o},
+        m_name{std::move(name)},
+        m_region{r},
+        m_size{size},
+        m_in{ring(o == owner::server ? 0 : 1)},
+        m_out{ring(o == owner::server ? 1 : 0)},
+        m_messages_in{incoming} {
+    m_reader = std::thread{[this] { read(); }};
+  }
+  //----------------------------------------------------------------------------
+  static auto region_size(std::size_t const capacity) -> std::size_t {
+    return ring_offset + 2 * capacity;
+  }
+  static constexpr std::size_t ring_offset =
+      (sizeof(region) + 63) / 64 * 64;
+  //----------------------------------------------------------------------------
+  auto ring(int const index) const -> spsc_ring {
+    auto *const bytes = reinterpret_cast<std::byte *>(m_region) + ring_offset +
+                        index * m_region->ring_capacity;
+    return spsc_ring{m_region->rings[index], bytes,
+                     static_cast<std::size_t>(m_region->ring_capacity)};
+  }
+  //----------------------------------------------------------------------------
+  [[noreturn]] static void throw_error(std::string const &what) {
+    throw std::system_error{errno, std::generic_category(), what};
+  }
+  //----------------------------------------------------------------------------
+  static auto map(int const fd, std::size_t const size,
+                  std::string const &name) -> void * {
+    auto *const memory =
+        ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto const error = errno;
+    // the mapping keeps the memory alive on its own
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+      throw std::system_error{error, std::generic_category(),
+                              "cannot map " + name};
+    }
+    return memory;
+  }
+  //----------------------------------------------------------------------------
+  // Closes the channel if the peer's process is gone
+  void check_peer() {
+    auto const pid =
+        m_region->pids[m_owner == owner::server ? 1 : 0].load(
+            std::memory_order_acquire);
+    if (pid != 0 && ::kill(pid, 0) != 0 && errno == ESRCH) {
+      std::cout << "[LOCAL] Peer Gone.\n";
+      disconnect();
+    }
+  }
+  //----------------------------------------------------------------------------
+  // Runs on m_reader, moves frames from the ring to the incoming queue until
+  // the channel closes
+  void read() {
+    auto header = message_header<MessageTag>{};
+    while (is_connected()) {
+      if (m_in.readable() == 0) {
+        m_in.wait_for_data(liveness_interval);
+        if (m_in.readable() == 0) {
+          check_peer();
+        }
+        continue;
+      }
+      m_in.peek(0, std::as_writable_bytes(std::span{&header, 1}));
+      if (header.body_size >
+              message_limits<MessageTag>::max_body_size(header.tag) ||
+          sizeof(header) + header.body_size > m_in.readable()) {
+        std::cout << "[LOCAL] Oversized Frame.\n";
+        disconnect();
+        return;
+      }
+      auto msg   = message<MessageTag>{};
+      msg.header = header;
+      msg.body.resize_for_overwrite(header.body_size);
+      m_in.peek(sizeof(header),
+                std::as_writable_bytes(
+                    std::span{msg.body.data(), msg.body.size()}));
+      m_in.consume(sizeof(header) + header.body_size);
+      m_messages_in.emplace(nullptr, std::move(msg));
+    }
+  }
+  //----------------------------------------------------------------------------
+  owner                                   m_owner;
+  std::string                             m_name;
+  region                                 *m_region;
+  std::size_t                             m_size;
+  spsc_ring                               m_in;
+  spsc_ring                               m_out;
+  mpsc_queue<owned_message<MessageTag>>  &m_messages_in;
+  std::mutex                              m_send_mutex;
+  std::thread                             m_reader;
+};
+#else
+/// The rings wait on futexes, elsewhere there are no local channels and
+/// listening or connecting throws std::runtime_error.
+template <typename MessageTag>
+class local_channel {
+ public:
+  static auto listen(std::string const &,
+                     mpsc_queue<owned_message<MessageTag>> &,
+                     std::size_t const = 0) -> std::unique_ptr<local_channel> {
+    throw std::runtime_error{"local channels need Linux"};
+  }
+  static auto connect(std::string const &,
+                      mpsc_queue<owned_message<MessageTag>> &)
+      -> std::unique_ptr<local_channel> {
+    throw std::runtime_error{"local channels need Linux"};
+  }
+  //----------------------------------------------------------------------------
+  void send(message<MessageTag> const &) {}
+  bool is_connected() const { return false; }
+  bool has_peer() const { return false; }
+  void disconnect() {}
+};
+#endif
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
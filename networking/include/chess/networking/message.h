@@ -1,29 +1,96 @@
 #pragma once
 //==============================================================================
+#include <algorithm>
+#include <bit>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <concepts>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
 #include <type_traits>
-#include <vector>
+#include <utility>
+
+#include "small_buffer.h"
 //==============================================================================
 namespace chess::networking {
 //==============================================================================
+/// Values that can be written to and read from a message body.
+template <typename T>
+concept wire_value = std::is_trivially_copyable_v<T>;
+//------------------------------------------------------------------------------
+namespace detail {
+//------------------------------------------------------------------------------
+/// Copies value to bytes. Arithmetic and enum values are stored little
+/// endian, everything else is copied as it is laid out in memory.
+template <wire_value T>
+auto store_little_endian(unsigned char *bytes, T const &value) -> void {
+  std::memcpy(bytes, &value, sizeof(T));
+  if constexpr (std::endian::native == std::endian::big &&
+                (std::is_arithmetic_v<T> || std::is_enum_v<T>)) {
+    std::reverse(bytes, bytes + sizeof(T));
+  }
+}
+//------------------------------------------------------------------------------
+template <wire_value T>
+auto load_little_endian(unsigned char const *bytes, T &value) -> void {
+  std::memcpy(&value, bytes, sizeof(T));
+  if constexpr (std::endian::native == std::endian::big &&
+                (std::is_arithmetic_v<T> || std::is_enum_v<T>)) {
+    auto *const value_bytes = reinterpret_cast<unsigned char *>(&value);
+    std::reverse(value_bytes, value_bytes + sizeof(T));
+  }
+}
+//------------------------------------------------------------------------------
+} // namespace detail
+//==============================================================================
+/// Frame header, sent as it is laid out in memory. The peers have to agree
+/// on byte order, which all supported platforms do.
 template <typename Tag>
 struct message_header {
   Tag tag{};
   std::uint32_t body_size = 0;
-  constexpr size_t size() const { return sizeof(message_header<Tag>); }
+  /// Position of the message in its resumable session, zero outside of one.
+  /// Set by the sending connection.
+  std::uint32_t sequence = 0;
+  /// Number of body bytes that follow the header on the wire.
+  constexpr size_t size() const { return body_size; }
 };
 //------------------------------------------------------------------------------
+/// Largest body a connection accepts for a message of a tag. Larger frames
+/// are treated as a protocol violation and close the connection before any
+/// memory is reserved for them. Specialize for a tag type to set limits per
+/// tag.
+template <typename Tag>
+struct message_limits {
+  static constexpr std::uint32_t default_max_body_size = 64 * 1024;
+  //----------------------------------------------------------------------------
+  static constexpr auto max_body_size(Tag const /*tag*/) -> std::uint32_t {
+    return default_max_body_size;
+  }
+};
+//------------------------------------------------------------------------------
+/// Tagged message with a body of serialized values.
+///
+/// Values are appended with << and read back in the same order with >>, a
+/// cursor remembers how far the body was read. Bodies of up to
+/// inline_body_size bytes live inside the message, so typical game messages
+/// are built and received without touching the heap.
 template <typename Tag, std::integral BodyValueType = std::uint8_t>
 struct message {
+  static constexpr std::size_t inline_body_size = 64;
+  //----------------------------------------------------------------------------
   using this_t           = message<Tag, BodyValueType>;
   using body_value_t     = BodyValueType;
-  using body_t           = std::vector<body_value_t>;
+  using body_t =
+      small_buffer<body_value_t, inline_body_size / sizeof(body_value_t)>;
   using message_header_t = message_header<Tag>;
   //----------------------------------------------------------------------------
   message_header_t header{};
   body_t           body{};
+  /// Body elements already consumed by >>.
+  std::size_t      read_position = 0;
   //----------------------------------------------------------------------------
   message()                                 = default;
   message(message const &other)             = default;
@@ -33,27 +100,95 @@ struct message {
   //----------------------------------------------------------------------------
   message(Tag const tag) : header{tag} {}
   //----------------------------------------------------------------------------
-  this_t& operator<<(auto &&data) {
-    auto const ints_of_data = reinterpret_cast<body_value_t const*>(&data);
-    auto const data_size    = sizeof(decltype(data)) / sizeof(body_value_t);
-    std::copy(ints_of_data, ints_of_data + data_size, std::back_inserter(body));
-    header.body_size += data_size;
+  /// Number of body elements a value of type T occupies.
+  template <wire_value T>
+  static constexpr auto elements_of() -> std::size_t {
+    static_assert(sizeof(T) % sizeof(body_value_t) == 0,
+                  "value does not fill whole body elements");
+    return sizeof(T) / sizeof(body_value_t);
+  }
+  //----------------------------------------------------------------------------
+  template <wire_value T>
+  this_t& operator<<(T const &data) {
+    auto const offset = body.size();
+    body.resize_for_overwrite(offset + elements_of<T>());
+    detail::store_little_endian(
+        reinterpret_cast<unsigned char *>(body.data() + offset), data);
+    header.body_size = static_cast<std::uint32_t>(body.size());
     return *this;
   }
   //----------------------------------------------------------------------------
-  this_t& operator>>(auto &data) /* requires (std::is_standard_layout_v<decltype(data)>) */ {
-    auto const ints_of_data = reinterpret_cast<body_value_t *>(&data);
-    auto const data_size    = sizeof(decltype(data)) / sizeof(body_value_t);
-    std::copy(end(body) - data_size, end(body), ints_of_data);
-    body.resize(body.size() - data_size);
-    header.body_size -= data_size;
+  /// Reads the next value. Throws std::out_of_range if the rest of the body
+  /// is too short.
+  template <wire_value T>
+    requires(!std::is_const_v<T>)
+  this_t& operator>>(T &data) {
+    if (remaining() < elements_of<T>()) {
+      throw std::out_of_range{"message body is too short"};
+    }
+    detail::load_little_endian(
+        reinterpret_cast<unsigned char const *>(body.data() + read_position),
+        data);
+    read_position += elements_of<T>();
     return *this;
   }
+  //----------------------------------------------------------------------------
+  /// Body elements not read yet.
+  auto remaining() const -> std::size_t { return body.size() - read_position; }
+  //----------------------------------------------------------------------------
+  /// Lets >> start over at the beginning of the body.
+  auto rewind() -> void { read_position = 0; }
   size_t size() const {
-    return header.size() + body.size();
+    return sizeof(message_header_t) + body.size();
   }
 };
 
+//------------------------------------------------------------------------------
+/// Message layout of a tag whose body is always the same sequence of values.
+/// The body size is known at compile time, so encode writes every value at a
+/// fixed offset after a single resize and decode validates the size once.
+/// Layouts that fit into the inline body never allocate.
+///
+///     using move_message = fixed_message<tag::move, std::uint16_t, clock_ms>;
+///     auto msg           = move_message::encode(m, clock);
+///     auto [m, clock]    = *move_message::decode(msg);
+template <auto Tag, wire_value... Values>
+struct fixed_message {
+  using tag_t     = decltype(Tag);
+  using message_t = message<tag_t>;
+  //----------------------------------------------------------------------------
+  static constexpr tag_t         tag       = Tag;
+  static constexpr std::uint32_t body_size = (sizeof(Values) + ... + 0);
+  static constexpr bool          fits_inline =
+      body_size <= message_t::inline_body_size;
+  //----------------------------------------------------------------------------
+  static auto encode(Values const &...values) -> message_t {
+    auto msg = message_t{Tag};
+    msg.body.resize_for_overwrite(body_size);
+    msg.header.body_size = body_size;
+    auto *bytes          = reinterpret_cast<unsigned char *>(msg.body.data());
+    ((detail::store_little_endian(bytes, values), bytes += sizeof(Values)), ...);
+    return msg;
+  }
+  //----------------------------------------------------------------------------
+  /// The values of msg or nullopt if it has another tag or size.
+  static auto decode(message_t const &msg) -> std::optional<std::tuple<Values...>> {
+    if (msg.header.tag != Tag || msg.body.size() != body_size) {
+      return std::nullopt;
+    }
+    auto values = std::tuple<Values...>{};
+    auto const *bytes =
+        reinterpret_cast<unsigned char const *>(msg.body.data());
+    std::apply(
+        [&bytes](auto &...value) {
+          ((detail::load_little_endian(bytes, value), bytes += sizeof(value)),
+           ...);
+        },
+        values);
+    return values;
+  }
+};
+//------------------------------------------------------------------------------
 template <typename MessageTag>
 class connection;
 
@@ -61,7 +196,11 @@ template <typename MessageTag>
 struct owned_message : message<MessageTag> {
   owned_message(std::shared_ptr<connection<MessageTag>> rem, message<MessageTag> const& msg)
     : message<MessageTag>{msg}
-    , remote{rem}
+    , remote{std::move(rem)}
+  {}
+  owned_message(std::shared_ptr<connection<MessageTag>> rem, message<MessageTag>&& msg)
+    : message<MessageTag>{std::move(msg)}
+    , remote{std::move(rem)}
   {}
   std::shared_ptr<connection<MessageTag>> remote = nullptr;
 };
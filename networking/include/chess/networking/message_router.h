@@ -0,0 +1,185 @@
+#pragma once
+//==============================================================================
+#include "message.h"
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+/// Number of tags of a message tag enum. Specialize it to make every
+/// message_router for that tag type prove at compile time that each tag has a
+/// layout. Zero, the default, skips the check.
+template <typename MessageTag>
+struct message_tag_count : std::integral_constant<std::size_t, 0> {};
+//------------------------------------------------------------------------------
+/// Type that knows the tag of its messages and how to decode their bodies,
+/// like fixed_message. decode returns nullopt for malformed bodies.
+template <typename Layout>
+concept message_layout =
+    std::is_enum_v<typename Layout::tag_t> &&
+    std::default_initializable<Layout> &&
+    requires(message<typename Layout::tag_t> const &msg) {
+      { Layout::tag } -> std::convertible_to<typename Layout::tag_t>;
+      { Layout::decode(msg).has_value() } -> std::convertible_to<bool>;
+      *Layout::decode(msg);
+    };
+//------------------------------------------------------------------------------
+namespace detail {
+//------------------------------------------------------------------------------
+template <typename T>
+struct is_tuple : std::false_type {};
+template <typename... Ts>
+struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+//------------------------------------------------------------------------------
+/// Position of tag in a router's table.
+template <typename MessageTag>
+constexpr auto tag_index(MessageTag const tag) -> std::size_t {
+  return static_cast<std::size_t>(
+      static_cast<std::underlying_type_t<MessageTag>>(tag));
+}
+//------------------------------------------------------------------------------
+/// Number of layouts per tag, one entry for each tag up to the largest one
+/// and to message_tag_count.
+template <typename MessageTag, auto... Tags>
+constexpr auto count_layouts() {
+  constexpr auto size =
+      std::max({message_tag_count<MessageTag>::value, (tag_index(Tags) + 1)...});
+  auto counts = std::array<std::size_t, size>{};
+  (++counts[tag_index(Tags)], ...);
+  return counts;
+}
+//------------------------------------------------------------------------------
+template <typename Layout>
+using payload_t =
+    std::remove_cvref_t<decltype(*Layout::decode(std::declval<
+                                 message<typename Layout::tag_t> const &>()))>;
+//------------------------------------------------------------------------------
+/// Calls handler.on_message(Layout{}, client, payload). Tuples, which
+/// fixed_message decodes into, are passed as separate values.
+template <typename Layout, typename Handler, typename Client, typename Payload>
+auto invoke_handler(Handler &handler, Client const &client, Payload &&payload)
+    -> void {
+  if constexpr (is_tuple<std::remove_cvref_t<Payload>>::value) {
+    std::apply(
+        [&](auto &&...values) {
+          handler.on_message(Layout{}, client,
+                             std::forward<decltype(values)>(values)...);
+        },
+        std::forward<Payload>(payload));
+  } else {
+    handler.on_message(Layout{}, client, std::forward<Payload>(payload));
+  }
+}
+//------------------------------------------------------------------------------
+template <typename Layout, typename Handler, typename Client, typename Payload>
+struct accepts
+    : std::bool_constant<requires(Handler &handler, Client const &client,
+                                  Payload &&payload) {
+        handler.on_message(Layout{}, client, std::move(payload));
+      }> {};
+template <typename Layout, typename Handler, typename Client,
+          typename... Values>
+struct accepts<Layout, Handler, Client, std::tuple<Values...>>
+    : std::bool_constant<requires(Handler &handler, Client const &client,
+                                  Values &&...values) {
+        handler.on_message(Layout{}, client, std::move(values)...);
+      }> {};
+//------------------------------------------------------------------------------
+template <typename Layout, typename Handler, typename Client>
+concept handles = accepts<Layout, Handler, Client, payload_t<Layout>>::value;
+//------------------------------------------------------------------------------
+} // namespace detail
+//==============================================================================
+/// Sends every message straight to the handler overload of its tag.
+///
+/// The table from tag to handler is built at compile time, so dispatching is
+/// one bounds check and one indirect call. The body is decoded before the
+/// handler runs, which receives the layout as its first argument to pick the
+/// overload:
+///
+///     struct game_handler {
+///       void on_message(move_message, client_ptr const &, std::uint16_t move,
+///                       clock_ms clock);
+///       void on_message(resign_message, client_ptr const &);
+///     };
+///     auto router = message_router<game_handler, move_message,
+///                                  resign_message>{handler};
+///     server.update(router);
+///
+/// A layout without a matching overload, two layouts for the same tag and,
+/// when message_tag_count is specialized, a tag without a layout do not
+/// compile. Tags that arrive without a layout and bodies that do not decode
+/// are reported by dispatch returning false.
+template <typename Handler, message_layout... Layouts>
+class message_router {
+ public:
+  using tag_t =
+      typename std::tuple_element_t<0, std::tuple<Layouts...>>::tag_t;
+  using client_ptr = std::shared_ptr<connection<tag_t>>;
+  //----------------------------------------------------------------------------
+  static_assert(sizeof...(Layouts) > 0, "a router needs at least one layout");
+  static_assert((std::same_as<typename Layouts::tag_t, tag_t> && ...),
+                "all layouts of a router must use the same tag type");
+  static_assert((detail::handles<Layouts, Handler, client_ptr> && ...),
+                "the handler lacks an on_message overload for a layout");
+  //----------------------------------------------------------------------------
+  explicit message_router(Handler &handler) : m_handler{handler} {}
+  //----------------------------------------------------------------------------
+  /// Decodes msg and passes it to its handler. False if its tag has no
+  /// layout or its body does not decode.
+  auto dispatch(client_ptr const &client, message<tag_t> const &msg) const
+      -> bool {
+    auto const i = detail::tag_index(msg.header.tag);
+    if (i >= table.size() || table[i] == nullptr) {
+      return false;
+    }
+    return table[i](m_handler, client, msg);
+  }
+  //----------------------------------------------------------------------------
+  /// True if msg has a tag this router knows.
+  static constexpr auto routes(tag_t const tag) -> bool {
+    auto const i = detail::tag_index(tag);
+    return i < table.size() && table[i] != nullptr;
+  }
+
+ private:
+  using entry = bool (*)(Handler &, client_ptr const &, message<tag_t> const &);
+  //----------------------------------------------------------------------------
+  template <typename Layout>
+  static auto route(Handler &handler, client_ptr const &client,
+                    message<tag_t> const &msg) -> bool {
+    auto payload = Layout::decode(msg);
+    if (!payload) {
+      return false;
+    }
+    detail::invoke_handler<Layout>(handler, client, std::move(*payload));
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  static constexpr auto layout_counts =
+      detail::count_layouts<tag_t, Layouts::tag...>();
+  static_assert(std::ranges::all_of(layout_counts,
+                                    [](auto n) { return n <= 1; }),
+                "two layouts of a router use the same tag");
+  static_assert(message_tag_count<tag_t>::value == 0 ||
+                    std::ranges::all_of(layout_counts,
+                                        [](auto n) { return n == 1; }),
+                "a tag has no layout in this router");
+  //----------------------------------------------------------------------------
+  static constexpr auto table = [] {
+    auto table = std::array<entry, layout_counts.size()>{};
+    ((table[detail::tag_index(Layouts::tag)] = &route<Layouts>), ...);
+    return table;
+  }();
+  //----------------------------------------------------------------------------
+  Handler &m_handler;
+};
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
@@ -0,0 +1,199 @@
+#pragma once
+//==============================================================================
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+/// Bounded lock-free queue for many producers and a single consumer.
+///
+/// Every slot of the ring carries a sequence number that tells producers and
+/// the consumer whose turn it is, so producers only contend on the tail
+/// index and the consumer never has to synchronize with them through a
+/// shared counter. Items become visible in the order in which producers
+/// claimed their slots.
+///
+/// The consumer may block in wait(). It announces that it is about to sleep
+/// and only producers that see the announcement pay for a futex wake up, an
+/// idle queue that is drained faster than it fills never makes a system call.
+template <typename T>
+class mpsc_queue {
+ public:
+  static constexpr std::size_t default_capacity = 4096;
+  //----------------------------------------------------------------------------
+  /// capacity is rounded up to a power of two.
+  explicit mpsc_queue(std::size_t const capacity = default_capacity)
+      : m_mask{std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity) - 1},
+        m_slots{std::make_unique<slot[]>(m_mask + 1)} {
+    for (std::size_t i = 0; i <= m_mask; ++i) {
+      m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  //----------------------------------------------------------------------------
+  mpsc_queue(mpsc_queue const &)                    = delete;
+  auto operator=(mpsc_queue const &) -> mpsc_queue & = delete;
+  //----------------------------------------------------------------------------
+  ~mpsc_queue() { clear(); }
+  //----------------------------------------------------------------------------
+  auto capacity() const { return m_mask + 1; }
+  //============================================================================
+  // producers
+  //============================================================================
+  /// Moves item into the queue unless it is full. item is left untouched if
+  /// false is returned.
+  auto try_enqueue(T &item) -> bool {
+    return try_emplace(std::move(item));
+  }
+  //----------------------------------------------------------------------------
+  auto try_enqueue(T &&item) -> bool { return try_emplace(std::move(item)); }
+  //----------------------------------------------------------------------------
+  /// Constructs an item in place unless the queue is full.
+  auto try_emplace(auto &&...args) -> bool {
+    auto pos = m_tail.load(std::memory_order_relaxed);
+    slot *s  = nullptr;
+    for (;;) {
+      s              = &m_slots[pos & m_mask];
+      auto const seq = s->sequence.load(std::memory_order_acquire);
+      auto const diff =
+          static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+    std::construct_at(s->item(), std::forward<decltype(args)>(args)...);
+    s->sequence.store(pos + 1, std::memory_order_release);
+    wake_consumer();
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  /// Like try_emplace but yields until the consumer made room.
+  auto emplace(auto &&...args) -> void {
+    while (!try_emplace(std::forward<decltype(args)>(args)...)) {
+      std::this_thread::yield();
+    }
+  }
+  //----------------------------------------------------------------------------
+  auto enqueue(T item) -> void {
+    while (!try_enqueue(item)) {
+      std::this_thread::yield();
+    }
+  }
+  //============================================================================
+  // consumer
+  //============================================================================
+  /// True if the next item is not published yet. Only meaningful for the
+  /// consumer, producers see a snapshot.
+  auto empty() const -> bool {
+    auto const head = m_head.load(std::memory_order_relaxed);
+    return m_slots[head & m_mask].sequence.load(std::memory_order_acquire) !=
+           head + 1;
+  }
+  //----------------------------------------------------------------------------
+  /// Number of claimed slots, including ones that are still being written.
+  auto size() const -> std::size_t {
+    return m_tail.load(std::memory_order_relaxed) -
+           m_head.load(std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  auto try_dequeue() -> std::optional<T> {
+    std::optional<T> item;
+    consume(1, [&item](T &&next) { item.emplace(std::move(next)); });
+    return item;
+  }
+  //----------------------------------------------------------------------------
+  /// Calls f with every item that is ready, at most max_items, and returns
+  /// how many were passed. Items are moved into f and destroyed afterwards.
+  auto consume(std::size_t const max_items, auto &&f) -> std::size_t {
+    auto head  = m_head.load(std::memory_order_relaxed);
+    auto count = std::size_t{0};
+    while (count < max_items) {
+      auto &s = m_slots[head & m_mask];
+      if (s.sequence.load(std::memory_order_acquire) != head + 1) {
+        break;
+      }
+      f(std::move(*s.item()));
+      std::destroy_at(s.item());
+      s.sequence.store(head + m_mask + 1, std::memory_order_release);
+      ++head;
+      ++count;
+      m_head.store(head, std::memory_order_relaxed);
+    }
+    return count;
+  }
+  //----------------------------------------------------------------------------
+  /// Moves up to max_items items to out and returns how many were written.
+  auto dequeue_bulk(auto out, std::size_t const max_items) -> std::size_t {
+    return consume(max_items, [&out](T &&item) { *out++ = std::move(item); });
+  }
+  //----------------------------------------------------------------------------
+  /// Blocks until an item is ready or wake() was called.
+  auto wait() -> void {
+    while (empty() &&
+           !m_wake_requested.exchange(false, std::memory_order_acquire)) {
+      auto const signal = m_signal.load(std::memory_order_acquire);
+      m_consumer_waiting.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (empty() && !m_wake_requested.load(std::memory_order_relaxed)) {
+        m_signal.wait(signal, std::memory_order_acquire);
+      }
+    }
+    m_consumer_waiting.store(false, std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  /// Makes a blocked or the next wait() return even if the queue is empty, for
+  /// example when the consumer has to shut down.
+  auto wake() -> void {
+    m_wake_requested.store(true, std::memory_order_release);
+    signal_consumer();
+  }
+  //----------------------------------------------------------------------------
+  /// Destroys all items that are ready. Must be called by the consumer.
+  auto clear() -> void {
+    consume(static_cast<std::size_t>(-1), [](T &&) {});
+  }
+
+ private:
+  struct slot {
+    std::atomic<std::size_t> sequence;
+    alignas(T) std::byte     storage[sizeof(T)];
+    //--------------------------------------------------------------------------
+    auto item() { return std::launder(reinterpret_cast<T *>(storage)); }
+  };
+  //----------------------------------------------------------------------------
+  auto wake_consumer() -> void {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_consumer_waiting.load(std::memory_order_relaxed)) {
+      signal_consumer();
+    }
+  }
+  //----------------------------------------------------------------------------
+  auto signal_consumer() -> void {
+    m_signal.fetch_add(1, std::memory_order_release);
+    m_signal.notify_one();
+  }
+  //----------------------------------------------------------------------------
+  std::size_t             m_mask;
+  std::unique_ptr<slot[]> m_slots;
+
+  alignas(64) std::atomic<std::size_t> m_tail = 0;
+  alignas(64) std::atomic<std::size_t> m_head = 0;
+  alignas(64) std::atomic<std::uint32_t> m_signal = 0;
+  std::atomic<bool>                      m_consumer_waiting = false;
+  std::atomic<bool>                      m_wake_requested   = false;
+};
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
@@ -5,6 +5,9 @@
 //==============================================================================
 namespace chess::networking {
 //==============================================================================
+/// Mutex guarded deque. References returned by front() and back() stay valid
+/// only until the item is dequeued, so only the single consumer may use them.
+/// Incoming traffic of many connections goes through mpsc_queue instead.
 template <typename T>
 class queue {
  public:
@@ -69,16 +72,18 @@ class queue {
   }
 
   auto empty() const {
+    std::scoped_lock l{m_mutex};
     return m_data.empty();
   }
 
   auto size() const {
+    std::scoped_lock l{m_mutex};
     return m_data.size();
   }
 
  private:
-  std::deque<T> m_data;
-  std::mutex    m_mutex;
+  std::deque<T>      m_data;
+  mutable std::mutex m_mutex;
 
 };
 //==============================================================================
@@ -1,19 +1,34 @@
 #pragma once
 //==============================================================================
+#include "mpsc_queue.h"
 #include "queue.h"
 #include "message.h"
 #include "connection.h"
-#include "message_observer.h"
+#include "io_context_pool.h"
+#include "message_router.h"
+
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 //==============================================================================
 namespace chess::networking
 {
+  // Connections are spread round robin over a pool of io_contexts that each
+  // run on their own thread. A connection stays on its context for its whole
+  // life, so its handlers never run concurrently with each other.
   template<typename MessageTag>
-  class server_interface : public message_observer<MessageTag>
+  class server_interface
   {
   public:
-    // Create a server, ready to listen on specified port
-    server_interface(uint16_t port)
-      : m_asio_acceptor(m_asio_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
+    // Create a server, ready to listen on specified port with thread_count
+    // network threads
+    server_interface(uint16_t port,
+                     std::size_t thread_count = std::thread::hardware_concurrency())
+      : m_pool(thread_count)
+      , m_asio_acceptor(m_pool.context(0), asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
     {
 
     }
@@ -33,8 +48,8 @@ namespace chess::networking
         // connect.
         wait_for_client_connection();
 
-        // Launch the asio context in its own thread
-        m_thread_context = std::thread([this]() { m_asio_context.run(); });
+        // Launch every asio context in its own thread
+        m_pool.run();
       }
       catch (std::exception& e)
       {
@@ -48,11 +63,11 @@ namespace chess::networking
     }
     //----------------------------------------------------------------------------
     void stop() {
-      // Request the context to close
-      m_asio_context.stop();
+      // Request the contexts to close and tidy up their threads
+      m_pool.stop();
 
-      // Tidy up the context thread
-      if (m_thread_context.joinable()) m_thread_context.join();
+      // Release a game loop that sleeps in update()
+      m_messages_in.wake();
 
       // Inform someone, anybody, if they care...
       std::cout << "[SERVER] Stopped!\n";
@@ -63,8 +78,12 @@ namespace chess::networking
       // Prime context with an instruction to wait until a socket connects. This
       // is the purpose of an "acceptor" object. It will provide a unique socket
       // for each incoming connection attempt
+      // The socket is created on the next context of the pool, the
+      // connection lives there from now on
+      auto& connection_context = m_pool.next();
       m_asio_acceptor.async_accept(
-        [this](std::error_code ec, asio::ip::tcp::socket socket)
+        connection_context,
+        [this, &connection_context](std::error_code ec, asio::ip::tcp::socket socket)
         {
           // Triggered by incoming connection request
           if (!ec)
@@ -75,21 +94,44 @@ namespace chess::networking
             // Create a new connection to handle this client 
             std::shared_ptr<connection<MessageTag>> newconn = 
               std::make_shared<connection<MessageTag>>(connection<MessageTag>::owner::server, 
-                m_asio_context, std::move(socket), m_messages_in);
+                connection_context, std::move(socket), m_messages_in, m_write_options,
+                m_backpressure_options, m_io_options);
+
+            // Let the user server know when the client cannot keep up
+            newconn->set_backpressure_handler(
+              [this](connection<MessageTag>& client, bool congested)
+              {
+                on_client_backpressure(client.shared_from_this(), congested);
+              });
             
-            
-
+            if (m_io_options.resume.enabled)
+            {
+              // The client's hello tells whether it is new or resumes a
+              // session, on_client_connect only hears of new ones
+              newconn->set_session_handlers(
+                [this](connection<MessageTag>& client, session_hello const& hello)
+                {
+                  on_session_hello(client.shared_from_this(), hello);
+                },
+                [this](connection<MessageTag>& client, bool replayed)
+                {
+                  on_client_resume(client.shared_from_this(), replayed);
+                });
+              newconn->connect_to_client(n_id_counter++);
+            }
             // Give the user server a chance to deny connection
-            if (on_client_connect(newconn))
+            else if (on_client_connect(newconn))
             {								
-              // Connection allowed, so add to container of new connections
-              m_connections.push_back(std::move(newconn));
-
               // And very important! Issue a task to the connection's
               // asio context to sit and wait for bytes to arrive!
-              m_connections.back()->connect_to_client(n_id_counter++);
+              newconn->connect_to_client(n_id_counter++);
 
-              std::cout << "[" << m_connections.back()->get_id() << "] Connection Approved\n";
+              std::cout << "[" << newconn->get_id() << "] Connection Approved\n";
+
+              // Connection allowed, so add to container of new connections
+              std::unique_lock lock{m_connections_mutex};
+              auto const id = newconn->get_id();
+              m_connections.emplace(id, std::move(newconn));
             }
             else
             {
@@ -111,85 +153,339 @@ namespace chess::networking
         });
     }
 
+    // Runs on the new connection's thread once its client said hello. A
+    // known session takes over the socket, anything else is a new client.
+    void on_session_hello(std::shared_ptr<connection<MessageTag>> newconn, session_hello const& hello)
+    {
+      if (hello.token != 0)
+      {
+        std::shared_ptr<connection<MessageTag>> session;
+        {
+          std::shared_lock lock{m_connections_mutex};
+          auto const it = m_sessions.find(hello.token);
+          if (it != end(m_sessions))
+            session = it->second;
+        }
+        if (session && session->is_connected())
+        {
+          newconn->hand_over(*session, hello.last_received);
+          return;
+        }
+      }
+
+      if (!on_client_connect(newconn))
+      {
+        std::cout << "[-----] Connection Denied\n";
+        newconn->disconnect();
+        return;
+      }
+      std::cout << "[" << newconn->get_id() << "] Connection Approved\n";
+
+      auto token = std::uint64_t{0};
+      {
+        std::unique_lock lock{m_connections_mutex};
+        // Tokens are hard to guess, another client cannot take a session over
+        while (token == 0 || m_sessions.contains(token))
+          token = std::uint64_t{m_random()} << 32 | m_random();
+        m_sessions.emplace(token, newconn);
+        m_connections.emplace(newconn->get_id(), newconn);
+      }
+      newconn->accept_session(token);
+    }
+
     // Send a message to a specific client
-    void message_client(std::shared_ptr<connection<MessageTag>> client, const message<MessageTag>& msg) {
+    void message_client(std::shared_ptr<connection<MessageTag>> client, const message<MessageTag>& msg,
+                        send_policy const policy = {}) {
       // Check client is legitimate...
-      if (client && client->IsConnected())
+      if (client && client->is_connected())
       {
         // ...and post the message via the connection
-        client->Send(msg);
+        client->send(msg, policy);
       }
       else
       {
         // If we cant communicate with client then we may as 
         // well remove the client - let the server know, it may
         // be tracking it somehow
-        OnClientDisconnect(client);
+        on_client_disconnect(client);
+
+        // Then physically remove it from the container
+        if (client)
+        {
+          {
+            std::unique_lock lock{m_connections_mutex};
+            auto const it = m_connections.find(client->get_id());
+            if (it != end(m_connections) && it->second == client)
+            {
+              m_sessions.erase(client->session_token());
+              m_connections.erase(it);
+            }
+          }
+          unsubscribe_all(client);
+        }
 
         // Off you go now, bye bye!
         client.reset();
-
-        // Then physically remove it from the container
-        m_connections.erase(
-          std::ranges::remove(m_connections, client), end(m_connections));
       }
     }
     
     // Send message to all clients
     void message_all_clients(
         const message<MessageTag>& msg,
-        std::shared_ptr<connection<MessageTag>> pIgnoreClient = nullptr) {
-      bool bInvalidClientExists = false;
-
-      // Iterate through all clients in container
-      for (auto& client : m_connections)
+        std::shared_ptr<connection<MessageTag>> pIgnoreClient = nullptr,
+        send_policy const policy = {}) {
+      // The message is copied once and every connection queues a reference
+      // to the same copy
+      auto const shared = std::make_shared<message<MessageTag> const>(msg);
+
+      // Dead clients are reported after the lock is released, so the
+      // handler may talk to the server again
+      std::vector<std::shared_ptr<connection<MessageTag>>> disconnected;
       {
-        // Check client is connected...
-        if (client && client->IsConnected())
+        std::unique_lock lock{m_connections_mutex};
+
+        // Iterate through all clients in container, dead clients are erased
+        // on the way
+        for (auto it = begin(m_connections); it != end(m_connections);)
         {
-          // ..it is!
-          if(client != pIgnoreClient)
-            client->Send(msg);
+          auto& client = it->second;
+          // Check client is connected...
+          if (client->is_connected())
+          {
+            // ..it is!
+            if(client != pIgnoreClient)
+              client->send(shared, policy);
+            ++it;
+          }
+          else
+          {
+            // The client couldnt be contacted, so assume it has
+            // disconnected.
+            m_sessions.erase(client->session_token());
+            disconnected.push_back(std::move(client));
+            it = m_connections.erase(it);
+          }
         }
+      }
+
+      for (auto& client : disconnected)
+      {
+        unsubscribe_all(client);
+        on_client_disconnect(client);
+      }
+    }
+
+    // Adds client to the named channel, for example a game or a tournament.
+    // Channels are created on first use. Connections stay subscribed until
+    // they are unsubscribed or the server notices they are gone.
+    void subscribe(std::string const& name, std::shared_ptr<connection<MessageTag>> client)
+    {
+      auto const context = m_pool.index_of(client->context());
+      std::scoped_lock lock{m_channels_mutex};
+      auto& subscribers =
+        m_channels.try_emplace(name, m_pool.size()).first->second.by_context[context];
+      if (std::ranges::find(*subscribers, client) != subscribers->end())
+        return;
+      auto updated = std::make_shared<subscriber_list>(*subscribers);
+      updated->push_back(std::move(client));
+      subscribers = std::move(updated);
+    }
+
+    void unsubscribe(std::string const& name, std::shared_ptr<connection<MessageTag>> const& client)
+    {
+      std::scoped_lock lock{m_channels_mutex};
+      auto it = m_channels.find(name);
+      if (it == end(m_channels))
+        return;
+      remove_subscriber(it->second, client);
+      if (it->second.empty())
+        m_channels.erase(it);
+    }
+
+    void unsubscribe_all(std::shared_ptr<connection<MessageTag>> const& client)
+    {
+      std::scoped_lock lock{m_channels_mutex};
+      for (auto it = begin(m_channels); it != end(m_channels);)
+      {
+        remove_subscriber(it->second, client);
+        if (it->second.empty())
+          it = m_channels.erase(it);
         else
-        {
-          // The client couldnt be contacted, so assume it has
-          // disconnected.
-          OnClientDisconnect(client);
-          client.reset();
+          ++it;
+      }
+    }
 
-          // Set this flag to then remove dead clients from container
-          bInvalidClientExists = true;
-        }
+    // Number of connections subscribed to the channel
+    auto subscriber_count(std::string const& name)
+    {
+      std::scoped_lock lock{m_channels_mutex};
+      auto it = m_channels.find(name);
+      return it == end(m_channels) ? std::size_t{0} : it->second.size();
+    }
+
+    // Sends msg to every subscriber of the channel but pIgnoreClient. The
+    // message is copied once into an immutable shared buffer and every
+    // network thread gets one task that queues a reference to it on all of
+    // its subscribers. Returns the number of subscribers.
+    std::size_t broadcast(
+        std::string const& name,
+        const message<MessageTag>& msg,
+        std::shared_ptr<connection<MessageTag>> const& pIgnoreClient = nullptr,
+        send_policy const policy = {}) {
+      // Subscriber lists are never changed in place, taking a reference to
+      // them is all the locking a broadcast needs
+      std::vector<std::shared_ptr<subscriber_list const>> by_context;
+      {
+        std::scoped_lock lock{m_channels_mutex};
+        auto it = m_channels.find(name);
+        if (it == end(m_channels))
+          return 0;
+        by_context = it->second.by_context;
+      }
+
+      auto const shared = std::make_shared<message<MessageTag> const>(msg);
+      auto count = std::size_t{0};
+      for (std::size_t i = 0; i < by_context.size(); ++i)
+      {
+        if (by_context[i]->empty())
+          continue;
+        count += by_context[i]->size();
+        asio::post(m_pool.context(i),
+          [shared, subscribers = by_context[i], ignore = pIgnoreClient.get(), policy]
+          {
+            for (auto& client : *subscribers)
+              if (client.get() != ignore && client->is_connected())
+                client->enqueue_on_context(shared, policy);
+          });
       }
+      return count;
+    }
+
+    // Number of connections that were accepted and not removed yet
+    auto connection_count()
+    {
+      std::shared_lock lock{m_connections_mutex};
+      return m_connections.size();
+    }
+
+    // The connection with id or nullptr if there is none, lookups from
+    // several threads do not block each other
+    auto find_client(uint32_t const id) -> std::shared_ptr<connection<MessageTag>>
+    {
+      std::shared_lock lock{m_connections_mutex};
+      auto const it = m_connections.find(id);
+      return it == end(m_connections) ? nullptr : it->second;
+    }
+
+    // Limits for coalescing outgoing messages of every connection, must be
+    // set before start()
+    void set_write_options(write_options const& options)
+    {
+      m_write_options = options;
+    }
+
+    // Bounds of the outgoing queue of every connection, must be set before
+    // start()
+    void set_backpressure_options(backpressure_options const& options)
+    {
+      m_backpressure_options = options;
+    }
+
+    // Whether connections are driven by callbacks or coroutines and their
+    // timeouts, must be set before start()
+    void set_io_options(io_options const& options)
+    {
+      m_io_options = options;
+    }
+
+    // Number of threads serving connections
+    auto thread_count() const
+    {
+      return m_pool.size();
+    }
+
+    // Force server to respond to incoming messages. With bWait the calling
+    // thread sleeps until a message arrives or the server stops. Returns the
+    // number of handled messages.
+    size_t update(size_t nMaxMessages = -1, bool bWait = false) {
+      return process(nMaxMessages, bWait,
+        [this](owned_message<MessageTag>& msg)
+        {
+          on_message(msg.remote, msg);
+        });
+    }
 
-      // Remove dead clients, all in one go - this way, we dont invalidate the
-      // container as we iterated through it.
-      if (bInvalidClientExists)
-        m_connections.erase(
-          std::ranges::remove(m_connections, nullptr), end(m_connections));
+    // Like update() but every message goes straight to the handler of its
+    // tag in router, already decoded, instead of through on_message
+    template<typename Handler, typename... Layouts>
+    size_t update(message_router<Handler, Layouts...> const& router,
+                  size_t nMaxMessages = -1, bool bWait = false) {
+      static_assert(std::same_as<typename message_router<Handler, Layouts...>::tag_t, MessageTag>,
+                    "the router is for another tag type");
+      return process(nMaxMessages, bWait,
+        [this, &router](owned_message<MessageTag>& msg)
+        {
+          if (!router.dispatch(msg.remote, msg))
+            on_unrouted_message(msg.remote, msg);
+        });
     }
 
-    // Force server to respond to incoming messages
-    void update(size_t nMaxMessages = -1, bool bWait = false) {
+  protected:
+    // Takes up to nMaxMessages from the incoming queue, in one go, and hands
+    // them to handle
+    size_t process(size_t nMaxMessages, bool bWait, auto&& handle) {
       if (bWait) m_messages_in.wait();
 
-      // Process as many messages as you can up to the value
-      // specified
-      size_t nMessageCount = 0;
-      while (nMessageCount < nMaxMessages && !m_messages_in.empty())
+      return m_messages_in.consume(nMaxMessages,
+        [&handle](owned_message<MessageTag>&& msg)
+        {
+          handle(msg);
+
+          // The body buffer goes back to the connection that received it
+          if (msg.remote)
+            msg.remote->recycle(std::move(msg.body));
+        });
+    }
+
+    using subscriber_list = std::vector<std::shared_ptr<connection<MessageTag>>>;
+
+    // Subscribers of one channel, split by the context their connections
+    // run on. Lists are copied on change so broadcasts can use them without
+    // holding the lock.
+    struct channel
+    {
+      std::vector<std::shared_ptr<subscriber_list const>> by_context;
+
+      explicit channel(std::size_t context_count = 0)
+        : by_context(context_count, std::make_shared<subscriber_list const>())
+      {}
+
+      auto size() const
       {
-        // Grab the front message
-        auto msg = m_messages_in.pop_front();
+        auto n = std::size_t{0};
+        for (auto& subscribers : by_context)
+          n += subscribers->size();
+        return n;
+      }
 
-        // Pass to message handler
-        OnMessage(msg.remote, msg.msg);
+      auto empty() const
+      {
+        return size() == 0;
+      }
+    };
 
-        nMessageCount++;
+    void remove_subscriber(channel& c, std::shared_ptr<connection<MessageTag>> const& client)
+    {
+      for (auto& subscribers : c.by_context)
+      {
+        if (std::ranges::find(*subscribers, client) == subscribers->end())
+          continue;
+        auto updated = std::make_shared<subscriber_list>(*subscribers);
+        std::erase(*updated, client);
+        subscribers = std::move(updated);
       }
     }
 
-  protected:
     // This server class should override thse functions to implement
     // customised functionality
 
@@ -203,26 +499,63 @@ namespace chess::networking
 
     }
 
+    // Called on the client's network thread when its outgoing queue reaches
+    // the high watermark (congested) and when it drained to the low one.
+    // Non-essential traffic to a congested client can be held back.
+    virtual void on_client_backpressure(std::shared_ptr<connection<MessageTag>> client, bool congested) {
+
+    }
+
+    // Called on the client's network thread when a resumable session took
+    // over the socket of its client's new connection. Without replayed the
+    // client missed messages and needs the full state again.
+    virtual void on_client_resume(std::shared_ptr<connection<MessageTag>> client, bool replayed) {
+
+    }
+
     // Called when a message arrives
     virtual void on_message(std::shared_ptr<connection<MessageTag>> client, message<MessageTag>& msg) {
-      notify_observers(client, msg);
+
     }
 
+    // Called with messages whose tag has no layout in the router passed to
+    // update() or whose body does not decode
+    virtual void on_unrouted_message(std::shared_ptr<connection<MessageTag>> client, message<MessageTag>& msg) {
 
-  protected:
-    // Thread Safe Queue for incoming message packets
-    queue<owned_message<MessageTag>> m_messages_in;
+    }
 
-    // Container of active validated connections
-    std::deque<std::shared_ptr<connection<MessageTag>>> m_connections;
 
-    // Order of declaration is important - it is also the order of initialisation
-    asio::io_context m_asio_context;
-    std::thread m_thread_context;
+  protected:
+    // Order of declaration is important - it is also the order of
+    // initialisation. Everything holding a socket must be destroyed before
+    // the contexts of the pool.
+    io_context_pool m_pool;
+
+    // Lock-free queue for incoming message packets, filled by all network
+    // threads and drained by update()
+    mpsc_queue<owned_message<MessageTag>> m_messages_in;
 
     // These things need an asio context
     asio::ip::tcp::acceptor m_asio_acceptor; // Handles new incoming connection attempts...
 
+    // Container of active validated connections by id, accepted on the
+    // acceptor's thread and used from the game loop
+    std::unordered_map<uint32_t, std::shared_ptr<connection<MessageTag>>> m_connections;
+    // The same connections by session token, with resumable sessions
+    std::unordered_map<std::uint64_t, std::shared_ptr<connection<MessageTag>>> m_sessions;
+    std::shared_mutex m_connections_mutex;
+    // Draws session tokens, under m_connections_mutex
+    std::random_device m_random;
+
+    // Named channels for broadcast()
+    std::unordered_map<std::string, channel> m_channels;
+    std::mutex m_channels_mutex;
+
+    // Passed to every new connection
+    write_options m_write_options;
+    backpressure_options m_backpressure_options;
+    io_options m_io_options;
+
     // Clients will be identified in the "wider system" via an ID
     uint32_t n_id_counter = 10000;
   };
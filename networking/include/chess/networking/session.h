@@ -0,0 +1,57 @@
+#pragma once
+//==============================================================================
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+/// Resumable sessions, which both ends have to enable.
+///
+/// The server numbers the messages of a session in message_header::sequence
+/// and keeps the latest of them. A client that lost its connection connects
+/// again with the token of its session and the last sequence it received,
+/// the server hands the new socket to the connection of the session and
+/// replays only what the client missed. The application keeps using the same
+/// connection object throughout.
+struct resume_options {
+  bool                      enabled = false;
+  /// Messages the server keeps per session for replay, older ones are
+  /// forgotten once either limit is reached.
+  std::size_t               replay_messages = 1024;
+  std::size_t               replay_bytes    = 256 * 1024;
+  /// How long the server keeps a session whose client is gone. Messages sent
+  /// meanwhile are kept for the replay.
+  std::chrono::milliseconds linger{30 * 1000};
+};
+//------------------------------------------------------------------------------
+/// First bytes a client sends on a connection of a resumable session.
+struct session_hello {
+  static constexpr std::uint32_t protocol = 0x31534843; // "CHS1"
+  //----------------------------------------------------------------------------
+  std::uint32_t magic         = protocol;
+  /// Sequence of the last message received in the session.
+  std::uint32_t last_received = 0;
+  /// Zero asks for a new session.
+  std::uint64_t token         = 0;
+};
+//------------------------------------------------------------------------------
+/// The server's answer to a session_hello, it precedes every message.
+struct session_welcome {
+  std::uint64_t token         = 0;
+  /// Sequence of the first message that follows.
+  std::uint32_t next_sequence = 1;
+  /// One if the client receives every message after the last one it got.
+  /// Zero for a new session or if the server no longer had some of them,
+  /// the client then needs the full state again.
+  std::uint32_t replayed      = 0;
+};
+//------------------------------------------------------------------------------
+/// What a client keeps of its session between connections.
+struct session_ticket {
+  std::uint64_t token         = 0;
+  std::uint32_t last_received = 0;
+};
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
@@ -0,0 +1,121 @@
+#pragma once
+//==============================================================================
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+/// Contiguous buffer of integers that keeps up to InlineCapacity elements
+/// inside the object and only goes to the heap for larger contents.
+///
+/// Moving a buffer that lives on the heap steals the allocation, moving an
+/// inline one copies its elements. clear() keeps the capacity so a heap
+/// buffer can be reused without allocating again.
+template <std::integral T, std::size_t InlineCapacity>
+class small_buffer {
+ public:
+  using value_type                              = T;
+  static constexpr std::size_t inline_capacity = InlineCapacity;
+  //----------------------------------------------------------------------------
+  small_buffer() = default;
+  //----------------------------------------------------------------------------
+  small_buffer(small_buffer const &other) { assign(other.data(), other.size()); }
+  //----------------------------------------------------------------------------
+  small_buffer(small_buffer &&other) noexcept { steal(other); }
+  //----------------------------------------------------------------------------
+  auto operator=(small_buffer const &other) -> small_buffer & {
+    if (this != &other) {
+      assign(other.data(), other.size());
+    }
+    return *this;
+  }
+  //----------------------------------------------------------------------------
+  auto operator=(small_buffer &&other) noexcept -> small_buffer & {
+    if (this != &other) {
+      steal(other);
+    }
+    return *this;
+  }
+  //----------------------------------------------------------------------------
+  ~small_buffer() = default;
+  //----------------------------------------------------------------------------
+  auto data() -> T * { return m_heap ? m_heap.get() : m_inline; }
+  auto data() const -> T const * { return m_heap ? m_heap.get() : m_inline; }
+  auto size() const { return m_size; }
+  auto capacity() const { return m_capacity; }
+  auto empty() const { return m_size == 0; }
+  auto is_inline() const { return m_heap == nullptr; }
+  //----------------------------------------------------------------------------
+  auto begin() { return data(); }
+  auto begin() const { return data(); }
+  auto end() { return data() + m_size; }
+  auto end() const { return data() + m_size; }
+  //----------------------------------------------------------------------------
+  auto operator[](std::size_t const i) -> T & { return data()[i]; }
+  auto operator[](std::size_t const i) const -> T const & { return data()[i]; }
+  //----------------------------------------------------------------------------
+  auto clear() -> void { m_size = 0; }
+  //----------------------------------------------------------------------------
+  auto reserve(std::size_t const capacity) -> void {
+    if (capacity <= m_capacity) {
+      return;
+    }
+    auto heap = std::make_unique_for_overwrite<T[]>(capacity);
+    std::memcpy(heap.get(), data(), m_size * sizeof(T));
+    m_heap     = std::move(heap);
+    m_capacity = capacity;
+  }
+  //----------------------------------------------------------------------------
+  /// Grows or shrinks to size elements, new elements are zero.
+  auto resize(std::size_t const size) -> void {
+    auto const old_size = m_size;
+    resize_for_overwrite(size);
+    if (size > old_size) {
+      std::fill(data() + old_size, data() + size, T{});
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Grows or shrinks to size elements, new elements are left uninitialized
+  /// for the caller to overwrite.
+  auto resize_for_overwrite(std::size_t const size) -> void {
+    if (size > m_capacity) {
+      reserve(std::max(size, m_capacity * 2));
+    }
+    m_size = size;
+  }
+  //----------------------------------------------------------------------------
+  auto append(T const *values, std::size_t const count) -> void {
+    auto const offset = m_size;
+    resize_for_overwrite(m_size + count);
+    std::memcpy(data() + offset, values, count * sizeof(T));
+  }
+
+ private:
+  auto assign(T const *values, std::size_t const count) -> void {
+    m_size = 0;
+    append(values, count);
+  }
+  //----------------------------------------------------------------------------
+  auto steal(small_buffer &other) -> void {
+    if (other.m_heap) {
+      m_heap     = std::move(other.m_heap);
+      m_capacity = other.m_capacity;
+      m_size     = other.m_size;
+    } else {
+      assign(other.m_inline, other.m_size);
+    }
+    other.m_capacity = InlineCapacity;
+    other.m_size     = 0;
+  }
+  //----------------------------------------------------------------------------
+  std::unique_ptr<T[]> m_heap;
+  std::size_t          m_size     = 0;
+  std::size_t          m_capacity = InlineCapacity;
+  T                    m_inline[InlineCapacity];
+};
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
@@ -0,0 +1,216 @@
+#pragma once
+//==============================================================================
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <span>
+#include <thread>
+
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+namespace detail {
+/// Sleeps while word holds expected, at most timeout. The word may live in
+/// memory that other processes share, so the futex is not private.
+inline void futex_wait(std::atomic<std::uint32_t> &word,
+                       std::uint32_t const         expected,
+                       std::chrono::nanoseconds const timeout) {
+  auto const seconds = std::chrono::floor<std::chrono::seconds>(timeout);
+  auto const ts      = timespec{
+      static_cast<time_t>(seconds.count()),
+      static_cast<long>((timeout - seconds).count())};
+  ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT,
+            expected, &ts, nullptr, 0);
+}
+//------------------------------------------------------------------------------
+inline void futex_wake_all(std::atomic<std::uint32_t> &word) {
+  ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE,
+            INT_MAX, nullptr, nullptr, 0);
+}
+} // namespace detail
+//==============================================================================
+/// Indices and wake up words of a spsc_ring. Lives next to the ring's bytes,
+/// in memory that may be shared between processes, and starts zeroed.
+struct spsc_ring_control {
+  // Written by the producer
+  alignas(64) std::atomic<std::uint64_t> tail{0};
+  std::atomic<std::uint32_t> data_signal{0};
+  std::atomic<std::uint32_t> producer_waiting{0};
+  // Written by the consumer
+  alignas(64) std::atomic<std::uint64_t> head{0};
+  std::atomic<std::uint32_t> space_signal{0};
+  std::atomic<std::uint32_t> consumer_waiting{0};
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free &&
+                  std::atomic<std::uint32_t>::is_always_lock_free,
+              "ring indices must work across processes");
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+//==============================================================================
+/// Ring of bytes for one producer and one consumer, which may be different
+/// processes that map the same memory. Linux only.
+///
+/// The producer appends frames made of several parts and publishes each
+/// frame with a single store of the tail, so the consumer never sees half a
+/// frame. Both sides only spin on their own cache line until they run out
+/// of data or room. Then they announce that they sleep on a futex, and only
+/// a peer that sees the announcement pays for the system call that wakes
+/// them, like mpsc_queue does within a process.
+class spsc_ring {
+ public:
+  /// capacity has to be a power of two.
+  spsc_ring(spsc_ring_control &control, std::byte *data,
+            std::size_t const capacity)
+      : m_control{&control},
+        m_data{data},
+        m_mask{capacity - 1},
+        m_cached_head{control.head.load(std::memory_order_acquire)} {}
+  //----------------------------------------------------------------------------
+  auto capacity() const { return m_mask + 1; }
+  //============================================================================
+  // producer
+  //============================================================================
+  /// Appends the parts as one frame unless there is no room for all of them.
+  auto try_write(std::initializer_list<std::span<std::byte const>> parts)
+      -> bool {
+    auto size = std::size_t{0};
+    for (auto const part : parts) {
+      size += part.size();
+    }
+    auto const tail = m_control->tail.load(std::memory_order_relaxed);
+    if (size > capacity() - (tail - m_cached_head)) {
+      m_cached_head = m_control->head.load(std::memory_order_acquire);
+      if (size > capacity() - (tail - m_cached_head)) {
+        return false;
+      }
+    }
+    auto position = tail;
+    for (auto const part : parts) {
+      copy_in(position, part);
+      position += part.size();
+    }
+    m_control->tail.store(position, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_control->consumer_waiting.load(std::memory_order_relaxed) != 0) {
+      m_control->data_signal.fetch_add(1, std::memory_order_release);
+      detail::futex_wake_all(m_control->data_signal);
+    }
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  /// Spins a while and then sleeps until the consumer made room, at most
+  /// timeout.
+  void wait_for_space(std::size_t const size,
+                      std::chrono::nanoseconds const timeout) {
+    wait(m_control->space_signal, m_control->producer_waiting, timeout,
+         [&] {
+           return capacity() -
+                      (m_control->tail.load(std::memory_order_relaxed) -
+                       m_control->head.load(std::memory_order_acquire)) >=
+                  size;
+         });
+  }
+  //============================================================================
+  // consumer
+  //============================================================================
+  /// Bytes of complete frames that can be read.
+  auto readable() const -> std::size_t {
+    return m_control->tail.load(std::memory_order_acquire) -
+           m_control->head.load(std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  /// Copies out.size() bytes that start offset bytes after the head, which
+  /// have to be readable.
+  void peek(std::size_t const offset, std::span<std::byte> const out) const {
+    auto const position =
+        m_control->head.load(std::memory_order_relaxed) + offset;
+    auto const first = position & m_mask;
+    auto const n     = std::min(out.size(), capacity() - first);
+    std::memcpy(out.data(), m_data + first, n);
+    std::memcpy(out.data() + n, m_data, out.size() - n);
+  }
+  //----------------------------------------------------------------------------
+  /// Gives size read bytes back to the producer.
+  void consume(std::size_t const size) {
+    m_control->head.store(m_control->head.load(std::memory_order_relaxed) +
+                              size,
+                          std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_control->producer_waiting.load(std::memory_order_relaxed) != 0) {
+      m_control->space_signal.fetch_add(1, std::memory_order_release);
+      detail::futex_wake_all(m_control->space_signal);
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Spins a while and then sleeps until something is readable, at most
+  /// timeout.
+  void wait_for_data(std::chrono::nanoseconds const timeout) {
+    wait(m_control->data_signal, m_control->consumer_waiting, timeout,
+         [&] { return readable() != 0; });
+  }
+  //----------------------------------------------------------------------------
+  /// Wakes whoever sleeps on the ring, for example to let them see that the
+  /// channel closed.
+  void wake() {
+    m_control->data_signal.fetch_add(1, std::memory_order_release);
+    detail::futex_wake_all(m_control->data_signal);
+    m_control->space_signal.fetch_add(1, std::memory_order_release);
+    detail::futex_wake_all(m_control->space_signal);
+  }
+
+ private:
+  /// Polls this often before sleeping, a message of a busy peer is usually
+  /// there within a few microseconds. A single core cannot run the peer
+  /// while spinning, it sleeps right away.
+  static auto spin_count() -> int {
+    static int const count =
+        std::thread::hardware_concurrency() > 1 ? 4096 : 0;
+    return count;
+  }
+  //----------------------------------------------------------------------------
+  void copy_in(std::uint64_t const position,
+               std::span<std::byte const> const part) {
+    auto const first = position & m_mask;
+    auto const n     = std::min(part.size(), capacity() - first);
+    std::memcpy(m_data + first, part.data(), n);
+    std::memcpy(m_data, part.data() + n, part.size() - n);
+  }
+  //----------------------------------------------------------------------------
+  static void wait(std::atomic<std::uint32_t> &signal,
+                   std::atomic<std::uint32_t> &waiting,
+                   std::chrono::nanoseconds const timeout, auto &&ready) {
+    for (int i = 0, n = spin_count(); i < n; ++i) {
+      if (ready()) {
+        return;
+      }
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+    auto const value = signal.load(std::memory_order_acquire);
+    waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+      detail::futex_wait(signal, value, timeout);
+    }
+    waiting.store(0, std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  spsc_ring_control *m_control;
+  std::byte         *m_data;
+  std::size_t        m_mask;
+  // The producer's last look at the head, saves reading the consumer's line
+  std::uint64_t      m_cached_head;
+};
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
@@ -0,0 +1,250 @@
+#pragma once
+//==============================================================================
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+class timing_wheel;
+//------------------------------------------------------------------------------
+namespace detail {
+/// Link of the intrusive, circular lists the slots of a timing_wheel keep.
+struct wheel_link {
+  wheel_link *prev = this;
+  wheel_link *next = this;
+  //----------------------------------------------------------------------------
+  auto linked() const { return next != this; }
+  //----------------------------------------------------------------------------
+  void unlink() {
+    prev->next = next;
+    next->prev = prev;
+    prev       = this;
+    next       = this;
+  }
+  //----------------------------------------------------------------------------
+  /// Inserts node in front of this, which is the back of a list whose head
+  /// this is.
+  void push_back(wheel_link &node) {
+    node.prev  = prev;
+    node.next  = this;
+    prev->next = &node;
+    prev       = &node;
+  }
+};
+} // namespace detail
+//==============================================================================
+/// Timer of a timing_wheel. The owner keeps it alive, scheduling and
+/// cancelling never allocate. The callback is set once and runs on the
+/// thread that advances the wheel, it may schedule its own timer again.
+///
+/// A timer has to be cancelled, or destroyed, on the thread that advances
+/// its wheel.
+class wheel_timer : private detail::wheel_link {
+ public:
+  wheel_timer() = default;
+  explicit wheel_timer(std::function<void()> callback)
+      : m_callback{std::move(callback)} {}
+  //----------------------------------------------------------------------------
+  wheel_timer(wheel_timer const &)                    = delete;
+  auto operator=(wheel_timer const &) -> wheel_timer & = delete;
+  //----------------------------------------------------------------------------
+  ~wheel_timer() { cancel(); }
+  //----------------------------------------------------------------------------
+  void set_callback(std::function<void()> callback) {
+    m_callback = std::move(callback);
+  }
+  auto is_scheduled() const { return m_wheel != nullptr; }
+  //----------------------------------------------------------------------------
+  /// Does nothing if the timer is not scheduled.
+  inline void cancel();
+
+ private:
+  friend class timing_wheel;
+  //----------------------------------------------------------------------------
+  std::function<void()> m_callback;
+  timing_wheel         *m_wheel  = nullptr;
+  std::uint64_t         m_expiry = 0;
+};
+//==============================================================================
+/// Hierarchical timing wheel with millisecond ticks.
+///
+/// Four levels of 256 slots cover 256 ms, 65 s, 4.6 h and 49 days. A timer
+/// is linked into the slot of the coarsest level it needs, which makes
+/// scheduling and cancelling O(1). Timers of a coarse slot move down a level
+/// when the wheel reaches that slot, so every timer is touched at most once
+/// per level. Delays beyond the last level fire at its end and should be
+/// scheduled again.
+///
+/// The wheel does not own a thread. The owner advances it, for example from
+/// a periodic handler on an I/O thread, and timers fire inside advance.
+/// Not thread-safe.
+class timing_wheel {
+ public:
+  using clock      = std::chrono::steady_clock;
+  using resolution = std::chrono::milliseconds;
+  //----------------------------------------------------------------------------
+  static constexpr std::size_t slot_bits = 8;
+  static constexpr std::size_t slots     = std::size_t{1} << slot_bits;
+  static constexpr std::size_t levels    = 4;
+  //----------------------------------------------------------------------------
+  explicit timing_wheel(clock::time_point const start = clock::now())
+      : m_start{start} {}
+  //----------------------------------------------------------------------------
+  timing_wheel(timing_wheel const &)                    = delete;
+  auto operator=(timing_wheel const &) -> timing_wheel & = delete;
+  //----------------------------------------------------------------------------
+  /// Detaches all timers, they count as not scheduled afterwards.
+  ~timing_wheel() { clear(); }
+  //----------------------------------------------------------------------------
+  /// Fires timer delay after now(), at the earliest on the next tick. A
+  /// scheduled timer is moved.
+  void schedule(wheel_timer &timer, resolution const delay) {
+    auto const ticks = delay.count() <= 0
+                           ? std::uint64_t{1}
+                           : static_cast<std::uint64_t>(delay.count());
+    timer.cancel();
+    timer.m_wheel  = this;
+    timer.m_expiry = m_now + ticks;
+    link(timer);
+    ++m_size;
+  }
+  //----------------------------------------------------------------------------
+  void schedule_at(wheel_timer &timer, clock::time_point const when) {
+    schedule(timer, std::chrono::ceil<resolution>(when - now()));
+  }
+  //----------------------------------------------------------------------------
+  /// Advances to time and fires every timer that is due on the way, in
+  /// order of their ticks. Returns how many fired.
+  auto advance(clock::time_point const time) -> std::size_t {
+    auto const target = static_cast<std::uint64_t>(
+        std::max<resolution::rep>(
+            std::chrono::floor<resolution>(time - m_start).count(), 0));
+    auto fired = std::size_t{0};
+    while (m_now < target) {
+      if (m_size == 0) {
+        // Nothing can fire, skip the empty ticks
+        m_now = target;
+        break;
+      }
+      ++m_now;
+      cascade();
+      fired += expire(m_wheels[0][m_now & (slots - 1)]);
+    }
+    return fired;
+  }
+  //----------------------------------------------------------------------------
+  /// The time the wheel advanced to.
+  auto now() const -> clock::time_point {
+    return m_start + resolution{m_now};
+  }
+  /// Number of scheduled timers.
+  auto size() const { return m_size; }
+  auto empty() const { return m_size == 0; }
+  //----------------------------------------------------------------------------
+  /// Cancels all timers without firing them.
+  void clear() {
+    for (auto &level : m_wheels) {
+      for (auto &slot : level) {
+        while (slot.linked()) {
+          detach(*static_cast<wheel_timer *>(slot.next));
+        }
+      }
+    }
+  }
+
+ private:
+  friend class wheel_timer;
+  //----------------------------------------------------------------------------
+  /// Links timer into the slot of the coarsest level that still resolves
+  /// its expiry relative to now.
+  void link(wheel_timer &timer) {
+    auto const delta = timer.m_expiry - m_now;
+    auto       level = std::size_t{0};
+    while (level + 1 < levels && delta >= (std::uint64_t{1}
+                                           << (slot_bits * (level + 1)))) {
+      ++level;
+    }
+    auto expiry = timer.m_expiry;
+    if (level == levels - 1) {
+      // Longer delays fire at the end of the last level
+      expiry = std::min(expiry,
+                        m_now + (std::uint64_t{1} << (slot_bits * levels)) - 1);
+    }
+    auto const slot = (expiry >> (slot_bits * level)) & (slots - 1);
+    m_wheels[level][slot].push_back(timer);
+  }
+  //----------------------------------------------------------------------------
+  /// Moves the timers of every coarse slot whose turn it is one level down.
+  void cascade() {
+    for (std::size_t level = 1; level < levels; ++level) {
+      if ((m_now & ((std::uint64_t{1} << (slot_bits * level)) - 1)) != 0) {
+        break;
+      }
+      auto &slot = m_wheels[level][(m_now >> (slot_bits * level)) & (slots - 1)];
+      auto  list = detail::wheel_link{};
+      splice(slot, list);
+      while (list.linked()) {
+        auto &timer = *static_cast<wheel_timer *>(list.next);
+        timer.unlink();
+        link(timer);
+      }
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Fires all timers of slot. Timers scheduled by callbacks land in other
+  /// slots or in this one for the next turn of the wheel.
+  auto expire(detail::wheel_link &slot) -> std::size_t {
+    auto list = detail::wheel_link{};
+    splice(slot, list);
+    auto fired = std::size_t{0};
+    while (list.linked()) {
+      auto &timer = *static_cast<wheel_timer *>(list.next);
+      detach(timer);
+      ++fired;
+      if (timer.m_callback) {
+        timer.m_callback();
+      }
+    }
+    return fired;
+  }
+  //----------------------------------------------------------------------------
+  void detach(wheel_timer &timer) {
+    timer.unlink();
+    timer.m_wheel = nullptr;
+    --m_size;
+  }
+  //----------------------------------------------------------------------------
+  /// Moves all nodes of from to the empty list to.
+  static void splice(detail::wheel_link &from, detail::wheel_link &to) {
+    if (!from.linked()) {
+      return;
+    }
+    to.next       = from.next;
+    to.prev       = from.prev;
+    to.next->prev = &to;
+    to.prev->next = &to;
+    from.prev     = &from;
+    from.next     = &from;
+  }
+  //----------------------------------------------------------------------------
+  using level = std::array<detail::wheel_link, slots>;
+  //----------------------------------------------------------------------------
+  clock::time_point             m_start;
+  std::uint64_t                 m_now  = 0;
+  std::size_t                   m_size = 0;
+  std::array<level, levels>     m_wheels;
+};
+//------------------------------------------------------------------------------
+void wheel_timer::cancel() {
+  if (m_wheel != nullptr) {
+    m_wheel->detach(*this);
+  }
+}
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
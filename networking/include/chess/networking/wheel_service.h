@@ -0,0 +1,71 @@
+#pragma once
+//==============================================================================
+#include "timing_wheel.h"
+#include <asio.hpp>
+#include <chrono>
+//==============================================================================
+namespace chess::networking {
+//==============================================================================
+/// The timing wheel of an io_context, advanced on the context's thread.
+///
+/// All connections of a context share one wheel and one steady_timer that
+/// ticks at the wheel's resolution while timers are scheduled and stops
+/// when none are left. Scheduling and cancelling must happen on the
+/// context's thread. Shutting the context down detaches all timers.
+///
+///     auto &timers = asio::use_service<wheel_service>(context);
+///     timers.schedule(timer, std::chrono::seconds{30});
+class wheel_service : public asio::execution_context::service {
+ public:
+  using key_type = wheel_service;
+  inline static asio::execution_context::id id;
+  //----------------------------------------------------------------------------
+  explicit wheel_service(asio::io_context &context)
+      : asio::execution_context::service{context}, m_ticker{context} {}
+  //----------------------------------------------------------------------------
+  void schedule(wheel_timer &timer, timing_wheel::resolution const delay) {
+    advance();
+    m_wheel.schedule(timer, delay);
+    start_ticking();
+  }
+  //----------------------------------------------------------------------------
+  auto wheel() -> timing_wheel & { return m_wheel; }
+
+ private:
+  void shutdown() override {
+    m_wheel.clear();
+    m_ticker.cancel();
+  }
+  //----------------------------------------------------------------------------
+  // Catches the wheel up with the clock before a delay is measured from it
+  void advance() {
+    if (!m_ticking) {
+      m_wheel.advance(timing_wheel::clock::now());
+    }
+  }
+  //----------------------------------------------------------------------------
+  void start_ticking() {
+    if (m_ticking || m_wheel.empty()) {
+      return;
+    }
+    m_ticking = true;
+    m_ticker.expires_after(timing_wheel::resolution{1});
+    m_ticker.async_wait([this](std::error_code ec) { tick(ec); });
+  }
+  //----------------------------------------------------------------------------
+  void tick(std::error_code const ec) {
+    m_ticking = false;
+    if (ec) {
+      return;
+    }
+    m_wheel.advance(timing_wheel::clock::now());
+    start_ticking();
+  }
+  //----------------------------------------------------------------------------
+  timing_wheel       m_wheel;
+  asio::steady_timer m_ticker;
+  bool               m_ticking = false;
+};
+//==============================================================================
+} // namespace chess::networking
+//==============================================================================
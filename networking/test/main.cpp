@@ -1,12 +1,36 @@
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 //==============================================================================
 #include <chess/networking/message.h>
+#include <chess/networking/message_router.h>
 #include <chess/networking/server_interface.h>
 #include <chess/networking/client_interface.h>
+#include <chess/networking/local_channel.h>
+#include <chess/networking/mpsc_queue.h>
 #include <chess/networking/queue.h>
+#include <chess/networking/timing_wheel.h>
 //==============================================================================
 enum class message_tag { A, B, C };
+//------------------------------------------------------------------------------
+template <>
+struct chess::networking::message_limits<message_tag> {
+  static constexpr auto max_body_size(message_tag const tag) -> std::uint32_t {
+    return tag == message_tag::C ? 16 : 1024;
+  }
+};
+template <>
+struct chess::networking::message_tag_count<message_tag>
+    : std::integral_constant<std::size_t, 3> {};
 
+using chess::networking::mpsc_queue;
 using chess::networking::queue;
 using chess::networking::server_interface;
 using chess::networking::client_interface;
@@ -25,14 +49,252 @@ TEST_CASE( "queue::enque, queue:dequeue" ) {
   REQUIRE(q.front().header.tag == message_tag::C);
 }
 //==============================================================================
+TEST_CASE( "mpsc_queue" ) {
+  mpsc_queue<std::unique_ptr<int>> q{5};
+  REQUIRE(q.capacity() == 8);
+  REQUIRE(q.empty());
+  REQUIRE_FALSE(q.try_dequeue());
+
+  for (int i = 0; i < 8; ++i) {
+    REQUIRE(q.try_emplace(std::make_unique<int>(i)));
+  }
+  auto rejected = std::make_unique<int>(8);
+  REQUIRE_FALSE(q.try_enqueue(rejected));
+  REQUIRE(rejected != nullptr);
+  REQUIRE(q.size() == 8);
+
+  auto first = q.try_dequeue();
+  REQUIRE(first);
+  REQUIRE(**first == 0);
+  REQUIRE(q.try_enqueue(rejected));
+  REQUIRE(rejected == nullptr);
+
+  std::vector<std::unique_ptr<int>> batch;
+  REQUIRE(q.dequeue_bulk(std::back_inserter(batch), 5) == 5);
+  REQUIRE(q.dequeue_bulk(std::back_inserter(batch), 5) == 3);
+  REQUIRE(q.empty());
+  for (int i = 0; i < 8; ++i) {
+    REQUIRE(*batch[i] == i + 1);
+  }
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "mpsc_queue with blocking consumer" ) {
+  auto constexpr producer_count = 4;
+  auto constexpr item_count     = 20000;
+  mpsc_queue<std::pair<int, int>> q{64};
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < producer_count; ++p) {
+    producers.emplace_back([&q, p] {
+      for (int i = 0; i < item_count; ++i) {
+        q.enqueue({p, i});
+        if (i % 1000 == 0) {
+          std::this_thread::sleep_for(std::chrono::microseconds{200});
+        }
+      }
+    });
+  }
+  // Items of every producer arrive complete and in order
+  std::vector<int> next(producer_count, 0);
+  auto in_order = true;
+  auto received = 0;
+  while (received < producer_count * item_count) {
+    q.wait();
+    received += static_cast<int>(q.consume(32, [&](std::pair<int, int> &&item) {
+      in_order = in_order && item.second == next[item.first]++;
+    }));
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  REQUIRE(in_order);
+  REQUIRE(q.empty());
+
+  // wake releases a consumer that waits on an empty queue
+  auto waiter = std::thread{[&q] { q.wait(); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  q.wake();
+  waiter.join();
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "timing_wheel" ) {
+  using chess::networking::timing_wheel;
+  using chess::networking::wheel_timer;
+  using std::chrono::milliseconds;
+  auto const start = timing_wheel::clock::now();
+  auto       wheel = timing_wheel{start};
+  auto       fired = std::vector<int>{};
+
+  wheel_timer a{[&] { fired.push_back(1); }};
+  wheel_timer b{[&] { fired.push_back(2); }};
+  wheel_timer c{[&] { fired.push_back(3); }};
+  wheel.schedule(a, milliseconds{10});
+  wheel.schedule(b, milliseconds{5});
+  wheel.schedule(c, milliseconds{7});
+  REQUIRE(wheel.size() == 3);
+  c.cancel();
+  REQUIRE_FALSE(c.is_scheduled());
+  REQUIRE(wheel.size() == 2);
+
+  REQUIRE(wheel.advance(start + milliseconds{4}) == 0);
+  REQUIRE(wheel.advance(start + milliseconds{10}) == 2);
+  REQUIRE(fired == std::vector<int>{2, 1});
+  REQUIRE(wheel.empty());
+
+  // Timers beyond the first level cascade down and fire on their tick
+  fired.clear();
+  wheel.schedule(a, milliseconds{300});
+  wheel.schedule(b, milliseconds{70000});
+  wheel.advance(start + milliseconds{309});
+  REQUIRE(fired.empty());
+  wheel.advance(start + milliseconds{310});
+  REQUIRE(fired == std::vector<int>{1});
+  wheel.advance(start + milliseconds{70009});
+  REQUIRE(fired.size() == 1);
+  wheel.advance(start + milliseconds{70010});
+  REQUIRE(fired == std::vector<int>{1, 2});
+
+  // A callback may schedule its own timer again
+  auto       count  = 0;
+  wheel_timer repeat;
+  repeat.set_callback([&] {
+    if (++count < 5) {
+      wheel.schedule(repeat, milliseconds{100});
+    }
+  });
+  wheel.schedule(repeat, milliseconds{100});
+  wheel.advance(start + milliseconds{80000});
+  REQUIRE(count == 5);
+  REQUIRE(wheel.empty());
+
+  // Destroyed timers leave the wheel
+  {
+    wheel_timer temporary{[&] { fired.push_back(4); }};
+    wheel.schedule(temporary, milliseconds{1000});
+  }
+  REQUIRE(wheel.empty());
+}
+//==============================================================================
 TEST_CASE( "message" ) {
   using message = chess::networking::message<message_tag>;
   auto msgA = message{message_tag::A};
   msgA << 1.0f << 2.0;
-  double r0; float r1;
+  REQUIRE(msgA.header.size() == sizeof(float) + sizeof(double));
+  REQUIRE(msgA.size() == sizeof(msgA.header) + msgA.header.size());
+  float r0; double r1;
   msgA >> r0 >> r1;
-  REQUIRE(r0 == 2.0);
-  REQUIRE(r1 == 1.0f);
+  REQUIRE(r0 == 1.0f);
+  REQUIRE(r1 == 2.0);
+  REQUIRE(msgA.remaining() == 0);
+  REQUIRE_THROWS_AS(msgA >> r0, std::out_of_range);
+  msgA.rewind();
+  msgA >> r0;
+  REQUIRE(r0 == 1.0f);
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "message wire layout" ) {
+  using message = chess::networking::message<message_tag>;
+  auto msg = message{message_tag::B};
+  msg << std::uint16_t{0x0102} << std::uint32_t{0x03040506};
+  REQUIRE(msg.body.size() == 6);
+  auto const expected = std::array<std::uint8_t, 6>{2, 1, 6, 5, 4, 3};
+  REQUIRE(std::equal(msg.body.begin(), msg.body.end(), expected.begin()));
+
+  // Small bodies stay inline, larger ones move to the heap and survive
+  // copies and moves
+  REQUIRE(msg.body.is_inline());
+  msg << std::array<std::uint8_t, message::inline_body_size>{7};
+  REQUIRE_FALSE(msg.body.is_inline());
+  auto copy  = msg;
+  auto moved = std::move(msg);
+  REQUIRE(moved.body.size() == copy.body.size());
+  REQUIRE(std::equal(moved.body.begin(), moved.body.end(), copy.body.begin()));
+  REQUIRE(copy.body[6] == 7);
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "fixed_message" ) {
+  using move_message = chess::networking::fixed_message<message_tag::C,
+                                                        std::uint16_t,
+                                                        std::int32_t>;
+  static_assert(move_message::body_size == 6);
+  static_assert(move_message::fits_inline);
+
+  auto msg = move_message::encode(0x1234, -5);
+  REQUIRE(msg.header.tag == message_tag::C);
+  REQUIRE(msg.header.body_size == 6);
+  REQUIRE(msg.body.is_inline());
+
+  auto const values = move_message::decode(msg);
+  REQUIRE(values);
+  REQUIRE(std::get<0>(*values) == 0x1234);
+  REQUIRE(std::get<1>(*values) == -5);
+
+  msg << std::uint8_t{0};
+  REQUIRE_FALSE(move_message::decode(msg));
+  REQUIRE_FALSE(move_message::decode(
+      chess::networking::message<message_tag>{message_tag::A}));
+}
+//------------------------------------------------------------------------------
+// Layout that decodes into a struct instead of a tuple
+struct chat_layout {
+  using tag_t            = message_tag;
+  static constexpr auto tag = message_tag::B;
+  struct payload {
+    std::string text;
+  };
+  static auto decode(chess::networking::message<message_tag> const &msg)
+      -> std::optional<payload> {
+    return payload{{reinterpret_cast<char const *>(msg.body.data()),
+                    msg.body.size()}};
+  }
+};
+//------------------------------------------------------------------------------
+TEST_CASE( "message_router" ) {
+  namespace net        = chess::networking;
+  using clock_message  = net::fixed_message<message_tag::A, std::int32_t>;
+  using move_message   = net::fixed_message<message_tag::C, std::uint16_t,
+                                            std::int32_t>;
+  using client_ptr     = std::shared_ptr<net::connection<message_tag>>;
+  struct handler {
+    std::vector<std::string> calls;
+    void on_message(clock_message, client_ptr const &, std::int32_t ms) {
+      calls.push_back("clock " + std::to_string(ms));
+    }
+    void on_message(move_message, client_ptr const &, std::uint16_t move,
+                    std::int32_t ms) {
+      calls.push_back("move " + std::to_string(move) + " " +
+                      std::to_string(ms));
+    }
+    void on_message(chat_layout, client_ptr const &,
+                    chat_layout::payload const &chat) {
+      calls.push_back("chat " + chat.text);
+    }
+  };
+  using router_t =
+      net::message_router<handler, move_message, clock_message, chat_layout>;
+  static_assert(router_t::routes(message_tag::A));
+  static_assert(!router_t::routes(static_cast<message_tag>(7)));
+
+  auto h      = handler{};
+  auto router = router_t{h};
+  REQUIRE(router.dispatch(nullptr, clock_message::encode(1500)));
+  REQUIRE(router.dispatch(nullptr, move_message::encode(12, -3)));
+  auto chat = net::message<message_tag>{message_tag::B};
+  chat << std::array<char, 2>{'h', 'i'};
+  REQUIRE(router.dispatch(nullptr, chat));
+  REQUIRE(h.calls ==
+          std::vector<std::string>{"clock 1500", "move 12 -3", "chat hi"});
+
+  // Malformed bodies and unknown tags are not passed on
+  REQUIRE_FALSE(
+      router.dispatch(nullptr, net::message<message_tag>{message_tag::A}));
+  REQUIRE_FALSE(router.dispatch(
+      nullptr, net::message<message_tag>{static_cast<message_tag>(7)}));
+  REQUIRE(h.calls.size() == 3);
+
+  // A server hands its incoming messages to the router instead
+  server_interface<message_tag> server{8086, 1};
+  REQUIRE(server.update(router) == 0);
 }
 //==============================================================================
 TEST_CASE( "server-client" ) {
@@ -47,3 +309,716 @@ TEST_CASE( "server-client" ) {
     client.send(message{message_tag::A});
   }
 }
+//==============================================================================
+template <typename MessageTag>
+struct accepting_server : server_interface<MessageTag> {
+  using server_interface<MessageTag>::server_interface;
+  std::vector<chess::networking::owned_message<MessageTag>> received;
+ protected:
+  bool on_client_connect(
+      std::shared_ptr<chess::networking::connection<MessageTag>>) override {
+    return true;
+  }
+  void on_message(
+      std::shared_ptr<chess::networking::connection<MessageTag>> client,
+      chess::networking::message<MessageTag> &msg) override {
+    received.emplace_back(std::move(client), msg);
+  }
+};
+//------------------------------------------------------------------------------
+TEST_CASE( "server with io_context pool" ) {
+  using message = chess::networking::message<message_tag>;
+  accepting_server<message_tag> server{8081, 4};
+  REQUIRE(server.thread_count() == 4);
+  REQUIRE(server.start());
+
+  auto constexpr client_count = 8;
+  std::vector<std::unique_ptr<client_interface<message_tag>>> clients;
+  for (int i = 0; i < client_count; ++i) {
+    clients.push_back(std::make_unique<client_interface<message_tag>>());
+    clients.back()->connect("localhost", 8081);
+  }
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  auto wait_until = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return condition();
+  };
+  REQUIRE(wait_until([&] {
+    for (auto &client : clients) {
+      if (!client->is_connected()) {
+        return false;
+      }
+    }
+    return server.connection_count() == client_count;
+  }));
+
+  for (auto &client : clients) {
+    auto msg = message{message_tag::B};
+    msg << 42;
+    client->send(msg);
+  }
+  // The game loop sleeps until the first message is in
+  REQUIRE(server.update(client_count, true) >= 1);
+  REQUIRE(wait_until([&] {
+    server.update();
+    return server.received.size() == client_count;
+  }));
+  for (auto const &msg : server.received) {
+    REQUIRE(msg.header.tag == message_tag::B);
+    REQUIRE(msg.body.size() == sizeof(int));
+    REQUIRE(msg.remote != nullptr);
+  }
+  auto const &first = server.received.front().remote;
+  REQUIRE(server.find_client(first->get_id()) == first);
+  REQUIRE(server.find_client(1) == nullptr);
+
+  // Broadcasts go out on every connection's own thread
+  server.message_all_clients(message{message_tag::C});
+  REQUIRE(wait_until([&] {
+    for (auto &client : clients) {
+      if (client->incoming().empty()) {
+        return false;
+      }
+    }
+    return true;
+  }));
+}
+//------------------------------------------------------------------------------
+template <typename MessageTag>
+struct inspectable_client : client_interface<MessageTag> {
+  auto writes() const { return this->m_connection->write_count(); }
+};
+//------------------------------------------------------------------------------
+TEST_CASE( "connection coalesces queued messages" ) {
+  using message = chess::networking::message<message_tag>;
+  accepting_server<message_tag> server{8082, 2};
+  REQUIRE(server.start());
+  inspectable_client<message_tag> client;
+  client.connect("localhost", 8082);
+
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  while (!client.is_connected() &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  REQUIRE(client.is_connected());
+
+  auto constexpr message_count = 500;
+  for (int i = 0; i < message_count; ++i) {
+    auto msg = message{message_tag::A};
+    msg << i;
+    client.send(msg);
+  }
+  while (server.received.size() < message_count &&
+         std::chrono::steady_clock::now() < deadline) {
+    server.update();
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  REQUIRE(server.received.size() == message_count);
+  auto in_order = true;
+  for (int i = 0; i < message_count; ++i) {
+    int value = -1;
+    server.received[i] >> value;
+    in_order = in_order && value == i;
+  }
+  REQUIRE(in_order);
+  REQUIRE(client.writes() < message_count);
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "connection rejects oversized frames" ) {
+  using message = chess::networking::message<message_tag>;
+  accepting_server<message_tag> server{8083, 1};
+  REQUIRE(server.start());
+  client_interface<message_tag> client;
+  client.connect("localhost", 8083);
+
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  while (!client.is_connected() &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  REQUIRE(client.is_connected());
+
+  auto allowed = message{message_tag::A};
+  allowed << std::array<std::uint8_t, 1000>{};
+  client.send(allowed);
+  while (server.received.empty() &&
+         std::chrono::steady_clock::now() < deadline) {
+    server.update();
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  REQUIRE(server.received.size() == 1);
+  REQUIRE(server.received.front().body.size() == 1000);
+
+  // 32 bytes are too many for C, the server hangs up before reading them
+  auto oversized = message{message_tag::C};
+  oversized << std::array<std::uint8_t, 32>{};
+  client.send(oversized);
+  while (client.is_connected() &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  REQUIRE_FALSE(client.is_connected());
+  server.update();
+  REQUIRE(server.received.size() == 1);
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "broadcast to channel subscribers" ) {
+  using message = chess::networking::message<message_tag>;
+  accepting_server<message_tag> server{8084, 2};
+  REQUIRE(server.start());
+
+  auto constexpr client_count = 4;
+  std::vector<std::unique_ptr<client_interface<message_tag>>> clients;
+  for (int i = 0; i < client_count; ++i) {
+    clients.push_back(std::make_unique<client_interface<message_tag>>());
+    clients.back()->connect("localhost", 8084);
+  }
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  auto wait_until = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return condition();
+  };
+  REQUIRE(wait_until([&] {
+    return std::ranges::all_of(clients, [](auto &c) { return c->is_connected(); });
+  }));
+
+  // Every client introduces itself so the server knows who is who
+  for (int i = 0; i < client_count; ++i) {
+    auto msg = message{message_tag::A};
+    msg << i;
+    clients[i]->send(msg);
+  }
+  REQUIRE(wait_until([&] {
+    server.update();
+    return server.received.size() == client_count;
+  }));
+  std::vector<std::shared_ptr<chess::networking::connection<message_tag>>>
+      remotes(client_count);
+  for (auto &msg : server.received) {
+    int i = -1;
+    msg >> i;
+    remotes[i] = msg.remote;
+  }
+  for (int i = 0; i < 3; ++i) {
+    server.subscribe("game/1", remotes[i]);
+  }
+  server.subscribe("game/1", remotes[0]);
+  REQUIRE(server.subscriber_count("game/1") == 3);
+
+  auto move = message{message_tag::B};
+  move << std::uint16_t{0x0c1c};
+  REQUIRE(server.broadcast("game/1", move, remotes[2]) == 3);
+  REQUIRE(server.broadcast("game/2", move) == 0);
+  REQUIRE(wait_until([&] {
+    return !clients[0]->incoming().empty() && !clients[1]->incoming().empty();
+  }));
+  server.message_all_clients(message{message_tag::C});
+  REQUIRE(wait_until([&] {
+    return clients[0]->incoming().size() == 2 &&
+           clients[1]->incoming().size() == 2 &&
+           !clients[2]->incoming().empty() && !clients[3]->incoming().empty();
+  }));
+
+  auto tags_of = [](auto &client) {
+    std::vector<message_tag> tags;
+    while (!client->incoming().empty()) {
+      auto next = client->incoming().try_dequeue();
+      if (next) {
+        tags.push_back(next->header.tag);
+      }
+    }
+    return tags;
+  };
+  using tags = std::vector<message_tag>;
+  auto const first = tags_of(clients[0]);
+  REQUIRE(first == tags{message_tag::B, message_tag::C});
+  REQUIRE(tags_of(clients[1]) == tags{message_tag::B, message_tag::C});
+  REQUIRE(tags_of(clients[2]) == tags{message_tag::C});
+  REQUIRE(tags_of(clients[3]) == tags{message_tag::C});
+
+  server.unsubscribe("game/1", remotes[0]);
+  REQUIRE(server.subscriber_count("game/1") == 2);
+  server.unsubscribe_all(remotes[1]);
+  server.unsubscribe_all(remotes[2]);
+  REQUIRE(server.subscriber_count("game/1") == 0);
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "connection backpressure" ) {
+  using message    = chess::networking::message<message_tag>;
+  using connection = chess::networking::connection<message_tag>;
+  namespace net    = chess::networking;
+
+  // The context never runs, so nothing is written and every message stays
+  // in the outgoing queue
+  asio::io_context context;
+  auto socket = asio::ip::tcp::socket{context};
+  socket.open(asio::ip::tcp::v4());
+  net::mpsc_queue<net::owned_message<message_tag>> incoming;
+
+  auto const frame = sizeof(net::message_header<message_tag>) + sizeof(int);
+  auto write       = net::write_options{};
+  write.flush_threshold = static_cast<std::size_t>(-1);
+  auto limits = net::backpressure_options{};
+  limits.max_queued_messages = 4;
+  limits.high_watermark      = 3 * frame;
+  limits.low_watermark       = frame;
+  limits.on_overflow         = net::overflow_policy::drop_oldest;
+
+  auto conn = std::make_shared<connection>(
+      connection::owner::server, context, std::move(socket), incoming, write,
+      limits);
+  std::vector<bool> congestion;
+  conn->set_backpressure_handler(
+      [&](connection &, bool congested) { congestion.push_back(congested); });
+  conn->connect_to_client(1);
+
+  auto make = [](message_tag tag, int value) {
+    auto msg = message{tag};
+    msg << value;
+    return std::make_shared<message const>(std::move(msg));
+  };
+  auto const clock     = net::send_policy{.coalesce_key = 7};
+  auto const spectator = net::send_policy{.droppable = true};
+
+  // Only the latest clock of a game waits in the queue
+  for (int i = 0; i < 3; ++i) {
+    conn->enqueue_on_context(make(message_tag::A, i), clock);
+  }
+  REQUIRE(conn->coalesced_count() == 2);
+
+  conn->enqueue_on_context(make(message_tag::B, 0), spectator);
+  REQUIRE_FALSE(conn->is_congested());
+  conn->enqueue_on_context(make(message_tag::B, 1), spectator);
+  REQUIRE(conn->is_congested());
+  REQUIRE(congestion == std::vector<bool>{true});
+
+  // Essential messages push out the oldest droppable ones...
+  conn->enqueue_on_context(make(message_tag::C, 0));
+  conn->enqueue_on_context(make(message_tag::C, 1));
+  REQUIRE(conn->dropped_count() == 1);
+  conn->enqueue_on_context(make(message_tag::C, 2));
+  REQUIRE(conn->dropped_count() == 2);
+
+  // ...a droppable message that finds no room is dropped itself...
+  conn->enqueue_on_context(make(message_tag::B, 2), spectator);
+  REQUIRE(conn->dropped_count() == 3);
+  REQUIRE(conn->is_connected());
+
+  // ...and a peer that cannot take essential messages anymore is cut off
+  conn->enqueue_on_context(make(message_tag::C, 3));
+  REQUIRE(conn->dropped_count() == 4);
+  REQUIRE_FALSE(conn->is_connected());
+}
+//------------------------------------------------------------------------------
+template <typename MessageTag>
+struct inspectable_connection : chess::networking::connection<MessageTag> {
+  using chess::networking::connection<MessageTag>::connection;
+  auto queue_length() const { return this->m_messages_out.size(); }
+};
+//------------------------------------------------------------------------------
+TEST_CASE( "connection drops without growing its queue" ) {
+  using message    = chess::networking::message<message_tag>;
+  using connection = inspectable_connection<message_tag>;
+  namespace net    = chess::networking;
+
+  // A peer that never reads, nothing leaves the queue
+  asio::io_context context;
+  auto socket = asio::ip::tcp::socket{context};
+  socket.open(asio::ip::tcp::v4());
+  net::mpsc_queue<net::owned_message<message_tag>> incoming;
+  auto write = net::write_options{};
+  write.flush_threshold = static_cast<std::size_t>(-1);
+  auto limits = net::backpressure_options{};
+  limits.max_queued_messages = 8;
+  limits.on_overflow         = net::overflow_policy::drop_oldest;
+  auto conn = std::make_shared<connection>(
+      connection::owner::server, context, std::move(socket), incoming, write,
+      limits);
+  conn->connect_to_client(1);
+
+  auto const spectator = net::send_policy{.droppable = true};
+  auto longest = std::size_t{0};
+  for (int i = 0; i < 10000; ++i) {
+    auto msg = message{message_tag::B};
+    msg << i;
+    conn->enqueue_on_context(
+        std::make_shared<message const>(std::move(msg)),
+        i % 4 == 0 ? net::send_policy{.coalesce_key = 9} : spectator);
+    longest = std::max(longest, conn->queue_length());
+  }
+  REQUIRE(conn->is_connected());
+  REQUIRE(longest == 8);
+  REQUIRE(conn->queue_length() + conn->dropped_count() +
+              conn->coalesced_count() ==
+          10000);
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "coroutine connections" ) {
+  using message = chess::networking::message<message_tag>;
+  namespace net = chess::networking;
+  accepting_server<message_tag> server{8085, 2};
+  auto io         = net::io_options{};
+  io.model        = net::io_model::coroutines;
+  io.idle_timeout = std::chrono::milliseconds{300};
+  server.set_io_options(io);
+  REQUIRE(server.start());
+
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  auto wait_until = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return condition();
+  };
+
+  client_interface<message_tag> client;
+  client.connect("localhost", 8085,
+                 net::io_options{.model = net::io_model::coroutines});
+  REQUIRE(wait_until([&] {
+    return client.is_connected() && server.connection_count() == 1;
+  }));
+
+  auto constexpr message_count = 100;
+  for (int i = 0; i < message_count; ++i) {
+    auto msg = message{message_tag::A};
+    msg << i;
+    client.send(msg);
+  }
+  REQUIRE(wait_until([&] {
+    server.update();
+    return server.received.size() == message_count;
+  }));
+  auto in_order = true;
+  for (int i = 0; i < message_count; ++i) {
+    int value = -1;
+    server.received[i] >> value;
+    in_order = in_order && value == i;
+  }
+  REQUIRE(in_order);
+
+  server.message_all_clients(message{message_tag::B});
+  REQUIRE(wait_until([&] { return !client.incoming().empty(); }));
+
+  // The client stays silent, so the server hangs up after the idle timeout
+  REQUIRE(wait_until([&] { return !client.is_connected(); }));
+}
+//------------------------------------------------------------------------------
+template <typename MessageTag>
+struct resuming_server : accepting_server<MessageTag> {
+  using accepting_server<MessageTag>::accepting_server;
+  std::atomic<int> resumed  = 0;
+  std::atomic<int> restarted = 0;
+ protected:
+  void on_client_resume(
+      std::shared_ptr<chess::networking::connection<MessageTag>>,
+      bool const replayed) override {
+    ++(replayed ? resumed : restarted);
+  }
+};
+//------------------------------------------------------------------------------
+void check_resumable_sessions(chess::networking::io_model const model,
+                              std::uint16_t const port) {
+  using message = chess::networking::message<message_tag>;
+  namespace net = chess::networking;
+  auto io = net::io_options{.model = model};
+  io.resume.enabled         = true;
+  io.resume.replay_messages = 8;
+  io.resume.linger          = std::chrono::milliseconds{300};
+  resuming_server<message_tag> server{port, 2};
+  server.set_io_options(io);
+  REQUIRE(server.start());
+
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{10};
+  auto wait_until = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return condition();
+  };
+  auto send_all = [&](int first, int last) {
+    for (int i = first; i <= last; ++i) {
+      auto msg = message{message_tag::A};
+      msg << i;
+      server.message_all_clients(msg);
+    }
+  };
+  client_interface<message_tag> client;
+  std::vector<int> values;
+  auto receive = [&](std::size_t count) {
+    return wait_until([&] {
+      client.incoming().consume(count, [&](auto &&msg) {
+        int value = -1;
+        msg >> value;
+        values.push_back(value);
+      });
+      return values.size() >= count;
+    });
+  };
+
+  client.connect("localhost", port, io);
+  REQUIRE(wait_until([&] {
+    return client.is_connected() && server.connection_count() == 1;
+  }));
+  REQUIRE_FALSE(client.session_resumed());
+  send_all(1, 3);
+  REQUIRE(receive(3));
+
+  // Messages sent while the client is gone arrive once it is back, and only
+  // those
+  client.disconnect();
+  send_all(4, 6);
+  client.connect("localhost", port, io);
+  REQUIRE(receive(6));
+  REQUIRE(values == std::vector<int>{1, 2, 3, 4, 5, 6});
+  REQUIRE(client.session_resumed());
+  REQUIRE(server.resumed == 1);
+  REQUIRE(server.connection_count() == 1);
+
+  // Too much was missed, the client starts over from the current state
+  client.disconnect();
+  send_all(7, 20);
+  client.connect("localhost", port, io);
+  REQUIRE(wait_until([&] { return server.restarted == 1; }));
+  REQUIRE(client.is_connected());
+  REQUIRE_FALSE(client.session_resumed());
+  send_all(21, 21);
+  REQUIRE(receive(7));
+  REQUIRE(values.back() == 21);
+
+  // The replay ring wrapped around meanwhile
+  client.disconnect();
+  send_all(22, 25);
+  client.connect("localhost", port, io);
+  REQUIRE(receive(11));
+  REQUIRE(std::vector<int>(values.begin() + 6, values.end()) ==
+          std::vector<int>{21, 22, 23, 24, 25});
+  REQUIRE(server.resumed == 2);
+
+  // A session the client did not resume in time is gone
+  client.disconnect();
+  REQUIRE(wait_until([&] {
+    server.message_all_clients(message{message_tag::B});
+    return server.connection_count() == 0;
+  }));
+  client.connect("localhost", port, io);
+  REQUIRE(wait_until([&] { return server.connection_count() == 1; }));
+  REQUIRE(server.resumed == 2);
+  REQUIRE_FALSE(client.session_resumed());
+}
+//------------------------------------------------------------------------------
+void check_coalesced_session_messages(chess::networking::io_model const model,
+                                      std::uint16_t const port) {
+  using message = chess::networking::message<message_tag>;
+  namespace net = chess::networking;
+  auto io = net::io_options{.model = model};
+  io.resume.enabled = true;
+  resuming_server<message_tag> server{port, 1};
+  server.set_io_options(io);
+  REQUIRE(server.start());
+
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{10};
+  auto wait_until = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return condition();
+  };
+  client_interface<message_tag> client;
+  client.connect("localhost", port, io);
+  REQUIRE(wait_until([&] {
+    return client.is_connected() && server.connection_count() == 1;
+  }));
+  client.send(message{message_tag::A});
+  REQUIRE(wait_until([&] {
+    server.update();
+    return !server.received.empty();
+  }));
+  auto const session = server.received.front().remote;
+
+  // A clock update, a move and a newer clock update wait in the queue
+  // together. The newer clock replaces the older one and goes out last with
+  // the highest number, so the move in between still arrives.
+  auto make = [](int value) {
+    auto msg = message{message_tag::A};
+    msg << value;
+    return std::make_shared<message const>(std::move(msg));
+  };
+  auto const clock = net::send_policy{.coalesce_key = 7};
+  asio::post(session->context(), [session, clock, make] {
+    session->enqueue_on_context(make(1), clock);
+    session->enqueue_on_context(make(2));
+    session->enqueue_on_context(make(3), clock);
+  });
+  std::vector<int> values;
+  REQUIRE(wait_until([&] {
+    client.incoming().consume(16, [&](auto &&msg) {
+      int value = -1;
+      msg >> value;
+      values.push_back(value);
+    });
+    return values.size() >= 2;
+  }));
+  REQUIRE(values == std::vector<int>{2, 3});
+  REQUIRE(session->coalesced_count() == 1);
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "resumable sessions" ) {
+  check_resumable_sessions(chess::networking::io_model::callbacks, 8087);
+  check_resumable_sessions(chess::networking::io_model::coroutines, 8088);
+  check_coalesced_session_messages(chess::networking::io_model::callbacks,
+                                   8092);
+  check_coalesced_session_messages(chess::networking::io_model::coroutines,
+                                   8093);
+}
+//------------------------------------------------------------------------------
+template <typename MessageTag>
+struct stalled_server : accepting_server<MessageTag> {
+  using accepting_server<MessageTag>::accepting_server;
+  auto backlog() const { return this->m_messages_in.size(); }
+  auto capacity() const { return this->m_messages_in.capacity(); }
+};
+//------------------------------------------------------------------------------
+TEST_CASE( "a full incoming queue pauses reading" ) {
+  using message = chess::networking::message<message_tag>;
+  // One network thread serves both clients
+  stalled_server<message_tag> server{8094, 1};
+  REQUIRE(server.start());
+
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{10};
+  auto wait_until = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return condition();
+  };
+  client_interface<message_tag> flooding;
+  client_interface<message_tag> other;
+  flooding.connect("localhost", 8094);
+  other.connect("localhost", 8094);
+  REQUIRE(wait_until([&] {
+    return flooding.is_connected() && other.is_connected() &&
+           server.connection_count() == 2;
+  }));
+
+  // The game loop does not run while one client sends more than fits, in
+  // portions its own outgoing queue can take
+  auto const message_count = static_cast<int>(server.capacity()) + 2000;
+  for (int i = 0; i < message_count; ++i) {
+    auto msg = message{message_tag::A};
+    msg << i;
+    flooding.send(msg);
+    if (i % 1000 == 999) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    }
+  }
+  REQUIRE(wait_until([&] { return server.backlog() == server.capacity(); }));
+
+  // The network thread still serves the other client
+  server.message_all_clients(message{message_tag::B});
+  REQUIRE(wait_until([&] { return !other.incoming().empty(); }));
+
+  // and the held messages follow once the game loop drains the queue
+  REQUIRE(wait_until([&] {
+    server.update();
+    return server.received.size() == static_cast<std::size_t>(message_count);
+  }));
+  auto in_order = true;
+  for (int i = 0; i < message_count; ++i) {
+    int value = -1;
+    server.received[i] >> value;
+    in_order = in_order && value == i;
+  }
+  REQUIRE(in_order);
+  REQUIRE(flooding.is_connected());
+}
+//------------------------------------------------------------------------------
+TEST_CASE( "local channel" ) {
+  using message = chess::networking::message<message_tag>;
+  namespace net = chess::networking;
+  auto const name = net::local_channel_name(8089);
+  // A small ring makes frames wrap around and senders wait for room
+  net::mpsc_queue<net::owned_message<message_tag>> server_in;
+  auto server = net::local_channel<message_tag>::listen(name, server_in, 4096);
+  REQUIRE(server->is_connected());
+  REQUIRE_FALSE(server->has_peer());
+
+  client_interface<message_tag> client;
+  client.connect("localhost", 8089,
+                 net::io_options{.transport = net::transport_kind::shared_memory});
+  REQUIRE(client.is_connected());
+  REQUIRE(server->has_peer());
+  // A channel has one client
+  net::mpsc_queue<net::owned_message<message_tag>> other_in;
+  REQUIRE_THROWS_AS(net::local_channel<message_tag>::connect(name, other_in),
+                    std::runtime_error);
+
+  auto const deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  auto wait_until = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return condition();
+  };
+
+  auto constexpr message_count = 2000;
+  for (int i = 0; i < message_count; ++i) {
+    auto msg = message{message_tag::A};
+    msg << i;
+    for (int j = 0; j < i % 50; ++j) {
+      msg << j;
+    }
+    client.send(msg);
+  }
+  std::vector<net::owned_message<message_tag>> received;
+  REQUIRE(wait_until([&] {
+    server_in.consume(message_count, [&](auto &&msg) {
+      received.push_back(std::move(msg));
+    });
+    return received.size() == message_count;
+  }));
+  auto in_order = true;
+  for (int i = 0; i < message_count; ++i) {
+    auto &msg = received[i];
+    int value = -1;
+    msg >> value;
+    in_order = in_order && value == i && msg.remote == nullptr &&
+               msg.header.tag == message_tag::A &&
+               msg.body.size() == sizeof(int) * (1 + i % 50);
+  }
+  REQUIRE(in_order);
+
+  auto reply = message{message_tag::B};
+  reply << 42;
+  server->send(reply);
+  REQUIRE(wait_until([&] { return !client.incoming().empty(); }));
+  auto answer = client.incoming().try_dequeue();
+  int value   = 0;
+  *answer >> value;
+  REQUIRE(value == 42);
+
+  // 32 bytes are too many for C, the server closes the channel
+  auto oversized = message{message_tag::C};
+  oversized << std::array<std::uint8_t, 32>{};
+  client.send(oversized);
+  REQUIRE(wait_until([&] { return !client.is_connected(); }));
+  REQUIRE_FALSE(server->is_connected());
+
+  // Only endpoints on this host are reachable through shared memory
+  client.connect("example.com", 8089,
+                 net::io_options{.transport = net::transport_kind::shared_memory});
+  REQUIRE_FALSE(client.is_connected());
+}
@@ -0,0 +1,79 @@
+#pragma once
+//==============================================================================
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+
+#include <chess/chessboard.h>
+#include <chess/engine/book.h>
+#include <chess/engine/nnue.h>
+#include <chess/engine/search.h>
+#include <chess/engine/thread_budget.h>
+#include <chess/transposition_table.h>
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+struct bot_settings {
+  /// Size of the bot's own transposition table, unused with a shared table.
+  std::size_t               hash_megabytes = 64;
+  /// Transposition table shared by all bots, each bot allocates its own of
+  /// hash_megabytes without one.
+  std::shared_ptr<transposition_table> table;
+  /// Search threads per request, taken from the thread budget of the bot.
+  std::size_t               threads = 1;
+  /// Time kept back from every latency budget for sending the reply.
+  std::chrono::milliseconds move_overhead{20};
+  /// Evaluation network shared by all bots, the handcrafted evaluation is
+  /// used without one.
+  std::shared_ptr<engine::nnue::network const> network;
+  /// Opening book shared by all bots, moves are searched without one.
+  std::shared_ptr<engine::polyglot_book const> book;
+  engine::book_settings                        book_selection;
+  /// Seed of the random book move selection, a random one if unset.
+  std::optional<std::uint64_t>                 book_seed;
+};
+//==============================================================================
+/// Computer opponent answering move requests of clients.
+///
+/// The transposition table lives as long as the bot so that consecutive
+/// requests of a game profit from earlier searches. With a shared table the
+/// bots of all games also profit from each other's searches. Requests are served one
+/// after another, cancel may be called from any thread. Bots of concurrent
+/// games share the cores of the server through a common thread budget.
+class bot {
+ public:
+  explicit bot(bot_settings const    &settings = {},
+               engine::thread_budget *budget   = nullptr);
+  //----------------------------------------------------------------------------
+  /// Searches the position on board and returns its best move before the
+  /// latency budget runs out. The returned move is null if the side to move
+  /// has no legal move. Book moves are played without searching, they are
+  /// reported with depth 0.
+  auto request_move(chess_board const &board,
+                    std::chrono::milliseconds latency_budget)
+      -> engine::search_result;
+  /// Like request_move but with explicit limits, which are not shortened and
+  /// choose the number of threads themselves.
+  auto request_move(chess_board const &board,
+                    engine::search_limits const &limits)
+      -> engine::search_result;
+  /// Ends the running request early with the best move found so far.
+  void cancel() { m_searcher.stop(); }
+  /// Forgets everything learned in earlier requests, e.g. when a new game
+  /// starts. Must not be called during a request. A shared table is only
+  /// aged because other bots may be searching it.
+  void clear();
+
+ private:
+  bot_settings                         m_settings;
+  std::shared_ptr<transposition_table> m_tt;
+  engine::searcher                     m_searcher;
+  std::mt19937_64                      m_rng;
+  std::mutex                           m_mutex;
+};
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
@@ -0,0 +1,147 @@
+#pragma once
+//==============================================================================
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <chess/move.h>
+#include <chess/networking/mpsc_queue.h>
+#include <chess/replication.h>
+
+#include "game_session.h"
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+/// A game that was open when the journal was last written.
+struct journaled_game {
+  game_id                      id = 0;
+  time_control                 tc;
+  std::vector<move>            moves;
+  /// Remaining time of white and black in milliseconds after the last move.
+  std::array<std::uint32_t, 2> clocks{};
+};
+//------------------------------------------------------------------------------
+/// Open games found by game_journal::recover.
+struct journal_recovery {
+  /// Sorted by id.
+  std::vector<journaled_game> games;
+  /// Largest id of any game in the journal, ended ones included.
+  game_id                     last_id = 0;
+  /// Bytes of all segments that were read.
+  std::size_t                 bytes   = 0;
+};
+//------------------------------------------------------------------------------
+struct journal_options {
+  std::filesystem::path directory;
+  /// A segment that would grow beyond this is closed and the next one begun.
+  std::size_t           segment_size = std::size_t{64} << 20;
+  /// Records that can wait for the writer before appending has to wait.
+  std::size_t           queue_capacity = 1 << 16;
+};
+//==============================================================================
+/// Append-only journal of the games of a server.
+///
+/// Records are appended to numbered segment files in a directory. A move
+/// costs 15 bytes: the record kind, the game id, the 16-bit move and the
+/// clock of the side that moved. Games that began and ended before every
+/// open game did live in segments that are deleted when a new segment
+/// begins.
+///
+/// Any thread may append. Records go through a lock-free queue to a writer
+/// thread that writes all records that arrived while the previous write was
+/// synced with one write and one fdatasync, so the games of all shards share
+/// the cost of a sync. sync() waits until everything its thread appended
+/// before is on disk.
+///
+/// Recovery maps the segments read-only and replays them in one pass. A
+/// record torn by a crash ends the journal, records after the last sync may
+/// be lost.
+class game_journal {
+ public:
+  /// Opens a new segment after the existing ones of options.directory, which
+  /// is created if needed, and writes the games of recovered to it. Throws
+  /// std::system_error if that fails.
+  explicit game_journal(journal_options options,
+                        std::span<journaled_game const> recovered = {});
+  game_journal(game_journal const &)                    = delete;
+  auto operator=(game_journal const &) -> game_journal & = delete;
+  /// Writes and syncs what was appended.
+  ~game_journal();
+  //----------------------------------------------------------------------------
+  void begin(game_id const game, time_control const &tc);
+  /// clock is the time the side that played m has left, in milliseconds.
+  void record_move(game_id const game, move const m, std::uint32_t const clock);
+  void end(game_id const game, game_status const status);
+  //----------------------------------------------------------------------------
+  /// Blocks until the records this thread appended are on disk. Rethrows
+  /// the std::system_error of a failed write or sync.
+  void sync();
+  //----------------------------------------------------------------------------
+  /// Number of the segment records are appended to.
+  auto segment() const { return m_segment.load(std::memory_order_relaxed); }
+  //----------------------------------------------------------------------------
+  /// Reads the segments of directory and returns the games that were not
+  /// ended. A missing directory is an empty journal. Throws
+  /// std::system_error if a segment cannot be mapped and std::runtime_error
+  /// if one is not a journal segment.
+  static auto recover(std::filesystem::path const &directory)
+      -> journal_recovery;
+  //----------------------------------------------------------------------------
+  static auto segment_path(std::filesystem::path const &directory,
+                           std::uint64_t const number)
+      -> std::filesystem::path;
+
+ private:
+  enum class record_kind : std::uint8_t {
+    // Zero bytes at the end of a segment are no record
+    begin = 1,
+    move  = 2,
+    end   = 3,
+    sync  = 4
+  };
+  //----------------------------------------------------------------------------
+  struct record {
+    record_kind          kind = record_kind::sync;
+    game_status          status{};
+    std::uint16_t        m = 0;
+    std::uint32_t        clock = 0;
+    std::uint32_t        increment = 0;
+    game_id              game = 0;
+    std::promise<void>  *synced = nullptr;
+  };
+  //----------------------------------------------------------------------------
+  void run();
+  void write_batch();
+  void encode(record const &r);
+  void open_segment(std::uint64_t const number);
+  void close_segment();
+  void remove_old_segments();
+  //----------------------------------------------------------------------------
+  journal_options                    m_options;
+  networking::mpsc_queue<record>     m_queue;
+  // Only touched by the writer thread, and the constructor before it starts
+  std::vector<std::uint8_t>          m_buffer;
+  std::vector<std::promise<void> *>  m_waiters;
+  int                                m_file = -1;
+  std::size_t                        m_segment_bytes = 0;
+  std::uint64_t                      m_first_segment = 0;
+  // Segment in which each open game began and open games per segment
+  std::unordered_map<game_id, std::uint64_t> m_begun_in;
+  std::map<std::uint64_t, std::size_t>        m_open_games;
+  std::exception_ptr                 m_error;
+  std::atomic<std::uint64_t>         m_segment = 0;
+  std::atomic<bool>                  m_running = true;
+  std::thread                        m_writer;
+};
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
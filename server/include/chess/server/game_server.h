@@ -0,0 +1,154 @@
+#pragma once
+//==============================================================================
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <tuple>
+
+#include <chess/networking/message.h>
+#include <chess/networking/message_router.h>
+#include <chess/networking/server_interface.h>
+
+#include "session_manager.h"
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+/// Tags of the messages between the server and its clients.
+enum class game_message : std::uint8_t {
+  /// Asks for a game against the next client that seeks one.
+  seek,
+  play,
+  resign,
+  spectate,
+  leave,
+  /// Takes a seat of a game the server restored from its journal, which
+  /// nobody plays after the restart.
+  rejoin,
+  /// Seat of the receiver in a game, from the server ahead of the keyframe
+  /// the receiver joins with.
+  seated,
+  /// Replication update of a game, from the server.
+  update
+};
+//------------------------------------------------------------------------------
+/// Role of the receiver of an update in its game.
+enum class seat : std::uint8_t { white, black, spectator };
+//------------------------------------------------------------------------------
+/// Initial time and increment in milliseconds. The first of two seeking
+/// clients plays white with the time control it asked for.
+using seek_message =
+    networking::fixed_message<game_message::seek, std::uint32_t, std::uint32_t>;
+/// Game and raw move.
+using play_message =
+    networking::fixed_message<game_message::play, game_id, std::uint16_t>;
+using resign_message =
+    networking::fixed_message<game_message::resign, game_id>;
+using spectate_message =
+    networking::fixed_message<game_message::spectate, game_id>;
+using leave_message = networking::fixed_message<game_message::leave, game_id>;
+/// Game and the color of the seat to take.
+using rejoin_message =
+    networking::fixed_message<game_message::rejoin, game_id, color>;
+using seated_message =
+    networking::fixed_message<game_message::seated, game_id, seat>;
+//------------------------------------------------------------------------------
+/// Game and the replication update that follows it up to the end of the
+/// body. The same message goes to every player and spectator of a game.
+struct update_message {
+  using tag_t = game_message;
+  //----------------------------------------------------------------------------
+  static constexpr tag_t tag = game_message::update;
+  //----------------------------------------------------------------------------
+  static auto encode(game_id game, std::span<std::uint8_t const> update)
+      -> networking::message<game_message>;
+  /// The fields of msg or nullopt if it is too short to hold an update.
+  /// The update refers to the body of msg.
+  static auto decode(networking::message<game_message> const &msg)
+      -> std::optional<std::tuple<game_id, std::span<std::uint8_t const>>>;
+};
+//==============================================================================
+/// Serves games to the clients that connect to it.
+///
+/// The thread that calls serve() reads the messages of all clients and
+/// routes each request to the shard that owns its game, so that thread only
+/// pairs seeking clients and never touches a game. The shards send the
+/// updates of their games straight to the players and spectators. An update
+/// is encoded once and every recipient queues the same shared message, a
+/// client that joins gets its seat and a keyframe of its own.
+///
+/// A timer on the first network thread ticks the session manager every
+/// tick_interval, so a player whose clock runs out loses on time even if
+/// nobody moves.
+class game_server : public networking::server_interface<game_message> {
+ public:
+  using client_ptr = std::shared_ptr<networking::connection<game_message>>;
+  using sessions_t = session_manager<client_ptr>;
+  //----------------------------------------------------------------------------
+  static constexpr auto default_tick_interval = std::chrono::milliseconds{10};
+  //----------------------------------------------------------------------------
+  game_server(std::uint16_t port, std::size_t network_threads,
+              session_options const &sessions,
+              std::chrono::milliseconds tick_interval = default_tick_interval);
+  ~game_server() override;
+  //----------------------------------------------------------------------------
+  /// Starts the shards and begins to accept clients. False if the port
+  /// cannot be listened on.
+  auto start() -> bool;
+  /// Handles up to max_messages waiting messages and returns their number.
+  /// With wait the calling thread sleeps until a message arrives or the
+  /// server stops.
+  auto serve(std::size_t max_messages = static_cast<std::size_t>(-1),
+             bool wait = false) -> std::size_t;
+  //----------------------------------------------------------------------------
+  auto sessions() -> sessions_t & { return m_sessions; }
+
+ protected:
+  bool on_client_connect(client_ptr client) override;
+  void on_unrouted_message(client_ptr client,
+                           networking::message<game_message> &msg) override;
+
+ private:
+  /// Handlers of the message_router, on the thread of serve().
+  struct requests {
+    game_server &server;
+    //--------------------------------------------------------------------------
+    void on_message(seek_message, client_ptr const &client,
+                    std::uint32_t initial, std::uint32_t increment);
+    void on_message(play_message, client_ptr const &client, game_id game,
+                    std::uint16_t m);
+    void on_message(resign_message, client_ptr const &client, game_id game);
+    void on_message(spectate_message, client_ptr const &client,
+                    game_id game);
+    void on_message(leave_message, client_ptr const &client, game_id game);
+    void on_message(rejoin_message, client_ptr const &client, game_id game,
+                    color side);
+  };
+  using router_t =
+      networking::message_router<requests, seek_message, play_message,
+                                 resign_message, spectate_message,
+                                 leave_message, rejoin_message>;
+  //----------------------------------------------------------------------------
+  /// Sends an update of game to recipient, or to all its players and
+  /// spectators if that is null, on the shard's thread.
+  static void send_update(sessions_t::shard::session const &game,
+                          client_ptr const                 *recipient,
+                          std::span<std::uint8_t const>     update);
+  /// Ticks the sessions every m_tick_interval until the pool stops.
+  void schedule_tick();
+  //----------------------------------------------------------------------------
+  sessions_t                m_sessions;
+  std::chrono::milliseconds m_tick_interval;
+  asio::steady_timer        m_ticker;
+  requests                  m_requests{*this};
+  router_t                  m_router{m_requests};
+  // The client waiting for an opponent and the time control it asked for,
+  // only touched by the thread of serve()
+  client_ptr                m_seeking;
+  time_control              m_seek_tc;
+};
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
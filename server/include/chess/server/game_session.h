@@ -0,0 +1,217 @@
+#pragma once
+//==============================================================================
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <chess/networking/timing_wheel.h>
+
+#include <chess/move.h>
+#include <chess/movegen.h>
+#include <chess/position.h>
+#include <chess/replication.h>
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+/// Identifies a game on the server, it also selects the shard that owns the
+/// game, see session_manager.
+using game_id = std::uint64_t;
+//------------------------------------------------------------------------------
+struct time_control {
+  std::chrono::milliseconds initial{5 * 60 * 1000};
+  std::chrono::milliseconds increment{0};
+};
+//==============================================================================
+/// One game played by two clients and watched by any number of spectators.
+///
+/// A session is owned by exactly one shard and only touched by its thread,
+/// so it has no locks. Its board, clocks and status are kept in a
+/// replicated_game from which the shard sends deltas to the players and
+/// spectators. Client is the handle the server uses to reach a player, it
+/// must be equality comparable. The shard keeps the flag timer on its timing
+/// wheel set to the moment the side to move runs out of time.
+template <typename Client>
+class game_session {
+ public:
+  using clock = std::chrono::steady_clock;
+  //----------------------------------------------------------------------------
+  game_session(game_id const id, Client white, Client black,
+               time_control const tc, clock::time_point const now)
+      : m_id{id},
+        m_players{std::move(white), std::move(black)},
+        m_time_control{tc},
+        m_position{position::from_fen(position::start_fen)},
+        m_turn_started{now} {
+    m_state.sync(m_position);
+    for (auto const c : {color::white, color::black}) {
+      m_state.set_clock(c, static_cast<std::uint32_t>(tc.initial.count()));
+    }
+    m_state.set_status(game_status::ongoing);
+  }
+  //----------------------------------------------------------------------------
+  /// Continues a game after moves, for example from a game_journal. clocks
+  /// are the times white and black had left, the turn of the side to move
+  /// starts at now.
+  game_session(game_id const id, Client white, Client black,
+               time_control const tc, std::span<move const> const moves,
+               std::array<std::uint32_t, 2> const clocks,
+               clock::time_point const now)
+      : game_session{id, std::move(white), std::move(black), tc, now} {
+    for (auto const m : moves) {
+      m_position.make_move(m);
+    }
+    m_state.sync(m_position);
+    for (auto const c : {color::white, color::black}) {
+      m_state.set_clock(c, clocks[static_cast<int>(c)]);
+    }
+  }
+  //----------------------------------------------------------------------------
+  auto id() const { return m_id; }
+  auto get_position() const -> position const & { return m_position; }
+  auto state() -> replicated_game & { return m_state; }
+  auto state() const -> replicated_game const & { return m_state; }
+  auto player(color const c) const -> Client const & {
+    return m_players[static_cast<int>(c)];
+  }
+  auto spectators() const -> std::vector<Client> const & {
+    return m_spectators;
+  }
+  auto is_over() const { return m_state.status() != game_status::ongoing; }
+  auto flag_timer() -> networking::wheel_timer & { return m_flag_timer; }
+  //----------------------------------------------------------------------------
+  /// Time the side to move has left at now.
+  auto time_left(clock::time_point const now) const
+      -> std::chrono::milliseconds {
+    auto const side = m_position.side_to_move();
+    return std::chrono::milliseconds{m_state.clock(side)} -
+           std::chrono::duration_cast<std::chrono::milliseconds>(
+               now - m_turn_started);
+  }
+  //----------------------------------------------------------------------------
+  /// Plays m for who if it is their turn, m is legal and their clock did not
+  /// run out before now. Ends the game on mate, stalemate, the fifty move
+  /// rule and flag fall.
+  auto play(Client const &who, move const m, clock::time_point const now)
+      -> bool {
+    auto const side = m_position.side_to_move();
+    if (is_over() || !(who == player(side))) {
+      return false;
+    }
+    if (!charge_clock(side, now)) {
+      return false;
+    }
+    auto legal = move_list{};
+    generate_legal_moves(m_position, legal);
+    if (std::ranges::find(legal, m) == legal.end()) {
+      return false;
+    }
+    m_position.make_move(m);
+    m_turn_started = now;
+    m_state.sync(m_position);
+    add_increment(side);
+
+    legal.clear();
+    generate_legal_moves(m_position, legal);
+    if (legal.empty()) {
+      m_state.set_status(!m_position.in_check() ? game_status::draw
+                         : side == color::white ? game_status::white_won
+                                                : game_status::black_won);
+    } else if (m_position.halfmove_clock() >= 100) {
+      m_state.set_status(game_status::draw);
+    }
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  /// Ends the game if the side to move ran out of time. True if it did.
+  auto check_flag(clock::time_point const now) -> bool {
+    return !is_over() && !charge_clock(m_position.side_to_move(), now);
+  }
+  //----------------------------------------------------------------------------
+  /// Gives the game to the opponent of who, if who plays it.
+  auto resign(Client const &who) -> bool {
+    if (is_over()) {
+      return false;
+    }
+    for (auto const c : {color::white, color::black}) {
+      if (who == player(c)) {
+        m_state.set_status(c == color::white ? game_status::black_won
+                                             : game_status::white_won);
+        return true;
+      }
+    }
+    return false;
+  }
+  //----------------------------------------------------------------------------
+  /// Seats who as side if nobody plays it, e.g. in a game restored from a
+  /// journal. True if who took the seat.
+  auto take_seat(color const side, Client who) -> bool {
+    auto &seat = m_players[static_cast<int>(side)];
+    if (is_over() || !(seat == Client{})) {
+      return false;
+    }
+    seat = std::move(who);
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  void add_spectator(Client spectator) {
+    if (std::ranges::find(m_spectators, spectator) == m_spectators.end()) {
+      m_spectators.push_back(std::move(spectator));
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Removes who from the spectators. A player leaving aborts the game.
+  void leave(Client const &who) {
+    std::erase(m_spectators, who);
+    if (!is_over() &&
+        (who == player(color::white) || who == player(color::black))) {
+      m_state.set_status(game_status::aborted);
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Calls f with both players and every spectator.
+  void for_each_recipient(auto &&f) const {
+    for (auto const &p : m_players) {
+      f(p);
+    }
+    for (auto const &s : m_spectators) {
+      f(s);
+    }
+  }
+
+ private:
+  /// Takes the time spent on this turn from the clock of side. Flags and
+  /// returns false if it is used up.
+  auto charge_clock(color const side, clock::time_point const now) -> bool {
+    auto const left = time_left(now);
+    if (left.count() <= 0) {
+      m_state.set_clock(side, 0);
+      m_state.set_status(side == color::white ? game_status::black_won
+                                              : game_status::white_won);
+      return false;
+    }
+    m_state.set_clock(side, static_cast<std::uint32_t>(left.count()));
+    m_turn_started = now;
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  void add_increment(color const side) {
+    m_state.set_clock(side, m_state.clock(side) + static_cast<std::uint32_t>(
+                                                      m_time_control.increment
+                                                          .count()));
+  }
+  //----------------------------------------------------------------------------
+  game_id                 m_id;
+  std::array<Client, 2>   m_players;
+  std::vector<Client>     m_spectators;
+  time_control            m_time_control;
+  position                m_position;
+  replicated_game         m_state;
+  clock::time_point       m_turn_started;
+  networking::wheel_timer m_flag_timer;
+};
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
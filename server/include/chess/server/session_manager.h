@@ -0,0 +1,452 @@
+#pragma once
+//==============================================================================
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <chess/networking/mpsc_queue.h>
+#include <chess/networking/timing_wheel.h>
+#include <chess/replication.h>
+
+#include "game_journal.h"
+#include "game_session.h"
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+/// Request for a game, executed by the shard that owns it.
+template <typename Client>
+struct session_command {
+  enum class kind : std::uint8_t {
+    create, play, resign, spectate, leave,
+    /// Takes the empty seat of side in a restored game.
+    rejoin,
+    /// Only wakes the shard to fire the game clocks that ran out.
+    tick
+  };
+  //----------------------------------------------------------------------------
+  kind         type;
+  game_id      game;
+  /// The sender, white for create.
+  Client       client{};
+  /// Black for create.
+  Client       opponent{};
+  move         m{};
+  time_control tc{};
+  color        side = color::white;
+};
+//==============================================================================
+/// Owns a subset of the games and runs them on its own thread.
+///
+/// Commands arrive through a lock-free queue that any thread may fill. After
+/// every batch the shard sends the changes of the games it touched as
+/// replication updates, on its own thread, through the update handler. Games
+/// that were not touched cost nothing, however many are open. A client that
+/// joins a game gets a keyframe of its own, the others keep following the
+/// deltas.
+///
+/// Flag fall is found by a timing wheel with a timer per game instead of by
+/// looking at every clock. The wheel advances whenever the shard processes a
+/// batch, tick commands make sure it does so while no moves arrive.
+///
+/// With a journal every new game, move and result is appended to it, and the
+/// updates of a batch only go out after its records were synced. If the
+/// journal fails, the games of the batch are aborted, they could not be
+/// recovered after a restart.
+template <typename Client>
+class session_shard {
+ public:
+  using session        = game_session<Client>;
+  using command        = session_command<Client>;
+  using clock          = typename session::clock;
+  /// recipient is a client that joined the game and gets the keyframe
+  /// update alone, null for an update to all players and spectators.
+  using update_handler =
+      std::function<void(session const &, Client const *recipient,
+                         std::span<std::uint8_t const> update)>;
+  //----------------------------------------------------------------------------
+  session_shard(std::size_t const queue_capacity,
+                std::uint32_t const keyframe_interval,
+                update_handler const &on_update,
+                game_journal *const journal = nullptr)
+      : m_journal{journal},
+        m_inbox{queue_capacity},
+        m_clocks{clock::now()},
+        m_replication{keyframe_interval},
+        m_on_update{on_update} {}
+  //----------------------------------------------------------------------------
+  ~session_shard() { stop(); }
+  //----------------------------------------------------------------------------
+  void start() {
+    m_running = true;
+    m_thread  = std::thread{[this] { run(); }};
+  }
+  //----------------------------------------------------------------------------
+  void stop() {
+    m_running = false;
+    m_inbox.wake();
+    if (m_thread.joinable()) {
+      m_thread.join();
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Queues cmd, from any thread. Yields while the queue is full.
+  void post(command cmd) { m_inbox.enqueue(std::move(cmd)); }
+  //----------------------------------------------------------------------------
+  /// Reopens a journaled game. Only before start(), the journal already
+  /// holds the game.
+  void restore(journaled_game const &game, Client white, Client black) {
+    auto const now      = clock::now();
+    auto [it, inserted] = m_games.try_emplace(
+        game.id, game.id, std::move(white), std::move(black), game.tc,
+        std::span<move const>{game.moves}, game.clocks, now);
+    if (inserted) {
+      open(it->second, now);
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Number of open games, only exact on the shard's thread.
+  auto game_count() const {
+    return m_game_count.load(std::memory_order_relaxed);
+  }
+  //----------------------------------------------------------------------------
+  /// Runs every queued command and sends the resulting updates. Called by
+  /// the shard's thread, or by the owner of a shard that was not started.
+  auto process() -> std::size_t {
+    auto const now   = clock::now();
+    auto const count = m_inbox.consume(
+        static_cast<std::size_t>(-1),
+        [this, now](command &&cmd) { execute(cmd, now); });
+    m_clocks.advance(now);
+    flush();
+    return count;
+  }
+
+ private:
+  void run() {
+    while (m_running.load(std::memory_order_relaxed)) {
+      m_inbox.wait();
+      process();
+    }
+  }
+  //----------------------------------------------------------------------------
+  void execute(command &cmd, typename clock::time_point const now) {
+    using kind = typename command::kind;
+    if (cmd.type == kind::create) {
+      auto [it, inserted] = m_games.try_emplace(
+          cmd.game, cmd.game, std::move(cmd.client), std::move(cmd.opponent),
+          cmd.tc, now);
+      if (inserted) {
+        if (m_journal != nullptr) {
+          m_journal->begin(cmd.game, cmd.tc);
+          m_journaled = true;
+        }
+        open(it->second, now);
+        m_changed.push_back(it->second.state().get_network_id());
+      }
+      return;
+    }
+    if (cmd.type == kind::tick) {
+      return;
+    }
+    auto const it = m_games.find(cmd.game);
+    if (it == m_games.end()) {
+      return;
+    }
+    auto &game = it->second;
+    m_changed.push_back(game.state().get_network_id());
+    switch (cmd.type) {
+      case kind::play:
+        if (game.play(cmd.client, cmd.m, now)) {
+          set_flag(game, now);
+          if (m_journal != nullptr) {
+            auto const mover = ~game.get_position().side_to_move();
+            m_journal->record_move(cmd.game, cmd.m, game.state().clock(mover));
+            m_journaled = true;
+          }
+        }
+        break;
+      case kind::resign:
+        game.resign(cmd.client);
+        break;
+      case kind::spectate:
+        game.add_spectator(cmd.client);
+        // A spectator starts from the current state and follows the deltas
+        send_keyframe(game, cmd.client);
+        break;
+      case kind::leave:
+        game.leave(cmd.client);
+        break;
+      case kind::rejoin:
+        if (game.take_seat(cmd.side, cmd.client)) {
+          send_keyframe(game, cmd.client);
+        }
+        break;
+      case kind::create:
+      case kind::tick:
+        break;
+    }
+  }
+  //----------------------------------------------------------------------------
+  // Registers a new game for replication and flag fall
+  void open(session &game, typename clock::time_point const now) {
+    auto const id = m_replication.add(game.state());
+    m_game_of.emplace(id, game.id());
+    // The players start from a keyframe of the current state, a restored
+    // game has nobody to send it to until a player rejoins
+    game.state().commit();
+    for (auto const c : {color::white, color::black}) {
+      if (!(game.player(c) == Client{})) {
+        send_keyframe(game, game.player(c));
+      }
+    }
+    m_game_count.fetch_add(1, std::memory_order_relaxed);
+    game.flag_timer().set_callback([this, &game] { on_flag(game); });
+    set_flag(game, now);
+  }
+  //----------------------------------------------------------------------------
+  void send_keyframe(session const &game, Client const &recipient) {
+    m_keyframe.clear();
+    game.state().write_keyframe(m_keyframe);
+    m_on_update(game, &recipient, m_keyframe);
+  }
+  //----------------------------------------------------------------------------
+  // Sets the flag timer of game to when the side to move runs out of time
+  void set_flag(session &game, typename clock::time_point const now) {
+    if (game.is_over()) {
+      game.flag_timer().cancel();
+      return;
+    }
+    m_clocks.schedule(game.flag_timer(), game.time_left(now));
+  }
+  //----------------------------------------------------------------------------
+  // The wheel rounds to whole ticks, a flag that is not quite due yet is
+  // set again for the rest
+  void on_flag(session &game) {
+    auto const now = clock::now();
+    if (game.check_flag(now)) {
+      m_changed.push_back(game.state().get_network_id());
+    } else {
+      set_flag(game, now);
+    }
+  }
+  //----------------------------------------------------------------------------
+  // Sends the changes of this batch and closes games that ended, after
+  // their final update went out
+  void flush() {
+    for (auto const id : m_changed) {
+      auto const game_it = m_game_of.find(id);
+      if (game_it != m_game_of.end() &&
+          m_games.at(game_it->second).is_over() &&
+          std::ranges::find(m_finished, id) == m_finished.end()) {
+        m_finished.push_back(id);
+        if (m_journal != nullptr) {
+          m_journal->end(game_it->second,
+                         m_games.at(game_it->second).state().status());
+          m_journaled = true;
+        }
+      }
+    }
+    if (m_journaled) {
+      // Nobody learns of a move the journal could still lose
+      m_journaled = false;
+      try {
+        m_journal->sync();
+      } catch (std::exception const &e) {
+        abort_changed(e);
+      }
+    }
+    m_replication.tick(m_changed, [this](replicated_game const &state,
+                                         std::span<std::uint8_t const> update) {
+      m_on_update(m_games.at(m_game_of.at(state.get_network_id())), nullptr,
+                  update);
+    });
+    for (auto const id : m_finished) {
+      auto const game_it = m_game_of.find(id);
+      auto const it      = m_games.find(game_it->second);
+      m_replication.remove(it->second.state());
+      m_games.erase(it);
+      m_game_of.erase(game_it);
+      m_game_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    m_finished.clear();
+    m_changed.clear();
+  }
+  //----------------------------------------------------------------------------
+  // The journal lost the records of this batch, its games end
+  void abort_changed(std::exception const &error) {
+    if (!m_journal_failed) {
+      std::cerr << "[SHARD] Journal Failed: " << error.what() << "\n";
+      m_journal_failed = true;
+    }
+    for (auto const id : m_changed) {
+      auto &game = m_games.at(m_game_of.at(id));
+      if (!game.is_over()) {
+        game.state().set_status(game_status::aborted);
+        game.flag_timer().cancel();
+      }
+      if (std::ranges::find(m_finished, id) == m_finished.end()) {
+        m_finished.push_back(id);
+      }
+    }
+  }
+  //----------------------------------------------------------------------------
+  game_journal                            *m_journal;
+  bool                                     m_journal_failed = false;
+  bool                                     m_journaled = false;
+  networking::mpsc_queue<command>          m_inbox;
+  networking::timing_wheel                 m_clocks;
+  std::unordered_map<game_id, session>     m_games;
+  std::unordered_map<network_id, game_id>  m_game_of;
+  replication_registry                     m_replication;
+  // Games touched by the current batch, may hold duplicates
+  std::vector<network_id>                  m_changed;
+  std::vector<network_id>                  m_finished;
+  std::vector<std::uint8_t>                m_keyframe;
+  update_handler                           m_on_update;
+  std::atomic<std::size_t>                 m_game_count = 0;
+  std::atomic<bool>                        m_running    = false;
+  std::thread                              m_thread;
+};
+//==============================================================================
+struct session_options {
+  std::size_t   shards = std::thread::hardware_concurrency();
+  /// Commands a shard can hold before posting has to wait.
+  std::size_t   queue_capacity = 1 << 14;
+  std::uint32_t keyframe_interval =
+      replication_registry::default_keyframe_interval;
+  /// Records the games if set, it must outlive the manager.
+  game_journal *journal = nullptr;
+};
+//==============================================================================
+/// Games of the server spread over a fixed set of shards.
+///
+/// Every game lives on one shard for its whole life. Ids are handed out in
+/// sequence and the id modulo the shard count is the shard, so games spread
+/// evenly and routing a command is a modulo and a push onto the shard's
+/// lock-free queue. No lock is shared between games
+/// of different shards, throughput grows with the number of shards.
+template <typename Client>
+class session_manager {
+ public:
+  using shard          = session_shard<Client>;
+  using update_handler = typename shard::update_handler;
+  using command        = typename shard::command;
+  using kind           = typename command::kind;
+  //----------------------------------------------------------------------------
+  /// on_update is called on the shard threads with every replication update
+  /// of a game and should send it to the game's recipients.
+  session_manager(session_options const &options,
+                  update_handler const &on_update) {
+    auto const count = options.shards == 0 ? std::size_t{1} : options.shards;
+    m_shards.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      m_shards.push_back(std::make_unique<shard>(
+          options.queue_capacity, options.keyframe_interval, on_update,
+          options.journal));
+    }
+  }
+  //----------------------------------------------------------------------------
+  session_manager(session_manager const &)                    = delete;
+  auto operator=(session_manager const &) -> session_manager & = delete;
+  //----------------------------------------------------------------------------
+  ~session_manager() { stop(); }
+  //----------------------------------------------------------------------------
+  void start() {
+    for (auto &s : m_shards) {
+      s->start();
+    }
+  }
+  //----------------------------------------------------------------------------
+  void stop() {
+    for (auto &s : m_shards) {
+      s->stop();
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Opens a game on the next shard and returns its id.
+  auto create_game(Client white, Client black, time_control const tc = {})
+      -> game_id {
+    auto const n  = m_next.fetch_add(1, std::memory_order_relaxed);
+    auto const id = n + 1;
+    post({kind::create, id, std::move(white), std::move(black), {}, tc});
+    return id;
+  }
+  //----------------------------------------------------------------------------
+  void play(game_id const game, Client who, move const m) {
+    post({kind::play, game, std::move(who), {}, m});
+  }
+  void resign(game_id const game, Client who) {
+    post({kind::resign, game, std::move(who)});
+  }
+  void spectate(game_id const game, Client who) {
+    post({kind::spectate, game, std::move(who)});
+  }
+  void leave(game_id const game, Client who) {
+    post({kind::leave, game, std::move(who)});
+  }
+  /// Seats who as side of a restored game whose side nobody plays yet.
+  void rejoin(game_id const game, Client who, color const side) {
+    post({kind::rejoin, game, std::move(who), {}, {}, {}, side});
+  }
+  //----------------------------------------------------------------------------
+  /// Reopens the games of recovery before start(). players(game) returns
+  /// the white and the black client of a journaled_game. New games get ids
+  /// after every journaled one.
+  ///
+  ///     auto recovery = game_journal::recover(directory);
+  ///     auto journal  = game_journal{{directory}, recovery.games};
+  ///     manager.restore(recovery, [&](journaled_game const &game) { ... });
+  void restore(journal_recovery const &recovery, auto &&players) {
+    for (auto const &game : recovery.games) {
+      auto [white, black] = players(game);
+      m_shards[shard_of(game.id)]->restore(game, std::move(white),
+                                           std::move(black));
+    }
+    auto next = m_next.load(std::memory_order_relaxed);
+    while (next < recovery.last_id &&
+           !m_next.compare_exchange_weak(next, recovery.last_id)) {
+    }
+  }
+  //----------------------------------------------------------------------------
+  /// Wakes every shard to end the games whose clock ran out. Call it
+  /// periodically, for example from a steady_timer on an I/O thread, at the
+  /// precision flag fall should have.
+  void tick() {
+    for (auto &s : m_shards) {
+      s->post({kind::tick, 0});
+    }
+  }
+  //----------------------------------------------------------------------------
+  auto shard_of(game_id const game) const -> std::size_t {
+    return game % m_shards.size();
+  }
+  auto shard_count() const { return m_shards.size(); }
+  auto get_shard(std::size_t const i) -> shard & { return *m_shards[i]; }
+  //----------------------------------------------------------------------------
+  /// Open games of all shards, approximate while the shards run.
+  auto game_count() const {
+    auto count = std::size_t{0};
+    for (auto const &s : m_shards) {
+      count += s->game_count();
+    }
+    return count;
+  }
+
+ private:
+  void post(command cmd) { m_shards[shard_of(cmd.game)]->post(std::move(cmd)); }
+  //----------------------------------------------------------------------------
+  std::vector<std::unique_ptr<shard>> m_shards;
+  std::atomic<game_id>                m_next = 0;
+};
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
@@ -0,0 +1,54 @@
+#include "chess/server/bot.h"
+
+#include <algorithm>
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+bot::bot(bot_settings const &settings, engine::thread_budget *const budget)
+    : m_settings{settings},
+      m_tt{settings.table ? settings.table
+                          : std::make_shared<transposition_table>(
+                                settings.hash_megabytes)},
+      m_searcher{*m_tt, budget},
+      m_rng{settings.book_seed.value_or(std::random_device{}())} {
+  m_searcher.set_network(settings.network);
+}
+//------------------------------------------------------------------------------
+void bot::clear() {
+  if (m_settings.table) {
+    m_tt->new_search();
+  } else {
+    m_tt->clear();
+  }
+}
+//------------------------------------------------------------------------------
+auto bot::request_move(chess_board const              &board,
+                       std::chrono::milliseconds const latency_budget)
+    -> engine::search_result {
+  // even an exhausted budget gets the first iteration, which takes well below
+  // a millisecond
+  auto const time = std::max(latency_budget - m_settings.move_overhead,
+                             std::chrono::milliseconds{1});
+  return request_move(board, engine::search_limits{
+                                 .time = time, .threads = m_settings.threads});
+}
+//------------------------------------------------------------------------------
+auto bot::request_move(chess_board const             &board,
+                       engine::search_limits const &limits)
+    -> engine::search_result {
+  auto lock = std::scoped_lock{m_mutex};
+  if (m_settings.book) {
+    auto const &pos = board.get_position();
+    auto const  ply = 2 * (pos.fullmove_number() - 1) +
+                     (pos.side_to_move() == color::black ? 1 : 0);
+    auto const m =
+        m_settings.book->pick(pos, ply, m_settings.book_selection, m_rng);
+    if (!m.is_null()) {
+      return {.best_move = m, .pv = {m}};
+    }
+  }
+  return m_searcher.search(board, limits);
+}
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
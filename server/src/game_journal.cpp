@@ -0,0 +1,407 @@
+#include "chess/server/game_journal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <chess/engine/mapped_file.h>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+/// Every segment starts with it, the version is its last character.
+constexpr auto magic = std::array<char, 8>{'C', 'H', 'S', 'J', 'R', 'N', 'L',
+                                           '1'};
+constexpr auto segment_extension = ".journal";
+//------------------------------------------------------------------------------
+constexpr std::size_t begin_size = 1 + 8 + 4 + 4;
+constexpr std::size_t move_size  = 1 + 8 + 2 + 4;
+constexpr std::size_t end_size   = 1 + 8 + 1;
+//------------------------------------------------------------------------------
+template <typename T>
+void put(std::vector<std::uint8_t> &out, T const value) {
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+  }
+}
+//------------------------------------------------------------------------------
+template <typename T>
+auto get(std::byte const *bytes) -> T {
+  auto value = T{0};
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<T>(static_cast<T>(bytes[i]) << (8 * i));
+  }
+  return value;
+}
+//------------------------------------------------------------------------------
+[[noreturn]] void fail(std::string const &what) {
+  throw std::system_error{errno, std::generic_category(), what};
+}
+//------------------------------------------------------------------------------
+auto open_file(std::filesystem::path const &path) -> int {
+#if defined(_WIN32)
+  auto const fd = ::_wopen(path.c_str(),
+                           _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY,
+                           _S_IREAD | _S_IWRITE);
+#else
+  auto const fd =
+      ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+  if (fd < 0) {
+    fail("cannot open " + path.string());
+  }
+  return fd;
+}
+//------------------------------------------------------------------------------
+void write_all(int const fd, std::span<std::uint8_t const> bytes) {
+  while (!bytes.empty()) {
+#if defined(_WIN32)
+    auto const n = ::_write(fd, bytes.data(),
+                            static_cast<unsigned>(std::min<std::size_t>(
+                                bytes.size(), 1u << 30)));
+#else
+    auto const n = ::write(fd, bytes.data(), bytes.size());
+#endif
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail("cannot write game journal");
+    }
+    bytes = bytes.subspan(static_cast<std::size_t>(n));
+  }
+}
+//------------------------------------------------------------------------------
+void sync_file(int const fd) {
+#if defined(_WIN32)
+  if (::_commit(fd) != 0) {
+#elif defined(__APPLE__)
+  if (::fsync(fd) != 0) {
+#else
+  if (::fdatasync(fd) != 0) {
+#endif
+    fail("cannot sync game journal");
+  }
+}
+//------------------------------------------------------------------------------
+void close_file(int const fd) {
+#if defined(_WIN32)
+  ::_close(fd);
+#else
+  ::close(fd);
+#endif
+}
+//------------------------------------------------------------------------------
+/// Makes a new directory entry durable, a synced file whose entry is lost is
+/// lost as well.
+void sync_directory([[maybe_unused]] std::filesystem::path const &directory) {
+#if !defined(_WIN32)
+  auto const fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fail("cannot open " + directory.string());
+  }
+  auto const result = ::fsync(fd);
+  ::close(fd);
+  if (result != 0) {
+    fail("cannot sync " + directory.string());
+  }
+#endif
+}
+//------------------------------------------------------------------------------
+/// Numbers of the segments in directory, ascending.
+auto segment_numbers(std::filesystem::path const &directory)
+    -> std::vector<std::uint64_t> {
+  auto numbers = std::vector<std::uint64_t>{};
+  auto ec      = std::error_code{};
+  for (auto const &entry : std::filesystem::directory_iterator{directory, ec}) {
+    auto const &path = entry.path();
+    if (path.extension() != segment_extension) {
+      continue;
+    }
+    auto const stem = path.stem().string();
+    if (stem.empty() || !std::ranges::all_of(stem, [](char const c) {
+          return c >= '0' && c <= '9';
+        })) {
+      continue;
+    }
+    numbers.push_back(std::stoull(stem));
+  }
+  std::ranges::sort(numbers);
+  return numbers;
+}
+//------------------------------------------------------------------------------
+/// Replays the records of one segment into games. Returns false at a torn
+/// record, which can only be the last one the server wrote.
+auto replay(std::span<std::byte const> bytes,
+            std::unordered_map<game_id, journaled_game> &games,
+            game_id &last_id) -> bool {
+  auto const *p   = bytes.data();
+  auto const *end = p + bytes.size();
+  while (p != end) {
+    auto const kind = static_cast<std::uint8_t>(*p);
+    auto const left = static_cast<std::size_t>(end - p);
+    if (kind == 2 && left >= move_size) {
+      auto const id = get<std::uint64_t>(p + 1);
+      if (auto const it = games.find(id); it != games.end()) {
+        auto &game = it->second;
+        game.clocks[game.moves.size() % 2] = get<std::uint32_t>(p + 11);
+        game.moves.push_back(move::from_raw(get<std::uint16_t>(p + 9)));
+      }
+      p += move_size;
+    } else if (kind == 1 && left >= begin_size) {
+      auto game    = journaled_game{};
+      game.id      = get<std::uint64_t>(p + 1);
+      game.tc      = {std::chrono::milliseconds{get<std::uint32_t>(p + 9)},
+                      std::chrono::milliseconds{get<std::uint32_t>(p + 13)}};
+      auto const initial = static_cast<std::uint32_t>(game.tc.initial.count());
+      game.clocks  = {initial, initial};
+      last_id      = std::max(last_id, game.id);
+      // A game that is begun again was copied to a newer segment
+      games.insert_or_assign(game.id, std::move(game));
+      p += begin_size;
+    } else if (kind == 3 && left >= end_size) {
+      games.erase(get<std::uint64_t>(p + 1));
+      p += end_size;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+game_journal::game_journal(journal_options options,
+                           std::span<journaled_game const> const recovered)
+    : m_options{std::move(options)}, m_queue{m_options.queue_capacity} {
+  std::filesystem::create_directories(m_options.directory);
+  auto const existing = segment_numbers(m_options.directory);
+  auto const next     = existing.empty() ? std::uint64_t{1} : existing.back() + 1;
+  m_first_segment     = next;
+  open_segment(next);
+
+  for (auto const &game : recovered) {
+    encode({.kind      = record_kind::begin,
+            .clock     = static_cast<std::uint32_t>(game.tc.initial.count()),
+            .increment = static_cast<std::uint32_t>(game.tc.increment.count()),
+            .game      = game.id});
+    for (std::size_t i = 0; i < game.moves.size(); ++i) {
+      auto const clock = game.clocks[i % 2];
+      encode({.kind  = record_kind::move,
+              .m     = game.moves[i].raw(),
+              .clock = clock,
+              .game  = game.id});
+    }
+  }
+  write_all(m_file, m_buffer);
+  m_segment_bytes += m_buffer.size();
+  m_buffer.clear();
+  sync_file(m_file);
+  // The recovered games are safe in the new segments, the old ones can go
+  for (auto const number : existing) {
+    auto ec = std::error_code{};
+    std::filesystem::remove(segment_path(m_options.directory, number), ec);
+  }
+  m_writer = std::thread{[this] { run(); }};
+}
+//------------------------------------------------------------------------------
+game_journal::~game_journal() {
+  m_running = false;
+  m_queue.wake();
+  if (m_writer.joinable()) {
+    m_writer.join();
+  }
+  close_segment();
+}
+//------------------------------------------------------------------------------
+void game_journal::begin(game_id const game, time_control const &tc) {
+  m_queue.enqueue(
+      {.kind      = record_kind::begin,
+       .clock     = static_cast<std::uint32_t>(tc.initial.count()),
+       .increment = static_cast<std::uint32_t>(tc.increment.count()),
+       .game      = game});
+}
+//------------------------------------------------------------------------------
+void game_journal::record_move(game_id const game, move const m,
+                               std::uint32_t const clock) {
+  m_queue.enqueue(
+      {.kind = record_kind::move, .m = m.raw(), .clock = clock, .game = game});
+}
+//------------------------------------------------------------------------------
+void game_journal::end(game_id const game, game_status const status) {
+  m_queue.enqueue({.kind = record_kind::end, .status = status, .game = game});
+}
+//------------------------------------------------------------------------------
+void game_journal::sync() {
+  auto synced = std::promise<void>{};
+  auto done   = synced.get_future();
+  m_queue.enqueue({.kind = record_kind::sync, .synced = &synced});
+  done.get();
+}
+//------------------------------------------------------------------------------
+auto game_journal::recover(std::filesystem::path const &directory)
+    -> journal_recovery {
+  auto result = journal_recovery{};
+  auto games  = std::unordered_map<game_id, journaled_game>{};
+  for (auto const number : segment_numbers(directory)) {
+    auto const path = segment_path(directory, number);
+    auto const file = engine::mapped_file{path};
+    auto const bytes = file.bytes();
+    if (bytes.size() < magic.size()) {
+      // Created right before a crash
+      break;
+    }
+    if (std::memcmp(bytes.data(), magic.data(), magic.size()) != 0) {
+      throw std::runtime_error{path.string() + " is not a game journal"};
+    }
+    result.bytes += bytes.size();
+    if (!replay(bytes.subspan(magic.size()), games, result.last_id)) {
+      // Torn by a crash, nothing was written after it
+      break;
+    }
+  }
+  result.games.reserve(games.size());
+  for (auto &[id, game] : games) {
+    result.games.push_back(std::move(game));
+  }
+  std::ranges::sort(result.games, {}, &journaled_game::id);
+  return result;
+}
+//------------------------------------------------------------------------------
+auto game_journal::segment_path(std::filesystem::path const &directory,
+                                std::uint64_t const number)
+    -> std::filesystem::path {
+  auto name = std::to_string(number);
+  name.insert(0, name.size() < 8 ? 8 - name.size() : 0, '0');
+  return directory / (name + segment_extension);
+}
+//------------------------------------------------------------------------------
+void game_journal::run() {
+  while (m_running.load(std::memory_order_relaxed) || !m_queue.empty()) {
+    m_queue.wait();
+    write_batch();
+  }
+}
+//------------------------------------------------------------------------------
+void game_journal::write_batch() {
+  // Everything that queued up while the last batch was synced goes out with
+  // one write and one sync
+  m_queue.consume(static_cast<std::size_t>(-1), [this](record &&r) {
+    if (r.kind == record_kind::sync) {
+      m_waiters.push_back(r.synced);
+    } else if (!m_error) {
+      try {
+        encode(r);
+      } catch (...) {
+        m_error = std::current_exception();
+      }
+    }
+  });
+  if (!m_buffer.empty() && !m_error) {
+    try {
+      write_all(m_file, m_buffer);
+      m_segment_bytes += m_buffer.size();
+      sync_file(m_file);
+    } catch (...) {
+      m_error = std::current_exception();
+    }
+  }
+  m_buffer.clear();
+  for (auto *const waiter : m_waiters) {
+    if (m_error) {
+      waiter->set_exception(m_error);
+    } else {
+      waiter->set_value();
+    }
+  }
+  m_waiters.clear();
+}
+//------------------------------------------------------------------------------
+void game_journal::encode(record const &r) {
+  auto const size = r.kind == record_kind::begin  ? begin_size
+                    : r.kind == record_kind::move ? move_size
+                                                  : end_size;
+  if (m_segment_bytes + m_buffer.size() + size > m_options.segment_size &&
+      m_segment_bytes + m_buffer.size() > magic.size()) {
+    // The records so far complete the current segment
+    write_all(m_file, m_buffer);
+    sync_file(m_file);
+    m_buffer.clear();
+    close_segment();
+    open_segment(segment() + 1);
+    remove_old_segments();
+  }
+  m_buffer.push_back(static_cast<std::uint8_t>(r.kind));
+  put(m_buffer, r.game);
+  switch (r.kind) {
+    case record_kind::begin:
+      put(m_buffer, r.clock);
+      put(m_buffer, r.increment);
+      if (m_begun_in.try_emplace(r.game, segment()).second) {
+        ++m_open_games[segment()];
+      }
+      break;
+    case record_kind::move:
+      put(m_buffer, r.m);
+      put(m_buffer, r.clock);
+      break;
+    case record_kind::end:
+      m_buffer.push_back(static_cast<std::uint8_t>(r.status));
+      if (auto const it = m_begun_in.find(r.game); it != m_begun_in.end()) {
+        if (--m_open_games[it->second] == 0) {
+          m_open_games.erase(it->second);
+        }
+        m_begun_in.erase(it);
+      }
+      break;
+    case record_kind::sync:
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+void game_journal::open_segment(std::uint64_t const number) {
+  m_file = open_file(segment_path(m_options.directory, number));
+  m_segment.store(number, std::memory_order_relaxed);
+  m_segment_bytes = magic.size();
+  write_all(m_file, std::span{reinterpret_cast<std::uint8_t const *>(
+                                  magic.data()),
+                              magic.size()});
+  sync_file(m_file);
+  sync_directory(m_options.directory);
+}
+//------------------------------------------------------------------------------
+void game_journal::close_segment() {
+  if (m_file >= 0) {
+    close_file(m_file);
+    m_file = -1;
+  }
+}
+//------------------------------------------------------------------------------
+// Segments before the one in which the oldest open game began hold no
+// record that recovery needs
+void game_journal::remove_old_segments() {
+  auto const keep = m_open_games.empty()
+                        ? segment()
+                        : std::min(m_open_games.begin()->first, segment());
+  for (; m_first_segment < keep; ++m_first_segment) {
+    auto ec = std::error_code{};
+    std::filesystem::remove(segment_path(m_options.directory, m_first_segment),
+                            ec);
+  }
+}
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
@@ -0,0 +1,148 @@
+#include "chess/server/game_server.h"
+
+#include <iostream>
+//==============================================================================
+namespace chess::server {
+//==============================================================================
+auto update_message::encode(game_id const game,
+                            std::span<std::uint8_t const> const update)
+    -> networking::message<game_message> {
+  auto msg = networking::message<game_message>{tag};
+  msg << game;
+  msg.body.append(update.data(), update.size());
+  msg.header.body_size = static_cast<std::uint32_t>(msg.body.size());
+  return msg;
+}
+//------------------------------------------------------------------------------
+auto update_message::decode(networking::message<game_message> const &msg)
+    -> std::optional<std::tuple<game_id, std::span<std::uint8_t const>>> {
+  constexpr auto prefix = sizeof(game_id);
+  if (msg.header.tag != tag || msg.body.size() < prefix + update_header::size) {
+    return std::nullopt;
+  }
+  auto fields = networking::message<game_message>{};
+  fields.body.append(msg.body.data(), prefix);
+  auto game = game_id{};
+  fields >> game;
+  return std::tuple{game, std::span{msg.body.data() + prefix,
+                                    msg.body.size() - prefix}};
+}
+//==============================================================================
+game_server::game_server(std::uint16_t const port,
+                         std::size_t const network_threads,
+                         session_options const &sessions,
+                         std::chrono::milliseconds const tick_interval)
+    : server_interface{port, network_threads},
+      m_sessions{sessions, &game_server::send_update},
+      m_tick_interval{tick_interval},
+      m_ticker{m_pool.context(0)} {}
+//------------------------------------------------------------------------------
+game_server::~game_server() {
+  // Once the pool stopped neither requests nor ticks reach the shards, which
+  // may still send to the connections meanwhile
+  stop();
+  m_sessions.stop();
+}
+//------------------------------------------------------------------------------
+auto game_server::start() -> bool {
+  m_sessions.start();
+  schedule_tick();
+  return server_interface::start();
+}
+//------------------------------------------------------------------------------
+void game_server::schedule_tick() {
+  m_ticker.expires_after(m_tick_interval);
+  m_ticker.async_wait([this](std::error_code const ec) {
+    if (ec) {
+      return;
+    }
+    m_sessions.tick();
+    schedule_tick();
+  });
+}
+//------------------------------------------------------------------------------
+auto game_server::serve(std::size_t const max_messages, bool const wait)
+    -> std::size_t {
+  return update(m_router, max_messages, wait);
+}
+//------------------------------------------------------------------------------
+bool game_server::on_client_connect(client_ptr /*client*/) { return true; }
+//------------------------------------------------------------------------------
+void game_server::on_unrouted_message(
+    client_ptr const client, networking::message<game_message> & /*msg*/) {
+  std::cout << "[" << client->get_id() << "] Malformed Request.\n";
+}
+//------------------------------------------------------------------------------
+void game_server::send_update(sessions_t::shard::session const &game,
+                              client_ptr const *const recipient,
+                              std::span<std::uint8_t const> const update) {
+  if (recipient != nullptr) {
+    auto const &client = *recipient;
+    if (!client || !client->is_connected()) {
+      return;
+    }
+    auto where = seat::spectator;
+    if (client == game.player(color::white)) {
+      where = seat::white;
+    } else if (client == game.player(color::black)) {
+      where = seat::black;
+    }
+    client->send(seated_message::encode(game.id(), where));
+    client->send(update_message::encode(game.id(), update));
+    return;
+  }
+  // Every recipient queues a reference to the same copy, like a broadcast
+  auto const shared = std::make_shared<networking::message<game_message> const>(
+      update_message::encode(game.id(), update));
+  game.for_each_recipient([&](client_ptr const &client) {
+    if (client && client->is_connected()) {
+      client->send(shared);
+    }
+  });
+}
+//==============================================================================
+void game_server::requests::on_message(seek_message, client_ptr const &client,
+                                       std::uint32_t const initial,
+                                       std::uint32_t const increment) {
+  auto &seeking = server.m_seeking;
+  if (!seeking || !seeking->is_connected() || seeking == client) {
+    seeking          = client;
+    server.m_seek_tc = {std::chrono::milliseconds{initial},
+                        std::chrono::milliseconds{increment}};
+    return;
+  }
+  server.m_sessions.create_game(std::move(seeking), client, server.m_seek_tc);
+  seeking = nullptr;
+}
+//------------------------------------------------------------------------------
+void game_server::requests::on_message(play_message, client_ptr const &client,
+                                       game_id const game,
+                                       std::uint16_t const m) {
+  server.m_sessions.play(game, client, move::from_raw(m));
+}
+//------------------------------------------------------------------------------
+void game_server::requests::on_message(resign_message,
+                                       client_ptr const &client,
+                                       game_id const game) {
+  server.m_sessions.resign(game, client);
+}
+//------------------------------------------------------------------------------
+void game_server::requests::on_message(spectate_message,
+                                       client_ptr const &client,
+                                       game_id const game) {
+  server.m_sessions.spectate(game, client);
+}
+//------------------------------------------------------------------------------
+void game_server::requests::on_message(leave_message, client_ptr const &client,
+                                       game_id const game) {
+  server.m_sessions.leave(game, client);
+}
+//------------------------------------------------------------------------------
+void game_server::requests::on_message(rejoin_message,
+                                       client_ptr const &client,
+                                       game_id const game, color const side) {
+  server.m_sessions.rejoin(game, client, side);
+}
+//==============================================================================
+} // namespace chess::server
+//==============================================================================
@@ -1,3 +1,205 @@
-auto main() -> int {
+#include <chess/server/bot.h>
+#include <chess/server/game_journal.h>
+#include <chess/server/game_server.h>
 
+#include <algorithm>
+#include <charconv>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+constexpr auto usage =
+    "usage: server [--port n] [--network-threads n] [--shards n]\n"
+    "              [--journal directory]\n"
+    "       server --stdin [--threads n] [--thread-budget n] [--hash mb]\n"
+    "              [--overhead ms] [--network file] [--book file]\n"
+    "              [--book-plies n] [--book-best]\n";
+//------------------------------------------------------------------------------
+auto parse_number(std::string_view const text) -> std::optional<std::size_t> {
+  auto value = std::size_t{0};
+  auto const [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || ptr != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+//------------------------------------------------------------------------------
+struct options {
+  std::uint16_t                  port = 60000;
+  std::size_t                    network_threads =
+      std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  chess::server::session_options sessions;
+  /// Directory of the game journal, without one a restart loses all games.
+  std::optional<std::string>     journal;
+  /// Answers bot move requests on stdin instead of serving games.
+  bool                           stdin_bot = false;
+  chess::server::bot_settings bot;
+  std::size_t thread_budget =
+      std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+};
+//------------------------------------------------------------------------------
+/// Throws std::invalid_argument for unknown or malformed options and
+/// whatever loading the network or book throws.
+auto parse_options(int const argc, char **argv) -> options {
+  auto result = options{};
+  for (auto i = 1; i < argc; ++i) {
+    auto const name  = std::string_view{argv[i]};
+    auto const value = [&]() -> std::string_view {
+      if (i + 1 == argc) {
+        throw std::invalid_argument{"missing value of " + std::string{name}};
+      }
+      return argv[++i];
+    };
+    auto const number = [&] {
+      auto const v = value();
+      if (auto const n = parse_number(v)) {
+        return *n;
+      }
+      throw std::invalid_argument{"invalid number: " + std::string{v}};
+    };
+    if (name == "--port") {
+      auto const port = number();
+      if (port > 65535) {
+        throw std::invalid_argument{"invalid port: " + std::to_string(port)};
+      }
+      result.port = static_cast<std::uint16_t>(port);
+    } else if (name == "--network-threads") {
+      result.network_threads = number();
+    } else if (name == "--shards") {
+      result.sessions.shards = number();
+    } else if (name == "--journal") {
+      result.journal = std::string{value()};
+    } else if (name == "--stdin") {
+      result.stdin_bot = true;
+    } else if (name == "--threads") {
+      result.bot.threads = number();
+    } else if (name == "--thread-budget") {
+      result.thread_budget = number();
+    } else if (name == "--hash") {
+      result.bot.hash_megabytes = number();
+    } else if (name == "--overhead") {
+      result.bot.move_overhead = std::chrono::milliseconds{number()};
+    } else if (name == "--network") {
+      result.bot.network =
+          std::make_shared<chess::engine::nnue::network const>(value());
+    } else if (name == "--book") {
+      result.bot.book =
+          std::make_shared<chess::engine::polyglot_book const>(value());
+    } else if (name == "--book-plies") {
+      result.bot.book_selection.max_ply = static_cast<int>(number());
+    } else if (name == "--book-best") {
+      result.bot.book_selection.weighted_random = false;
+    } else {
+      throw std::invalid_argument{"unknown option " + std::string{name}};
+    }
+  }
+  if (!result.stdin_bot) {
+    return result;
+  }
+  // one transposition table serves the searches of all games, it ages once
+  // per second rather than with each of their searches
+  result.bot.table = std::make_shared<chess::transposition_table>(
+      result.bot.hash_megabytes);
+  result.bot.table->set_age_interval(std::chrono::seconds{1});
+  return result;
+}
+//------------------------------------------------------------------------------
+/// Serves games on opts.port until the process is terminated. The calling
+/// thread routes the requests of the clients, the network threads and the
+/// shards do everything else.
+///
+/// With a journal the games of the last run continue. Their players are
+/// gone with the old connections, so the seats stay empty until a client
+/// rejoins them, and the clocks run as if the server never stopped.
+auto serve_games(options const &opts) -> int {
+  using chess::server::game_journal;
+  auto recovery = chess::server::journal_recovery{};
+  auto journal  = std::optional<game_journal>{};
+  auto sessions = opts.sessions;
+  if (opts.journal) {
+    try {
+      recovery = game_journal::recover(*opts.journal);
+      journal.emplace(chess::server::journal_options{*opts.journal},
+                      recovery.games);
+    } catch (std::exception const &e) {
+      std::cerr << "cannot open the journal: " << e.what() << '\n';
+      return 1;
+    }
+    sessions.journal = &*journal;
+    std::cout << "[SERVER] Recovered " << recovery.games.size()
+              << " Games.\n";
+  }
+  auto server = chess::server::game_server{opts.port, opts.network_threads,
+                                           sessions};
+  using client_ptr = chess::server::game_server::client_ptr;
+  server.sessions().restore(recovery, [](auto const &) {
+    return std::pair{client_ptr{}, client_ptr{}};
+  });
+  if (!server.start()) {
+    return 1;
+  }
+  while (true) {
+    server.serve(static_cast<std::size_t>(-1), true);
+  }
+}
+//------------------------------------------------------------------------------
+/// Bot moves are requested line by line on stdin as
+/// "<latency budget in ms> <fen>" and answered on stdout.
+///
+/// The thread budget shared by all searches defaults to the number of cores.
+/// Network, book and the transposition table exist once and are shared by
+/// every game.
+auto answer_bot_requests(options const &opts) -> int {
+  auto budget   = chess::engine::thread_budget{opts.thread_budget};
+  auto computer = chess::server::bot{opts.bot, &budget};
+
+  auto line = std::string{};
+  while (std::getline(std::cin, line)) {
+    auto const separator = line.find(' ');
+    if (separator == std::string::npos) {
+      std::cout << "error expected \"<budget ms> <fen>\"" << std::endl;
+      continue;
+    }
+    try {
+      auto const board = chess::chess_board{
+          std::string_view{line}.substr(separator + 1)};
+      auto const latency_budget = std::chrono::milliseconds{
+          parse_number(std::string_view{line}.substr(0, separator))
+              .value_or(1000)};
+      auto const result = computer.request_move(board, latency_budget);
+      std::cout << "bestmove "
+                << (result.best_move.is_null() ? "0000"
+                                               : result.best_move.to_uci())
+                << " score " << result.score << " depth " << result.depth
+                << " nodes " << result.nodes << " time "
+                << result.elapsed.count() << std::endl;
+    } catch (std::invalid_argument const &e) {
+      std::cout << "error " << e.what() << std::endl;
+    }
+  }
+  return 0;
+}
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+/// Serves games to the clients that connect, or with --stdin answers bot move
+/// requests on stdin.
+auto main(int argc, char **argv) -> int {
+  auto opts = options{};
+  try {
+    opts = parse_options(argc, argv);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << '\n' << usage;
+    return 2;
+  }
+  return opts.stdin_bot ? answer_bot_requests(opts) : serve_games(opts);
 }
@@ -0,0 +1,544 @@
+#include <catch2/catch_test_macros.hpp>
+//==============================================================================
+#include <chess/movegen.h>
+#include <chess/networking/client_interface.h>
+#include <chess/replication.h>
+#include <chess/server/game_journal.h>
+#include <chess/server/game_server.h>
+#include <chess/server/game_session.h>
+#include <chess/server/session_manager.h>
+//==============================================================================
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+//==============================================================================
+using chess::color;
+using chess::game_status;
+using chess::server::game_id;
+using chess::server::time_control;
+using namespace std::chrono_literals;
+//------------------------------------------------------------------------------
+// Players are plain numbers, white is 1 and black is 2
+using session = chess::server::game_session<int>;
+using manager = chess::server::session_manager<int>;
+using game_clock = session::clock;
+//------------------------------------------------------------------------------
+// Plays the moves alternately for white and black, false as soon as one is
+// refused
+auto play(session &game, std::initializer_list<char const *> const moves,
+          game_clock::time_point const now) -> bool {
+  for (auto const uci : moves) {
+    auto const mover =
+        game.get_position().side_to_move() == color::white ? 1 : 2;
+    if (!game.play(mover, chess::parse_move(game.get_position(), uci), now)) {
+      return false;
+    }
+  }
+  return true;
+}
+//==============================================================================
+TEST_CASE( "game_session::play" ) {
+  auto const start = game_clock::now();
+
+  SECTION( "turn order and illegal moves" ) {
+    auto game = session{1, 1, 2, time_control{}, start};
+    auto const e2e4 = chess::parse_move(game.get_position(), "e2e4");
+    // black and strangers cannot move for white
+    REQUIRE_FALSE(game.play(2, e2e4, start));
+    REQUIRE_FALSE(game.play(3, e2e4, start));
+    REQUIRE_FALSE(game.play(1, chess::move{chess::e2, chess::e5}, start));
+    REQUIRE(game.get_position().side_to_move() == color::white);
+    REQUIRE(game.play(1, e2e4, start));
+    // white cannot move twice
+    REQUIRE_FALSE(play(game, {"d2d4"}, start));
+    REQUIRE(game.get_position().side_to_move() == color::black);
+    REQUIRE(game.state().status() == game_status::ongoing);
+  }
+  SECTION( "mate" ) {
+    auto game = session{1, 1, 2, time_control{}, start};
+    REQUIRE(play(game, {"f2f3", "e7e5", "g2g4", "d8h4"}, start));
+    REQUIRE(game.is_over());
+    REQUIRE(game.state().status() == game_status::black_won);
+    REQUIRE_FALSE(play(game, {"a2a3"}, start));
+  }
+  SECTION( "stalemate" ) {
+    auto game = session{1, 1, 2, time_control{}, start};
+    REQUIRE(play(game,
+                 {"e2e3", "a7a5", "d1h5", "a8a6", "h5a5", "h7h5", "h2h4",
+                  "a6h6", "a5c7", "f7f6", "c7d7", "e8f7", "d7b7", "d8d3",
+                  "b7b8", "d3h7", "b8c8", "f7g6", "c8e6"},
+                 start));
+    REQUIRE(game.state().status() == game_status::draw);
+  }
+  SECTION( "fifty move rule" ) {
+    auto game = session{1, 1, 2, time_control{}, start};
+    for (auto i = 0; i < 24; ++i) {
+      REQUIRE(play(game, {"g1f3", "g8f6", "f3g1", "f6g8"}, start));
+    }
+    REQUIRE(play(game, {"g1f3", "g8f6", "f3g1"}, start));
+    REQUIRE(game.state().status() == game_status::ongoing);
+    REQUIRE(play(game, {"f6g8"}, start));
+    REQUIRE(game.state().status() == game_status::draw);
+  }
+  SECTION( "clocks and increment" ) {
+    auto game = session{1, 1, 2, time_control{60s, 2s}, start};
+    REQUIRE(play(game, {"e2e4"}, start + 500ms));
+    REQUIRE(game.state().clock(color::white) == 61500);
+    REQUIRE(game.state().clock(color::black) == 60000);
+    REQUIRE(game.time_left(start + 1500ms) == 59000ms);
+    // black's time runs out before the move
+    REQUIRE_FALSE(play(game, {"e7e5"}, start + 61s));
+    REQUIRE(game.state().status() == game_status::white_won);
+    REQUIRE(game.state().clock(color::black) == 0);
+  }
+  SECTION( "flag fall without a move" ) {
+    auto game = session{1, 1, 2, time_control{1s, 0s}, start};
+    REQUIRE_FALSE(game.check_flag(start + 999ms));
+    REQUIRE(game.check_flag(start + 1s));
+    REQUIRE(game.state().status() == game_status::black_won);
+  }
+}
+//==============================================================================
+TEST_CASE( "game_session::resign, game_session::leave" ) {
+  auto const start = game_clock::now();
+  auto game        = session{1, 1, 2, time_control{}, start};
+  REQUIRE_FALSE(game.resign(3));
+  REQUIRE(game.resign(2));
+  REQUIRE(game.state().status() == game_status::white_won);
+  REQUIRE_FALSE(game.resign(1));
+
+  auto left = session{2, 1, 2, time_control{}, start};
+  left.add_spectator(3);
+  left.add_spectator(3);
+  REQUIRE(left.spectators().size() == 1);
+  // spectators leave without consequences, players abort the game
+  left.leave(3);
+  REQUIRE(left.spectators().empty());
+  REQUIRE(left.state().status() == game_status::ongoing);
+  left.leave(1);
+  REQUIRE(left.state().status() == game_status::aborted);
+}
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+// Game ids and recipients of the updates a manager sent, in order, 0 for
+// the updates to all players and spectators
+struct update_log {
+  std::vector<game_id> games;
+  std::vector<int>     recipients;
+  //----------------------------------------------------------------------------
+  auto handler() -> manager::update_handler {
+    return [this](session const &game, int const *recipient,
+                  std::span<std::uint8_t const>) {
+      games.push_back(game.id());
+      recipients.push_back(recipient != nullptr ? *recipient : 0);
+    };
+  }
+  //----------------------------------------------------------------------------
+  void clear() {
+    games.clear();
+    recipients.clear();
+  }
+};
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+TEST_CASE( "session_manager::create_game" ) {
+  auto log = update_log{};
+  auto m   = manager{{.shards = 3}, log.handler()};
+  auto ids = std::vector<game_id>{};
+  for (auto i = 0; i < 7; ++i) {
+    ids.push_back(m.create_game(1, 2));
+  }
+  REQUIRE(ids == std::vector<game_id>{1, 2, 3, 4, 5, 6, 7});
+  for (auto const id : ids) {
+    REQUIRE(m.shard_of(id) == id % 3);
+  }
+  // the shards were not started, their owner runs them
+  REQUIRE(m.get_shard(0).process() == 2);
+  REQUIRE(m.get_shard(1).process() == 3);
+  REQUIRE(m.get_shard(2).process() == 2);
+  REQUIRE(m.get_shard(1).game_count() == 3);
+  REQUIRE(m.game_count() == 7);
+  // every game started with a keyframe to each of its players
+  REQUIRE(log.games.size() == 14);
+  REQUIRE(std::ranges::count(log.recipients, 0) == 0);
+}
+//==============================================================================
+TEST_CASE( "session_shard::flush" ) {
+  auto log    = update_log{};
+  auto m      = manager{{.shards = 1}, log.handler()};
+  auto &shard = m.get_shard(0);
+  auto const a = m.create_game(1, 2);
+  auto const b = m.create_game(3, 4);
+  auto const c = m.create_game(5, 6);
+  shard.process();
+  log.clear();
+
+  auto const e2e4 = chess::move{chess::e2, chess::e4,
+                                chess::move::flag::double_pawn_push};
+  // the spectator alone gets a keyframe, the moved game sends its delta to
+  // everybody and the third game nothing
+  m.play(b, 3, e2e4);
+  m.spectate(a, 7);
+  shard.process();
+  REQUIRE(log.games == std::vector<game_id>{a, b});
+  REQUIRE(log.recipients == std::vector{7, 0});
+  log.clear();
+
+  // a refused move is no change and sends nothing
+  m.play(a, 2, e2e4);
+  shard.process();
+  REQUIRE(log.games.empty());
+
+  // a finished game sends its final update and is closed
+  m.resign(c, 6);
+  shard.process();
+  REQUIRE(log.games == std::vector<game_id>{c});
+  REQUIRE(shard.game_count() == 2);
+  log.clear();
+  m.play(c, 5, e2e4);
+  m.resign(c, 5);
+  shard.process();
+  REQUIRE(log.games.empty());
+  REQUIRE(m.game_count() == 2);
+}
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+using chess::server::game_journal;
+//------------------------------------------------------------------------------
+// Empty directory that is removed again with its segments
+struct temp_directory {
+  std::filesystem::path path;
+  //----------------------------------------------------------------------------
+  explicit temp_directory(char const *name)
+      : path{std::filesystem::temp_directory_path() / name} {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  ~temp_directory() {
+    auto ec = std::error_code{};
+    std::filesystem::remove_all(path, ec);
+  }
+  //----------------------------------------------------------------------------
+  auto segment(std::uint64_t const number) const {
+    return game_journal::segment_path(path, number);
+  }
+};
+//------------------------------------------------------------------------------
+auto const e2e4 = chess::move{chess::e2, chess::e4,
+                              chess::move::flag::double_pawn_push};
+auto const e7e5 = chess::move{chess::e7, chess::e5,
+                              chess::move::flag::double_pawn_push};
+auto const g1f3 = chess::move{chess::g1, chess::f3};
+auto const tc   = time_control{std::chrono::minutes{5}, std::chrono::seconds{3}};
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+TEST_CASE( "game_journal segments" ) {
+  auto const dir = temp_directory{"chess-journal-segments"};
+  // the magic and a begin record leave room for two moves
+  auto journal = game_journal{{.directory = dir.path, .segment_size = 64}};
+  journal.begin(1, tc);
+  journal.record_move(1, e2e4, 299'000);
+  journal.record_move(1, e7e5, 298'000);
+  journal.sync();
+  REQUIRE(journal.segment() == 1);
+
+  // the third move rotates, game 1 keeps its first segment alive
+  journal.record_move(1, g1f3, 297'000);
+  journal.sync();
+  REQUIRE(journal.segment() == 2);
+  REQUIRE(std::filesystem::exists(dir.segment(1)));
+
+  // once it ended, the oldest open game began in segment 2
+  journal.end(1, game_status::white_won);
+  journal.begin(2, tc);
+  journal.record_move(2, e2e4, 299'500);
+  journal.sync();
+  REQUIRE(journal.segment() == 3);
+  REQUIRE_FALSE(std::filesystem::exists(dir.segment(1)));
+  REQUIRE(std::filesystem::exists(dir.segment(2)));
+
+  auto const recovery = game_journal::recover(dir.path);
+  REQUIRE(recovery.last_id == 2);
+  REQUIRE(recovery.games.size() == 1);
+  REQUIRE(recovery.games[0].id == 2);
+  REQUIRE(recovery.games[0].moves == std::vector{e2e4});
+  REQUIRE(recovery.games[0].clocks[0] == 299'500);
+}
+//==============================================================================
+TEST_CASE( "game_journal::recover" ) {
+  auto const dir = temp_directory{"chess-journal-recover"};
+  {
+    auto journal = game_journal{{.directory = dir.path}};
+    journal.begin(1, tc);
+    journal.record_move(1, e2e4, 299'000);
+    journal.begin(2, tc);
+    journal.end(2, game_status::aborted);
+  }
+  SECTION( "a torn record ends the journal" ) {
+    // half a move of game 1, and a later segment that begins game 3
+    auto torn = std::ofstream{dir.segment(1), std::ios::binary | std::ios::app};
+    torn.write("\x02\x01\x00\x00", 4);
+    torn.close();
+    auto later = std::ofstream{dir.segment(2), std::ios::binary};
+    later.write("CHSJRNL1", 8);
+    later.write("\x01\x03\x00\x00\x00\x00\x00\x00\x00"
+                "\xe0\x93\x04\x00\xb8\x0b\x00\x00",
+                17);
+    later.close();
+
+    auto const recovery = game_journal::recover(dir.path);
+    REQUIRE(recovery.last_id == 2);
+    REQUIRE(recovery.games.size() == 1);
+    REQUIRE(recovery.games[0].id == 1);
+    REQUIRE(recovery.games[0].moves == std::vector{e2e4});
+  }
+  SECTION( "a new journal copies the open games" ) {
+    auto const recovery = game_journal::recover(dir.path);
+    REQUIRE(recovery.games.size() == 1);
+    {
+      auto journal = game_journal{{.directory = dir.path}, recovery.games};
+      REQUIRE(journal.segment() == 2);
+      REQUIRE_FALSE(std::filesystem::exists(dir.segment(1)));
+      journal.record_move(1, e7e5, 298'000);
+    }
+    auto const again = game_journal::recover(dir.path);
+    REQUIRE(again.games.size() == 1);
+    REQUIRE(again.games[0].tc.initial == tc.initial);
+    REQUIRE(again.games[0].tc.increment == tc.increment);
+    REQUIRE(again.games[0].moves == std::vector{e2e4, e7e5});
+    REQUIRE(again.games[0].clocks == std::array<std::uint32_t, 2>{299'000,
+                                                                  298'000});
+    // the ended game was dropped, its id is only known through the copy
+    REQUIRE(again.last_id == 1);
+  }
+}
+//==============================================================================
+TEST_CASE( "session_manager::restore" ) {
+  auto log = update_log{};
+  auto m   = manager{{.shards = 2}, log.handler()};
+  auto recovery = chess::server::journal_recovery{};
+  recovery.games.push_back(
+      {.id = 3, .tc = tc, .moves = {e2e4}, .clocks = {299'000, 300'000}});
+  recovery.last_id = 5;
+  // nobody sits at the restored game until a player rejoins it
+  m.restore(recovery, [](auto const &) { return std::pair{0, 0}; });
+  REQUIRE(m.game_count() == 1);
+  REQUIRE(log.games.empty());
+
+  REQUIRE(m.create_game(1, 2) == 6);
+  m.get_shard(0).process();
+  m.get_shard(1).process();
+  log.clear();
+
+  auto &shard = m.get_shard(m.shard_of(3));
+  m.play(3, 2, e7e5);
+  shard.process();
+  REQUIRE(log.games.empty());
+  // the rejoined player gets a keyframe and continues the game
+  m.rejoin(3, 2, color::black);
+  m.rejoin(3, 4, color::black);
+  m.play(3, 2, e7e5);
+  shard.process();
+  REQUIRE(log.games == std::vector<game_id>{3, 3});
+  REQUIRE(log.recipients == std::vector{2, 0});
+  REQUIRE(m.game_count() == 2);
+}
+//==============================================================================
+#if defined(__linux__)
+TEST_CASE( "session_shard aborts games the journal lost" ) {
+  auto const dir = temp_directory{"chess-journal-full"};
+  auto journal = game_journal{{.directory = dir.path, .segment_size = 64}};
+  // the next segment is on a full disk
+  std::filesystem::create_symlink("/dev/full", dir.segment(2));
+  auto log    = update_log{};
+  auto m      = manager{{.shards = 1, .journal = &journal}, log.handler()};
+  auto &shard = m.get_shard(0);
+  auto const a = m.create_game(1, 2, tc);
+  shard.process();
+  REQUIRE(shard.game_count() == 1);
+  log.clear();
+
+  m.play(a, 1, e2e4);
+  m.play(a, 2, e7e5);
+  shard.process();
+  REQUIRE(shard.game_count() == 1);
+  log.clear();
+
+  // the move that rotates cannot be written, the game ends with it
+  m.play(a, 1, g1f3);
+  shard.process();
+  REQUIRE(log.games == std::vector<game_id>{a});
+  REQUIRE(shard.game_count() == 0);
+
+  // and so does every game after it
+  m.create_game(3, 4, tc);
+  shard.process();
+  REQUIRE(shard.game_count() == 0);
+}
+#endif
+//==============================================================================
+namespace {
+//------------------------------------------------------------------------------
+// Client of a game_server that follows the state of its game
+struct remote_player {
+  chess::networking::client_interface<chess::server::game_message> client;
+  chess::replicated_game             state;
+  std::optional<chess::server::seat> where;
+  game_id                            game = 0;
+  //----------------------------------------------------------------------------
+  std::size_t                        updates = 0;
+  //----------------------------------------------------------------------------
+  void receive() {
+    client.incoming().consume(16, [&](auto &&msg) {
+      if (auto const seated = chess::server::seated_message::decode(msg)) {
+        std::tie(game, where) = *seated;
+        return;
+      }
+      auto const update = chess::server::update_message::decode(msg);
+      REQUIRE(update);
+      auto const [id, bytes] = *update;
+      REQUIRE(id == game);
+      state.apply(bytes);
+      ++updates;
+    });
+  }
+};
+//------------------------------------------------------------------------------
+} // namespace
+//==============================================================================
+TEST_CASE( "game_server" ) {
+  using chess::server::seat;
+  auto server = chess::server::game_server{8090, 1, {.shards = 2}};
+  REQUIRE(server.start());
+
+  // the test thread is the server's game loop
+  auto const deadline = std::chrono::steady_clock::now() + 10s;
+  auto       handled  = std::size_t{0};
+  auto wait_until     = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      handled += server.serve();
+      std::this_thread::sleep_for(1ms);
+    }
+    return condition();
+  };
+  using player = remote_player;
+  auto white = player{};
+  auto black = player{};
+  white.client.connect("localhost", 8090);
+  black.client.connect("localhost", 8090);
+  REQUIRE(wait_until([&] {
+    return white.client.is_connected() && black.client.is_connected() &&
+           server.connection_count() == 2;
+  }));
+
+  // the first seeking client plays white with its time control
+  white.client.send(chess::server::seek_message::encode(60000, 0));
+  REQUIRE(wait_until([&] { return handled == 1; }));
+  black.client.send(chess::server::seek_message::encode(1000, 0));
+  REQUIRE(wait_until([&] {
+    white.receive();
+    black.receive();
+    return white.where && black.where;
+  }));
+  REQUIRE(*white.where == seat::white);
+  REQUIRE(*black.where == seat::black);
+  REQUIRE(white.game == black.game);
+  REQUIRE(white.state.clock(color::black) == 60000);
+  REQUIRE(white.state.status() == game_status::ongoing);
+
+  // a move goes to the shard of the game, both players see it
+  white.client.send(chess::server::play_message::encode(
+      white.game,
+      chess::move{chess::e2, chess::e4, chess::move::flag::double_pawn_push}
+          .raw()));
+  REQUIRE(wait_until([&] {
+    white.receive();
+    black.receive();
+    return black.state.side_to_move() == color::black;
+  }));
+  REQUIRE(black.state.piece_at(chess::e4) == chess::piece::white_pawn);
+  REQUIRE(black.state.piece_at(chess::e2) == chess::piece::none);
+
+  // a spectator joins with a keyframe of its own, the players get nothing
+  auto watcher = player{};
+  watcher.client.connect("localhost", 8090);
+  REQUIRE(wait_until([&] {
+    return watcher.client.is_connected() && server.connection_count() == 3;
+  }));
+  auto const updates = white.updates;
+  watcher.client.send(chess::server::spectate_message::encode(white.game));
+  REQUIRE(wait_until([&] {
+    watcher.receive();
+    return watcher.updates == 1;
+  }));
+  REQUIRE(*watcher.where == seat::spectator);
+  REQUIRE(watcher.game == white.game);
+  REQUIRE(watcher.state.piece_at(chess::e4) == chess::piece::white_pawn);
+  white.receive();
+  REQUIRE(white.updates == updates);
+
+  black.client.send(chess::server::resign_message::encode(black.game));
+  REQUIRE(wait_until([&] {
+    white.receive();
+    black.receive();
+    watcher.receive();
+    return white.state.status() == game_status::white_won &&
+           watcher.state.status() == game_status::white_won &&
+           server.sessions().game_count() == 0;
+  }));
+}
+//==============================================================================
+TEST_CASE( "game_server flags idle games" ) {
+  auto server = chess::server::game_server{8091, 1, {.shards = 2}};
+  REQUIRE(server.start());
+  auto const deadline = std::chrono::steady_clock::now() + 10s;
+  auto       handled  = std::size_t{0};
+  auto wait_until     = [&](auto &&condition) {
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+      handled += server.serve();
+      std::this_thread::sleep_for(1ms);
+    }
+    return condition();
+  };
+  auto white = remote_player{};
+  auto black = remote_player{};
+  white.client.connect("localhost", 8091);
+  black.client.connect("localhost", 8091);
+  REQUIRE(wait_until([&] { return server.connection_count() == 2; }));
+  white.client.send(chess::server::seek_message::encode(50, 0));
+  REQUIRE(wait_until([&] { return handled == 1; }));
+  black.client.send(chess::server::seek_message::encode(50, 0));
+  REQUIRE(wait_until([&] {
+    white.receive();
+    black.receive();
+    return white.game != 0 && white.game == black.game;
+  }));
+
+  // nobody moves, the server's clock tick ends the game on time
+  auto const started = std::chrono::steady_clock::now();
+  REQUIRE(wait_until([&] {
+    white.receive();
+    black.receive();
+    return white.state.status() == game_status::black_won &&
+           black.state.status() == game_status::black_won;
+  }));
+  REQUIRE(std::chrono::steady_clock::now() - started < 1s);
+  REQUIRE(white.state.clock(color::white) == 0);
+  REQUIRE(wait_until([&] { return server.sessions().game_count() == 0; }));
+}
+//==============================================================================